@@ -0,0 +1,748 @@
+#include "batch.h"
+#include "endian.h"
+#include "io.h"
+#include "pool.h"
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WRITE_MAX (1 << 30) // Most bytes handed to write_bytes at once, which counts in an int.
+
+// Stream and buffers of a worker, kept from one file to the next
+typedef struct Worker Worker;
+
+struct Worker {
+    lz_stream *stream;
+    uint8_t *in, *out; // size bytes each
+    Worker *next; // on the idle stack
+};
+
+// Archive mapped for decompression, whose members are read straight out of the mapping
+typedef struct Archive Archive;
+
+struct Archive {
+    InputMap map;
+    Archive *next;
+};
+
+typedef struct Batch {
+    Pool *pool;
+    bool compress;
+    lz_options options; // compressing
+    size_t size; // bytes read or written at a time
+    bool direct;
+    bool force; // outputs that exist already are overwritten rather than refused
+
+    int archive; // compressing into an archive, -1 if not
+    struct Job **queue; // jobs gathered before any of them runs
+    uint64_t jobs, room; // jobs in queue, and room in it
+    uint64_t turn; // place of the member to be written next
+
+    pthread_mutex_t lock;
+    pthread_cond_t turned; // signalled whenever turn moves on
+    Worker *idle; // workers between files, at most one per thread of the pool
+    Archive *maps; // decompressing
+    int failed;
+    lz_stats stats;
+    IoCounters io; // of the pool threads, handed over after each file
+} Batch;
+
+// One file, or one member of an archive
+typedef struct Job {
+    Batch *batch;
+    char *name; // what the file is reported as
+    const char *input; // file to read, NULL for a member
+    const uint8_t *data; // member in a mapped archive
+    size_t size; // bytes of the member
+    char *output; // NULL for a test, or for a member compressed into the archive
+    char *member; // name stored in the archive, NULL if not compressing into one
+    uint64_t turn; // place in the queue and in the archive
+    const char *error; // why the job fails before it starts, NULL if it does not
+} Job;
+
+// Where coded bytes go: a file, memory, or nowhere for a test
+typedef struct Sink {
+    int fd;
+    bool memory;
+    uint8_t *data;
+    size_t size, room;
+    bool ok; // nothing failed to be written
+} Sink;
+
+// Appends a copy of name, doubling the room whenever it runs out
+bool batch_list_add(BatchList *list, const char *name) {
+    if (list->count == list->size) {
+        int size = list->size ? 2 * list->size : 16;
+        char **grown = (char **) realloc(list->names, size * sizeof(char *));
+
+        if (grown == NULL)
+            return false;
+        list->names = grown;
+        list->size = size;
+    }
+
+    list->names[list->count] = strdup(name);
+    return list->names[list->count++] != NULL;
+}
+
+// Reads one name per line
+bool batch_list_read(BatchList *list, const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char *line = NULL;
+    size_t room = 0;
+    ssize_t n;
+    bool ok = file != NULL;
+
+    while (ok && (n = getline(&line, &room, file)) >= 0) {
+        // a list written on another system may end its lines with \r\n
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+            line[--n] = '\0';
+
+        if (n > 0)
+            ok = batch_list_add(list, line);
+    }
+
+    free(line);
+    if (file != NULL && file != stdin)
+        fclose(file);
+    return ok;
+}
+
+// Frees every name
+void batch_list_free(BatchList *list) {
+    for (int i = 0; i < list->count; i++)
+        free(list->names[i]);
+
+    free(list->names);
+    memset(list, 0, sizeof(BatchList));
+}
+
+// Looks at the first magic without moving the offset, which pipes and terminals do not even get
+// to, since nothing read from them could be put back
+bool batch_is_archive(int fd) {
+    struct stat st;
+    uint8_t magic[4];
+
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+           && pread(fd, magic, sizeof(magic), 0) == sizeof(magic)
+           && load_le32(magic) == ARCHIVE_MAGIC;
+}
+
+// Sums the statistics of one file into those of the batch
+static void stats_add(lz_stats *sum, const lz_stats *stats) {
+    sum->counters = stats->counters;
+    sum->total_in += stats->total_in;
+    sum->total_out += stats->total_out;
+    sum->lookups += stats->lookups;
+    sum->phrases += stats->phrases;
+    sum->resets += stats->resets;
+    sum->lzw = sum->lzw || stats->lzw;
+    sum->codec_ns += stats->codec_ns;
+
+    for (int i = 0; i <= MAX_BITS; i++)
+        sum->pairs[i] += stats->pairs[i];
+}
+
+// Destructor for Worker
+static void worker_delete(Worker *w) {
+    if (w->stream != NULL)
+        lz_stream_delete(w->stream);
+
+    free(w->in);
+    free(w->out);
+    free(w);
+}
+
+// Takes an idle worker and resets its stream for a new file, or makes a new one if none is idle,
+// returns NULL if memory ran out
+static Worker *worker_take(Batch *b) {
+    pthread_mutex_lock(&b->lock);
+    Worker *w = b->idle;
+    if (w != NULL)
+        b->idle = w->next;
+    pthread_mutex_unlock(&b->lock);
+
+    if (w != NULL) {
+        lz_stream_reset(w->stream);
+        return w;
+    }
+
+    w = (Worker *) calloc(1, sizeof(Worker));
+    if (w == NULL)
+        return NULL;
+
+    // one chunk at a time, the batch already keeps every thread busy with files of its own
+    w->stream = b->compress ? lz_compress_create(&b->options) : lz_decompress_create(1);
+    w->in = alloc_buffer(b->size);
+    w->out = alloc_buffer(b->size);
+
+    if (w->stream == NULL || w->in == NULL || w->out == NULL) {
+        worker_delete(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+// Puts a worker back on the idle stack once its file is done
+static void worker_give(Batch *b, Worker *w) {
+    pthread_mutex_lock(&b->lock);
+    w->next = b->idle;
+    b->idle = w;
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Writes n bytes of buf to fd, however large n is, returns false if they could not all be written
+static bool write_all(int fd, const uint8_t *buf, size_t n) {
+    while (n > 0) {
+        int part = n < WRITE_MAX ? (int) n : WRITE_MAX;
+
+        if (write_bytes(fd, (uint8_t *) buf, part) != part)
+            return false;
+        buf += part;
+        n -= part;
+    }
+
+    return true;
+}
+
+// Hands n coded bytes of buf over to the sink
+static void sink_put(Sink *sink, const uint8_t *buf, size_t n) {
+    if (sink->fd >= 0) {
+        sink->ok = sink->ok && write_all(sink->fd, buf, n);
+        return;
+    }
+
+    if (!sink->memory || !sink->ok)
+        return;
+
+    // doubles, so a member costs no more than a few copies however it grows
+    if (sink->size + n > sink->room) {
+        size_t room = sink->room ? sink->room : n;
+        while (room < sink->size + n)
+            room *= 2;
+
+        uint8_t *grown = (uint8_t *) realloc(sink->data, room);
+        if (grown == NULL) {
+            sink->ok = false;
+            return;
+        }
+        sink->data = grown;
+        sink->room = room;
+    }
+
+    memcpy(sink->data + sink->size, buf, n);
+    sink->size += n;
+}
+
+// Runs a file through the stream of w into sink: the n bytes at data if it is not NULL, otherwise
+// infile to its end, mapped if it is a regular file larger than a buffer
+static lz_status code_file(
+    Batch *b, Worker *w, const uint8_t *data, size_t n, int infile, Sink *sink) {
+    InputMap map;
+    struct stat st;
+    lz_status status = LZ_OK;
+
+    // a small file takes a single read, which is cheaper than setting up a mapping and tearing it
+    // down again, which also has to flush the TLBs of the other workers
+    bool mapped = data == NULL && !b->direct && fstat(infile, &st) == 0
+                  && (size_t) st.st_size > b->size && map_input(infile, &map);
+    if (mapped) {
+        data = map.data;
+        n = map.size;
+    }
+
+    const uint8_t *next_in = data != NULL ? data : w->in;
+    size_t avail_in = data != NULL ? n : 0;
+    bool eof = data != NULL;
+    uint8_t *next_out = w->out;
+    size_t avail_out = b->size;
+
+    while (status == LZ_OK) {
+        if (avail_in == 0 && !eof) {
+            int got = read_bytes(infile, w->in, b->size);
+            if (got < 0) {
+                status = LZ_IO_ERROR;
+                break;
+            }
+
+            avail_in = got;
+            next_in = w->in;
+            eof = avail_in < b->size; // read_bytes only comes up short at end of file
+        }
+
+        if (b->compress) {
+            status = lz_compress(w->stream, &next_in, &avail_in, &next_out, &avail_out,
+                eof ? LZ_FINISH : LZ_RUN);
+        } else {
+            status = lz_decompress(w->stream, &next_in, &avail_in, &next_out, &avail_out);
+
+            // still waiting for input that will never come
+            if (status == LZ_OK && eof && avail_in == 0 && avail_out > 0)
+                status = LZ_DATA_ERROR;
+        }
+
+        // whole buffers only, so that every write but the last one is aligned for O_DIRECT
+        if (avail_out == 0 || status != LZ_OK) {
+            sink_put(sink, w->out, next_out - w->out);
+            next_out = w->out;
+            avail_out = b->size;
+        }
+    }
+
+    if (mapped)
+        unmap_input(&map);
+    return status;
+}
+
+// Creates the directories leading to path, which is only changed while it is being walked
+static void make_parents(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0777); // already there, or the open of the file says what went wrong
+        *slash = '/';
+    }
+}
+
+// Waits for the turn of a job in the archive, and writes its member out if it has one
+static bool write_member(Job *job, const Sink *sink, bool ok) {
+    Batch *b = job->batch;
+
+    pthread_mutex_lock(&b->lock);
+    while (b->turn != job->turn) // jobs start in turn, so the one whose turn it is never waits
+        pthread_cond_wait(&b->turned, &b->lock);
+    pthread_mutex_unlock(&b->lock);
+
+    if (ok) {
+        size_t n = strlen(job->member);
+        MemberHeader head = { ARCHIVE_MAGIC, (uint16_t) n, 0, sink->size };
+        swap_member(&head);
+
+        ok = write_all(b->archive, (const uint8_t *) &head, sizeof(head))
+             && write_all(b->archive, (const uint8_t *) job->member, n)
+             && write_all(b->archive, sink->data, sink->size);
+    }
+
+    pthread_mutex_lock(&b->lock);
+    b->turn++;
+    pthread_cond_broadcast(&b->turned);
+    pthread_mutex_unlock(&b->lock);
+
+    return ok;
+}
+
+// Codes one file or member on a worker thread, or on the main thread if the pool was out of memory
+static void run_job(void *arg) {
+    Job *job = (Job *) arg;
+    Batch *b = job->batch;
+    Worker *w = worker_take(b);
+    Sink sink = { -1, b->archive >= 0, NULL, 0, 0, true };
+    int infile = -1;
+    struct stat st;
+    const char *error = job->error != NULL ? job->error : w == NULL ? "Not enough memory" : NULL;
+
+    if (error == NULL && job->input != NULL && (infile = open(job->input, O_RDONLY)) < 0)
+        error = "No such file or directory";
+    else if (error == NULL && infile >= 0 && fstat(infile, &st) == 0 && S_ISDIR(st.st_mode))
+        error = "Is a directory"; // which opens, but reads nothing
+
+    if (error == NULL && job->output != NULL) {
+        if (!b->compress)
+            make_parents(job->output);
+
+        sink.fd = open(job->output, O_WRONLY | O_CREAT | (b->force ? O_TRUNC : O_EXCL), 0666);
+        if (sink.fd < 0)
+            error = errno == EEXIST ? "Output exists, -f overwrites it" : "Could not create output";
+    }
+
+    if (error == NULL) {
+        // where O_DIRECT is refused, the page cache is used as usual
+        if (b->direct && infile >= 0)
+            set_direct(infile);
+        if (b->direct && sink.fd >= 0)
+            set_direct(sink.fd);
+
+        lz_status status = code_file(b, w, job->data, job->size, infile, &sink);
+
+        if (status == LZ_MEM_ERROR)
+            error = "Not enough memory";
+        else if (status == LZ_IO_ERROR)
+            error = "Could not read input";
+        else if (status != LZ_STREAM_END)
+            error = "Damaged or truncated file";
+        else if (!sink.ok)
+            error = sink.memory ? "Not enough memory" : "Could not write output";
+    }
+
+    // every job takes its turn, even a failed one, or the ones after it would wait forever
+    if (sink.memory && !write_member(job, &sink, error == NULL) && error == NULL)
+        error = "Could not write archive";
+
+    if (infile >= 0)
+        close(infile);
+    if (sink.fd >= 0)
+        close(sink.fd);
+    free(sink.data);
+
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", job->name, error);
+        if (sink.fd >= 0)
+            unlink(job->output); // no output is better than part of one
+    }
+
+    lz_stats stats;
+    if (w != NULL) {
+        lz_get_stats(w->stream, &stats);
+        worker_give(b, w);
+    }
+
+    pthread_mutex_lock(&b->lock);
+    if (w != NULL)
+        stats_add(&b->stats, &stats);
+    b->failed += error != NULL;
+    io_counters_add(&b->io, &io_counters);
+    memset(&io_counters, 0, sizeof(IoCounters));
+    pthread_mutex_unlock(&b->lock);
+
+    free(job->name);
+    free(job->output);
+    free(job->member);
+    free(job);
+}
+
+// Queues a job for name, taking over output and member, in turn after the jobs queued so far
+static void submit(Batch *b, const char *name, const char *input, const uint8_t *data, size_t n,
+    char *output, char *member) {
+    Job *job = (Job *) calloc(1, sizeof(Job));
+    char *copy = strdup(name);
+
+    if (b->jobs == b->room && job != NULL) {
+        uint64_t room = b->room ? 2 * b->room : 16;
+        Job **grown = (Job **) realloc(b->queue, room * sizeof(Job *));
+
+        if (grown != NULL) {
+            b->queue = grown;
+            b->room = room;
+        }
+    }
+
+    if (job == NULL || copy == NULL || b->jobs == b->room) {
+        fprintf(stderr, "%s: Not enough memory\n", name);
+        free(job);
+        free(copy);
+        free(output);
+        free(member);
+        b->failed++; // no job, so no turn in the archive either
+        return;
+    }
+
+    *job = (Job) { b, copy, input, data, n, output, member, b->jobs, NULL };
+    b->queue[b->jobs++] = job;
+}
+
+// Returns what a job writes: its member name in an archive, or else its output, NULL for a test
+static const char *job_target(const Job *job) {
+    return job->member != NULL ? job->member : job->output;
+}
+
+// Orders jobs by what they write, and those writing the same by their turn
+static int compare_jobs(const void *p, const void *q) {
+    const Job *a = *(Job *const *) p, *b = *(Job *const *) q;
+    int order = strcmp(job_target(a), job_target(b));
+
+    return order != 0 ? order : a->turn < b->turn ? -1 : a->turn > b->turn;
+}
+
+// Fails every job that would write the same output or member as one ahead of it, which would
+// overwrite the earlier one with -f and find it taken without, then runs the queue in turn
+static void run_queue(Batch *b) {
+    Job **sorted = (Job **) calloc(b->jobs + 1, sizeof(Job *));
+    uint64_t n = 0;
+
+    for (uint64_t i = 0; sorted != NULL && i < b->jobs; i++) {
+        if (job_target(b->queue[i]) != NULL)
+            sorted[n++] = b->queue[i];
+    }
+
+    if (sorted != NULL)
+        qsort(sorted, n, sizeof(Job *), compare_jobs);
+
+    for (uint64_t i = 1; i < n; i++) {
+        if (strcmp(job_target(sorted[i - 1]), job_target(sorted[i])) == 0)
+            sorted[i]->error = b->archive >= 0 ? "Same member name as an earlier input"
+                                               : "Same output as an earlier input";
+    }
+
+    for (uint64_t i = 0; i < b->jobs; i++) {
+        if (sorted == NULL)
+            b->queue[i]->error = "Not enough memory";
+
+        // run now rather than not at all, its turn comes once the jobs before it are done
+        if (!pool_submit(b->pool, run_job, b->queue[i]))
+            run_job(b->queue[i]);
+    }
+
+    free(sorted);
+}
+
+// Constructor for Batch, reports on stderr if it cannot start
+static Batch *batch_create(bool compress, int workers, size_t size, bool direct, bool force) {
+    Batch *b = (Batch *) calloc(1, sizeof(Batch));
+
+    if (b == NULL) {
+        fprintf(stderr, "Not enough memory for %d threads\n", workers);
+        return NULL;
+    }
+
+    b->compress = compress;
+    b->size = size;
+    b->direct = direct;
+    b->force = force;
+    b->archive = -1;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->turned, NULL);
+
+    b->pool = pool_create(workers);
+    if (b->pool == NULL) {
+        fprintf(stderr, "Not enough memory for %d threads\n", workers);
+        pthread_mutex_destroy(&b->lock);
+        pthread_cond_destroy(&b->turned);
+        free(b);
+        return NULL;
+    }
+
+    return b;
+}
+
+// Destructor for Batch, waits for every job, hands the counters over and returns the failures
+static int batch_finish(Batch *b, lz_stats *stats) {
+    pool_wait(b->pool);
+    pool_delete(b->pool);
+
+    while (b->idle != NULL) {
+        Worker *w = b->idle;
+        b->idle = w->next;
+        worker_delete(w);
+    }
+
+    while (b->maps != NULL) {
+        Archive *a = b->maps;
+        b->maps = a->next;
+        unmap_input(&a->map);
+        free(a);
+    }
+
+    stats_add(stats, &b->stats);
+    io_counters_add(&io_counters, &b->io);
+
+    int failed = b->failed;
+    free(b->queue); // of jobs that have freed themselves
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->turned);
+    free(b);
+    return failed;
+}
+
+// Joins two parts of a path, returns NULL if memory ran out
+static char *join(const char *dir, const char *name, const char *suffix) {
+    size_t n = (dir ? strlen(dir) + 1 : 0) + strlen(name) + strlen(suffix) + 1;
+    char *path = (char *) malloc(n);
+
+    if (path != NULL)
+        snprintf(path, n, "%s%s%s%s", dir ? dir : "", dir ? "/" : "", name, suffix);
+    return path;
+}
+
+// Turns a path into the name of a member in place, the way tar does: leading slashes, empty and
+// "." parts, and everything up to the last ".." part are dropped, so that the name stays below
+// wherever it is extracted; returns name, which may end up empty
+static char *member_name(char *name) {
+    char *out = name;
+
+    for (const char *part = name; *part != '\0';) {
+        size_t n = strcspn(part, "/");
+
+        if (n == 2 && strncmp(part, "..", 2) == 0) {
+            out = name;
+        } else if (n > 1 || (n == 1 && *part != '.')) {
+            if (out > name)
+                *out++ = '/';
+            memmove(out, part, n); // out never passes part
+            out += n;
+        }
+
+        part += n;
+        if (*part == '/')
+            part++;
+    }
+
+    *out = '\0';
+    return name;
+}
+
+// Compresses each input into name.lz or a member of the archive
+int batch_compress(const BatchList *inputs, const char *archive, const lz_options *options,
+    int workers, size_t size, bool direct, bool force, lz_stats *stats) {
+    Batch *b = batch_create(true, workers, size, direct, force);
+
+    if (b == NULL)
+        return -1;
+
+    b->options = *options;
+    if (archive != NULL) {
+        b->archive = open(archive, O_WRONLY | O_CREAT | (force ? O_TRUNC : O_EXCL), 0666);
+
+        if (b->archive < 0) {
+            fprintf(stderr, "%s: %s\n", archive,
+                errno == EEXIST ? "Output exists, -f overwrites it" : strerror(errno));
+            batch_finish(b, stats);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < inputs->count; i++) {
+        const char *name = inputs->names[i];
+        char *output = archive == NULL ? join(NULL, name, ".lz") : NULL;
+        char *member = archive != NULL ? strdup(name) : NULL;
+        const char *error = output == NULL && member == NULL ? "Not enough memory" : NULL;
+
+        // the name is checked as decode will see it, so that the archive extracts in full
+        if (member != NULL && *member_name(member) == '\0')
+            error = "No name left for an archive member";
+        else if (member != NULL && strlen(member) > MAX_MEMBER_NAME)
+            error = "Name too long for an archive";
+
+        if (error != NULL) {
+            fprintf(stderr, "%s: %s\n", name, error);
+            free(output);
+            free(member);
+            b->failed++;
+            continue;
+        }
+
+        submit(b, name, name, NULL, 0, output, member);
+    }
+
+    run_queue(b);
+    int archive_fd = b->archive;
+    int failed = batch_finish(b, stats);
+
+    if (archive_fd >= 0)
+        close(archive_fd);
+    return failed;
+}
+
+// Maps the archive open at fd and queues a job for each of its members, returns false if it is
+// damaged
+static bool submit_archive(Batch *b, int fd, const char *path, const char *dir, bool test) {
+    Archive *a = (Archive *) calloc(1, sizeof(Archive));
+    bool ok = a != NULL && map_input(fd, &a->map);
+
+    if (!ok) {
+        free(a);
+        return false;
+    }
+
+    a->next = b->maps;
+    b->maps = a;
+
+    const uint8_t *data = a->map.data;
+    size_t left = a->map.size;
+    char name[MAX_MEMBER_NAME + 1];
+
+    while (left > 0) {
+        MemberHeader head;
+
+        if (left < sizeof(MemberHeader))
+            return false;
+
+        memcpy(&head, data, sizeof(MemberHeader));
+        swap_member(&head);
+        data += sizeof(MemberHeader);
+        left -= sizeof(MemberHeader);
+
+        if (head.magic != ARCHIVE_MAGIC || head.name_len == 0 || head.name_len > MAX_MEMBER_NAME
+            || head.name_len > left || head.size > left - head.name_len)
+            return false;
+
+        memcpy(name, data, head.name_len);
+        name[head.name_len] = '\0';
+        data += head.name_len;
+        left -= head.name_len;
+
+        // a name with a NUL in it would be cut short, and one reaching out of dir is brought back
+        // below it like encode does, which leaves nothing of a name such as ".."
+        if (strlen(name) != head.name_len || *member_name(name) == '\0') {
+            fprintf(stderr, "%s: Unsafe member name\n", path);
+            b->failed++;
+        } else {
+            char *output = test ? NULL : join(dir, name, "");
+
+            if (!test && output == NULL) {
+                fprintf(stderr, "%s: Not enough memory\n", name);
+                b->failed++;
+            } else {
+                submit(b, name, NULL, data, head.size, output, NULL);
+            }
+        }
+
+        data += head.size;
+        left -= head.size;
+    }
+
+    return true;
+}
+
+// Decompresses each input to its name without .lz, or each member of an archive to its name
+int batch_decompress(const BatchList *inputs, const char *dir, bool test, int workers,
+    size_t size, bool direct, bool force, lz_stats *stats) {
+    Batch *b = batch_create(false, workers, size, direct, force);
+
+    if (b == NULL)
+        return -1;
+
+    for (int i = 0; i < inputs->count; i++) {
+        const char *name = inputs->names[i];
+        int fd = open(name, O_RDONLY);
+
+        if (fd >= 0 && batch_is_archive(fd)) {
+            if (!submit_archive(b, fd, name, dir, test)) {
+                fprintf(stderr, "%s: Damaged or truncated archive\n", name);
+                b->failed++;
+            }
+            close(fd); // the mapping stays
+            continue;
+        }
+
+        // anything else is opened again by its job, which also reports what is wrong with it
+        if (fd >= 0)
+            close(fd);
+
+        // the output goes next to the input, or into dir under the last part of its name
+        size_t n = strlen(name);
+        bool suffixed = n > 3 && strcmp(name + n - 3, ".lz") == 0;
+        const char *base = strrchr(name, '/');
+        base = dir != NULL && base != NULL ? base + 1 : name;
+
+        char *output = test ? NULL : join(dir, base, suffixed ? "" : ".out");
+        if (output != NULL && suffixed)
+            output[strlen(output) - 3] = '\0';
+
+        if (!test && output == NULL) {
+            fprintf(stderr, "%s: Not enough memory\n", name);
+            b->failed++;
+            continue;
+        }
+
+        submit(b, name, name, NULL, 0, output, NULL);
+    }
+
+    run_queue(b);
+    return batch_finish(b, stats);
+}
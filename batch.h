@@ -0,0 +1,77 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "lz78.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+//
+// Batch mode of encode and decode: many files coded at once on a pool of worker threads.
+//
+// Every worker codes one file at a time through an lz_stream of its own, which it resets between
+// files instead of freeing, so its dictionary, buffers and chunk threads are set up once per worker
+// rather than once per file. Compressed files go next to their inputs, or into a single archive,
+// see MemberHeader in io.h, whose members are written in input order whichever worker is done
+// first. Decompressing takes lz files and archives alike, and runs the members of an archive on
+// the workers just like files.
+//
+// Outputs, the archive included, are only created where nothing exists yet unless force is set,
+// and two inputs that would write the same output or member fail the later one either way.
+//
+// Each file that fails is reported on stderr, and the others go on.
+//
+
+typedef struct BatchList {
+    char **names; // Paths, each allocated.
+    int count; // Paths in names.
+    int size; // Room in names.
+} BatchList;
+
+/*
+ * Appends a copy of name to list, which starts out zeroed
+ * Returns false if memory ran out
+ */
+bool batch_list_add(BatchList *list, const char *name);
+
+/*
+ * Appends every line of the file at path, "-" for stdin, to list, skipping empty ones
+ * Returns false if it could not be read or memory ran out
+ */
+bool batch_list_read(BatchList *list, const char *path);
+
+/*
+ * Frees the names in list and empties it
+ */
+void batch_list_free(BatchList *list);
+
+/*
+ * Returns true if fd is a regular file that starts like an archive, without moving its offset
+ */
+bool batch_is_archive(int fd);
+
+/*
+ * Compresses every file in inputs with options on workers threads, size bytes at a time, with
+ * O_DIRECT if direct is set, each into the same path with .lz appended or, if archive is not NULL,
+ * all into a new archive at that path, overwriting what exists if force is set
+ * Adds the statistics of every file to *stats, zeroed by the caller, and the I/O counters of the
+ * workers to those of the calling thread
+ * Returns the number of inputs that failed, -1 if the batch could not be started, which is
+ * reported as well
+ */
+int batch_compress(const BatchList *inputs, const char *archive, const lz_options *options,
+    int workers, size_t size, bool direct, bool force, lz_stats *stats);
+
+/*
+ * Decompresses every lz file and every member of every archive in inputs on workers threads,
+ * size bytes at a time, with O_DIRECT if direct is set
+ * An lz file goes to its path without .lz, or with .out appended if it has none, and a member to
+ * its name, both inside dir if it is not NULL, overwriting what exists if force is set; with
+ * test set nothing is written at all
+ * Adds the statistics like batch_compress
+ * Returns the number of files or members that failed, -1 if the batch could not be started,
+ * which is reported as well
+ */
+int batch_decompress(const BatchList *inputs, const char *dir, bool test, int workers,
+    size_t size, bool direct, bool force, lz_stats *stats);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef __BITS_H__
+#define __BITS_H__
+
+#include "endian.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Word-at-a-time bit packer.
+//
+// Fields are appended least significant bit first into a 64-bit accumulator, exactly as pairs are
+// laid out on disk. Whenever the accumulator fills up, all 64 bits are spilled into buf with a
+// single store, so the per-bit work of the old packer disappears.
+//
+// The caller owns buf and must make sure that at least 8 bytes are free at buf + pos before every
+// call to bw_put or bw_finish.
+//
+typedef struct BitWriter {
+    uint64_t acc; // Pending bits, oldest bit in the LSB.
+    uint32_t count; // Number of valid bits in acc, always below 64.
+    uint32_t pos; // Next free byte in buf.
+    uint8_t *buf;
+} BitWriter;
+
+//
+// Append the low n bits of bits. n must be at most 32 and bits must not have any bit set at or
+// above position n.
+//
+static inline void bw_put(BitWriter *bw, uint64_t bits, uint32_t n) {
+    bw->acc |= bits << bw->count;
+    bw->count += n;
+
+    // accumulator full: spill a whole word and keep the bits that did not fit
+    if (bw->count >= 64) {
+        store_le64(bw->buf + bw->pos, bw->acc);
+        bw->pos += 8;
+        bw->count -= 64;
+        bw->acc = bits >> (n - bw->count);
+    }
+}
+
+//
+// Spill the pending bits into buf, zero padded to a byte boundary.
+//
+// The stream format always ends with one byte past the last complete byte, even when the bit count
+// is already byte aligned, so this moves pos forward by count / 8 + 1.
+//
+static inline void bw_finish(BitWriter *bw) {
+    store_le64(bw->buf + bw->pos, bw->acc);
+    bw->pos += bw->count / 8 + 1;
+    bw->acc = 0;
+    bw->count = 0;
+}
+
+//
+// Word-at-a-time bit reader, the mirror image of BitWriter.
+//
+// The next bits of the stream are kept in a 64-bit window, oldest bit in the LSB. br_refill tops
+// the window up with one unaligned 8-byte load, after which at least 56 bits can be taken without
+// touching buf again. Within the last 8 bytes of buf it falls back to loading single bytes.
+//
+typedef struct BitReader {
+    uint64_t window; // Upcoming bits, oldest bit in the LSB.
+    uint32_t count; // Number of valid bits in window.
+    size_t pos; // Next byte of buf not yet loaded into window.
+    size_t size; // Number of bytes available in buf, a whole mapped file at most.
+    const uint8_t *buf;
+} BitReader;
+
+//
+// Load as many whole bytes into the window as fit.
+//
+static inline void br_refill(BitReader *br) {
+    if (br->pos + 8 <= br->size) {
+        // bits loaded past the last whole byte are loaded again, unchanged, by the next refill
+        br->window |= load_le64(br->buf + br->pos) << br->count;
+        br->pos += (63 - br->count) >> 3;
+        br->count |= 56;
+    } else {
+        while (br->count <= 56 && br->pos < br->size) {
+            br->window |= (uint64_t) br->buf[br->pos++] << br->count;
+            br->count += 8;
+        }
+    }
+}
+
+//
+// Take the next n bits off the window. n must be at most 32 and no larger than count.
+//
+static inline uint64_t br_get(BitReader *br, uint32_t n) {
+    uint64_t bits = br->window & ((UINT64_C(1) << n) - 1);
+    br->window >>= n;
+    br->count -= n;
+    return bits;
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include "block.h"
+#include "bits.h"
+#include "code.h"
+#include "policy.h"
+#include "rans.h"
+#include <string.h>
+
+#define SYMBOLS_RAW  0 // The symbols of an entropy coded chunk are stored as they are.
+#define SYMBOLS_RANS 1 // They are coded by rans_encode.
+
+// Worst case: every symbol ends a phrase, plus the last partial phrase, the stop pair and a clear
+// every CLEAR_WINDOW symbols
+size_t block_bound(size_t n, int bits) {
+    return ((n + 2 + n / CLEAR_WINDOW) * (bits + 8) + 7) / 8 + 16;
+}
+
+// Every code takes at least a bit, and its word is at most one symbol longer than any word before
+// it, so k codes write no more than 1 + 2 + ... + k symbols
+uint64_t block_expansion(size_t n) {
+    if (n >= UINT32_MAX / 8)
+        return UINT64_MAX;
+
+    uint64_t k = (uint64_t) n * 8;
+    return k * (k + 1) / 2;
+}
+
+// Writes a pair, or only its code if its symbol is set aside in syms to be entropy coded
+static inline void put_pair(
+    BitWriter *bw, uint8_t *syms, uint32_t *count, uint32_t code, uint8_t sym, int bitlen) {
+    if (syms == NULL) {
+        bw_put(bw, code | (uint64_t) sym << bitlen, bitlen + 8);
+        return;
+    }
+
+    bw_put(bw, code, bitlen);
+    syms[(*count)++] = sym;
+}
+
+// Takes the symbol of the next pair off the bits, or out of the symbols of an entropy coded chunk,
+// returns -1 if there is none left
+static inline int get_symbol(BitReader *br, const uint8_t *syms, uint32_t *k, uint32_t count) {
+    if (syms != NULL)
+        return *k < count ? syms[(*k)++] : -1;
+
+    return br->count < 8 ? -1 : (int) br_get(br, 8);
+}
+
+// Writes the n symbols set aside by block_encode at dst, rANS coded if that makes them smaller,
+// returns the number of bytes written
+static uint32_t put_symbols(const uint8_t *syms, uint32_t n, uint8_t *dst) {
+    store_le32(dst, n);
+
+    // falling back on the raw symbols whenever rANS does not win keeps within block_bound
+    size_t size = rans_encode(syms, n, dst + 5, n);
+    if (size > 0) {
+        dst[4] = SYMBOLS_RANS;
+        return 5 + size;
+    }
+
+    dst[4] = SYMBOLS_RAW;
+    memcpy(dst + 5, syms, n);
+    return 5 + n;
+}
+
+// Reads the symbols written by put_symbols out of the n bytes of src into the last *count bytes
+// of dst, which has room for cap symbols, returns NULL if they are damaged or do not fit
+static const uint8_t *get_symbols(
+    const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap, uint32_t *count) {
+    if (n < 5 || load_le32(src) > cap)
+        return NULL;
+
+    *count = load_le32(src);
+    uint8_t *syms = dst + cap - *count;
+
+    if (src[4] == SYMBOLS_RAW && n - 5 == *count) {
+        memcpy(syms, src + 5, *count);
+        return syms;
+    }
+
+    if (src[4] == SYMBOLS_RANS && rans_decode(src + 5, n - 5, syms, *count))
+        return syms;
+
+    return NULL;
+}
+
+// Compresses a whole chunk into LZW codes with a fresh dictionary
+static uint32_t lzw_encode(
+    Dict *d, int bits, int policy, const uint8_t *src, uint32_t n, uint8_t *dst) {
+    BitWriter bw = { 0, 0, 0, dst };
+    Monitor monitor;
+    uint32_t max_code = MAX_CODE_BITS(bits);
+    uint32_t literals = FIRST_CODE(policy); // code of the one-symbol phrase 0
+    uint32_t next_code = literals + LITERALS;
+    uint32_t curr_code = n > 0 ? literals + src[0] : EMPTY_CODE;
+
+    dict_reset(d);
+    monitor_start(&monitor, 0);
+
+    for (uint32_t i = 1; i < n; i++) {
+        uint8_t sym = src[i];
+        uint32_t next = dict_step(d, curr_code, sym);
+
+        if (next != STOP_CODE) {
+            curr_code = next;
+            continue;
+        }
+
+        // only the code goes out: sym starts the next phrase, which is how the decoder learns it
+        int bitlen = code_bits(next_code);
+        bw_put(&bw, curr_code, bitlen);
+        STAT_ADD(d->counters.pairs[bitlen], 1);
+
+        if (next_code < max_code) {
+            dict_insert(d, curr_code, sym, next_code);
+            monitor_count(&monitor, bitlen);
+
+            if (++next_code == max_code && policy == POLICY_RESET) {
+                dict_reset(d);
+                STAT_ADD(d->counters.resets, 1);
+                next_code = literals + LITERALS;
+            } else if (next_code == max_code) {
+                monitor_full(&monitor, i);
+            }
+        } else if (policy == POLICY_ADAPTIVE && monitor_pair(&monitor, i, bitlen)) {
+            bw_put(&bw, CLEAR_CODE, bitlen);
+            dict_reset(d);
+            STAT_ADD(d->counters.resets, 1);
+            next_code = literals + LITERALS;
+            monitor_start(&monitor, i);
+        }
+
+        curr_code = literals + sym;
+    }
+
+    // the decoder reserves an entry for every code, the last one included
+    if (curr_code != EMPTY_CODE) {
+        bw_put(&bw, curr_code, code_bits(next_code));
+        STAT_ADD(d->counters.pairs[code_bits(next_code)], 1);
+
+        if (next_code < max_code && ++next_code == max_code && policy == POLICY_RESET)
+            next_code = literals + LITERALS;
+    }
+
+    bw_put(&bw, STOP_CODE, code_bits(next_code));
+    bw_finish(&bw);
+    STAT_ADD(d->counters.lookups, n);
+
+    return bw.pos;
+}
+
+// Compresses a whole chunk with a fresh dictionary, the codes ahead of the symbols if they are to
+// be entropy coded
+uint32_t block_encode(Dict *d, int bits, int policy, bool lzw, const uint8_t *src, uint32_t n,
+    uint8_t *dst, uint8_t *syms) {
+    if (lzw)
+        return lzw_encode(d, bits, policy, src, n, dst);
+
+    BitWriter bw = { 0, 0, 0, syms != NULL ? dst + 4 : dst };
+    uint32_t count = 0; // symbols set aside in syms
+    Monitor monitor;
+    uint32_t max_code = MAX_CODE_BITS(bits);
+    uint32_t curr_code = EMPTY_CODE;
+    uint32_t prev_code = EMPTY_CODE;
+    uint32_t next_code = FIRST_CODE(policy);
+
+    dict_reset(d);
+    monitor_start(&monitor, 0);
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t sym = src[i];
+        uint32_t next = dict_step(d, curr_code, sym);
+
+        // if the longer phrase exists, extend the current one
+        if (next != STOP_CODE) {
+            prev_code = curr_code;
+            curr_code = next;
+            continue;
+        }
+
+        int bitlen = code_bits(next_code);
+        put_pair(&bw, syms, &count, curr_code, sym, bitlen);
+        STAT_ADD(d->counters.pairs[bitlen], 1);
+
+        // a full dictionary is started over, kept as it is or recycled, depending on the policy
+        if (next_code < max_code) {
+            dict_insert(d, curr_code, sym, next_code);
+            monitor_count(&monitor, bitlen + 8);
+
+            if (++next_code == max_code && policy == POLICY_RESET) {
+                dict_reset(d);
+                STAT_ADD(d->counters.resets, 1);
+                next_code = START_CODE;
+            } else if (next_code == max_code) {
+                monitor_full(&monitor, i + 1);
+            }
+        } else if (policy == POLICY_ADAPTIVE && monitor_pair(&monitor, i + 1, bitlen + 8)) {
+            bw_put(&bw, CLEAR_CODE, bitlen);
+            dict_reset(d);
+            STAT_ADD(d->counters.resets, 1);
+            next_code = FIRST_CODE(policy);
+            monitor_start(&monitor, i + 1);
+        } else if (policy == POLICY_LRU) {
+            dict_recycle(d, curr_code, sym);
+        }
+
+        curr_code = EMPTY_CODE;
+    }
+
+    // the unfinished phrase is sent as its prefix and its last symbol, like the stream encoder
+    if (curr_code != EMPTY_CODE) {
+        put_pair(&bw, syms, &count, prev_code, src[n - 1], code_bits(next_code));
+        STAT_ADD(d->counters.pairs[code_bits(next_code)], 1);
+
+        if (next_code < max_code && ++next_code == max_code && policy == POLICY_RESET)
+            next_code = START_CODE;
+    }
+
+    bw_put(&bw, STOP_CODE, code_bits(next_code) + (syms != NULL ? 0 : 8));
+    bw_finish(&bw);
+    STAT_ADD(d->counters.lookups, n);
+
+    if (syms == NULL)
+        return bw.pos;
+
+    store_le32(dst, bw.pos);
+    return 4 + bw.pos + put_symbols(syms, count, dst + 4 + bw.pos);
+}
+
+// Decompresses a whole chunk of LZW codes with a fresh word table
+static uint32_t lzw_decode(WordTable *wt, int bits, int policy, const uint8_t *src, uint32_t n,
+    uint8_t *dst, uint32_t cap) {
+    BitReader br = { 0, 0, 0, n, src };
+    uint32_t max_code = MAX_CODE_BITS(bits);
+    uint32_t literals = FIRST_CODE(policy);
+    uint32_t next_code = literals + LITERALS;
+    uint32_t prev_code = EMPTY_CODE; // previous word, if the entry at next_code - 1 extends it
+    uint32_t len = 0;
+
+    wt_reset(wt);
+    wt_seed(wt, literals);
+
+    for (;;) {
+        int bitlen = code_bits(next_code);
+
+        br_refill(&br);
+        if (br.count < (uint32_t) bitlen) // ran out of bits before STOP_CODE
+            return UINT32_MAX;
+
+        uint32_t code = br_get(&br, bitlen);
+        if (code == STOP_CODE)
+            return len;
+
+        if (code == CLEAR_CODE && policy == POLICY_ADAPTIVE) {
+            wt_reset(wt);
+            STAT_ADD(wt->counters.resets, 1);
+            next_code = literals + LITERALS;
+            prev_code = EMPTY_CODE;
+            continue;
+        }
+
+        if (code < literals || code >= next_code)
+            return UINT32_MAX;
+
+        // KwKwK: the encoder used the entry it added with the previous code right away, so the
+        // word is the previous one followed by its own first symbol
+        bool pending = prev_code != EMPTY_CODE && code == next_code - 1;
+        if (pending)
+            wt_add(wt, code, prev_code, dst[len - wt->lens[prev_code]]);
+
+        if (wt->lens[code] > cap - len) // the word must fit in what is left of dst
+            return UINT32_MAX;
+
+        // otherwise the entry added with the previous code ends with the first symbol of this word
+        uint32_t start = len;
+        len += wt_copy(wt, code, dst + len);
+        if (prev_code != EMPTY_CODE && !pending)
+            wt_add(wt, next_code - 1, prev_code, dst[start]);
+        STAT_ADD(wt->counters.pairs[bitlen], 1);
+
+        // the encoder added an entry along with this code unless the table is full
+        prev_code = EMPTY_CODE;
+        if (next_code < max_code) {
+            prev_code = code;
+
+            if (++next_code == max_code && policy == POLICY_RESET) {
+                wt_reset(wt);
+                STAT_ADD(wt->counters.resets, 1);
+                next_code = literals + LITERALS;
+                prev_code = EMPTY_CODE;
+            }
+        }
+    }
+}
+
+// Decompresses a whole chunk with a fresh word table
+uint32_t block_decode(WordTable *wt, int bits, int policy, bool lzw, bool entropy,
+    const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap) {
+    if (lzw)
+        return lzw_decode(wt, bits, policy, src, n, dst, cap);
+
+    BitReader br = { 0, 0, 0, n, src };
+    const uint8_t *syms = NULL;
+    uint32_t count = 0, k = 0; // symbols decoded up front, and taken so far
+    uint32_t max_code = MAX_CODE_BITS(bits);
+    uint32_t next_code = FIRST_CODE(policy);
+    uint32_t len = 0;
+
+    // every pair writes at least one symbol, so the word of a pair can only overwrite symbols
+    // that were already taken as long as cap is exactly the size of the chunk
+    if (entropy) {
+        if (n < 4 || load_le32(src) > n - 4)
+            return UINT32_MAX;
+
+        br = (BitReader) { 0, 0, 0, load_le32(src), src + 4 };
+        syms = get_symbols(src + 4 + br.size, n - 4 - br.size, dst, cap, &count);
+        if (syms == NULL)
+            return UINT32_MAX;
+    }
+
+    wt_reset(wt);
+
+    for (;;) {
+        int bitlen = code_bits(next_code);
+
+        br_refill(&br);
+        if (br.count < (uint32_t) bitlen) // ran out of bits before STOP_CODE
+            return UINT32_MAX;
+
+        uint32_t code = br_get(&br, bitlen);
+        if (code == STOP_CODE)
+            return k == count ? len : UINT32_MAX;
+
+        if (code == CLEAR_CODE && policy == POLICY_ADAPTIVE) {
+            wt_reset(wt);
+            STAT_ADD(wt->counters.resets, 1);
+            next_code = FIRST_CODE(policy);
+            continue;
+        }
+
+        // the prefix must already be known and the word must fit in what is left of dst
+        int sym = get_symbol(&br, syms, &k, count);
+        if (sym < 0 || code >= next_code || wt->lens[code] >= cap - len)
+            return UINT32_MAX;
+
+        // a frozen table builds each word in the spare entry at max_code, and keeps none of them
+        uint32_t word = next_code;
+        if (next_code == max_code && policy == POLICY_LRU)
+            word = wt_recycle(wt, code, (uint8_t) sym);
+        else
+            wt_add(wt, next_code, code, (uint8_t) sym);
+
+        len += wt_copy(wt, word, dst + len);
+        STAT_ADD(wt->counters.pairs[bitlen], 1);
+
+        if (next_code < max_code && ++next_code == max_code && policy == POLICY_RESET) {
+            wt_reset(wt);
+            STAT_ADD(wt->counters.resets, 1);
+            next_code = START_CODE;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef __BLOCK_H__
+#define __BLOCK_H__
+
+#include "dict.h"
+#include "word.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// In-memory codec for the chunks of a chunked file.
+//
+// A chunk is coded exactly like the body of an unchunked file: (code, symbol) pairs starting from
+// an empty dictionary, or bare codes in LZW mode, closed by STOP_CODE. Nothing is shared between
+// chunks, so each one can be compressed or decompressed on its own thread without any global
+// state.
+//
+// An entropy coded chunk splits its pairs: the bare codes come first, behind their size in bytes,
+// followed by the symbols in one static rANS block, or stored as they are if that is no smaller.
+// The codes are close to uniform below the next code, so only the symbols are worth modelling.
+//
+
+/*
+ * Returns the largest number of bytes block_encode can produce from n symbols with codes of at
+ * most bits bits, including slack for its 8-byte stores
+ */
+size_t block_bound(size_t n, int bits);
+
+/*
+ * Returns the largest number of symbols that n bytes written by block_encode can decompress to,
+ * whatever the code width, policy and coding
+ */
+uint64_t block_expansion(size_t n);
+
+/*
+ * Compresses the n symbols of src into dst, which must hold block_bound(n, bits) bytes, handling a
+ * full dictionary as policy says, and writing bare LZW codes instead of pairs if lzw is set
+ * The symbols of the pairs are entropy coded if syms has room for n of them to be set aside, which
+ * does not go with lzw
+ * d is reset first and must be able to hold n codes below MAX_CODE_BITS(bits), plus LITERALS with
+ * lzw, and be tracked for POLICY_LRU
+ * Returns the number of bytes written to dst
+ */
+uint32_t block_encode(Dict *d, int bits, int policy, bool lzw, const uint8_t *src, uint32_t n,
+    uint8_t *dst, uint8_t *syms);
+
+/*
+ * Decompresses the n bytes of src, compressed with the same policy, lzw and entropy coding, into
+ * dst, which has room for cap symbols
+ * An entropy coded chunk must decode to exactly cap symbols, since its symbols are decoded into
+ * the end of dst before the words are written
+ * wt must have been created for MAX_CODE_BITS(bits), or for cap codes past the first code if that
+ * is fewer since every pair or LZW code adds at most one word, and be tracked for POLICY_LRU
+ * Returns the number of symbols written to dst, or UINT32_MAX if src is damaged or decodes to
+ * more than cap symbols
+ */
+uint32_t block_decode(WordTable *wt, int bits, int policy, bool lzw, bool entropy,
+    const uint8_t *src, uint32_t n, uint8_t *dst, uint32_t cap);
+
+#endif
@@ -0,0 +1,670 @@
+#include "chunks.h"
+#include "block.h"
+#include "code.h"
+#include "crc32c.h"
+#include "endian.h"
+#include "dict.h"
+#include "io.h"
+#include "policy.h"
+#include "pool.h"
+#include "word.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Chunk with the buffers and dictionary or word table it is coded with on a worker thread
+typedef struct Chunk {
+    const uint8_t *in; // buffer, or the chunk itself when it is whole in the input
+    uint8_t *buffer; // only allocated once a chunk has to be gathered from several inputs
+    uint32_t buffer_size; // bytes allocated for buffer
+    uint32_t ulen;
+    uint32_t clen;
+    uint8_t *out;
+    uint32_t out_size; // bytes allocated for out
+    uint8_t *syms; // symbols set aside for entropy coding, compressing with entropy only
+    Dict *dict; // compressing
+    WordTable *table; // decompressing
+    uint32_t codes; // codes table was created for
+    int bits;
+    int policy;
+    bool lzw;
+    bool entropy;
+    bool checksum;
+    bool ok;
+} Chunk;
+
+struct ChunkEncoder {
+    Pool *pool;
+    Chunk *chunks;
+    int threads;
+    uint32_t chunk_size;
+
+    int filled; // chunks of the batch submitted, chunks[filled] may be partly gathered
+    int drained; // chunks of the batch handed out
+    uint32_t drain_pos; // bytes of chunks[drained] handed out, its ChunkHeader included
+    bool draining; // the batch is compressed and being handed out
+
+    IndexEntry *index;
+    uint64_t count; // chunks in the index
+    uint64_t uoff, coff; // where the next chunk starts
+
+    uint8_t *trailer; // end marker, index and footer, once the input has ended
+    size_t trailer_size, trailer_pos;
+};
+
+struct ChunkDecoder {
+    Pool *pool;
+    Chunk *chunks;
+    int threads;
+    int bits;
+    bool indexed;
+    bool checksum;
+
+    int filled; // chunks of the batch submitted
+    int drained; // chunks of the batch handed out
+    uint32_t drain_pos; // bytes of chunks[drained] handed out
+    bool draining; // the batch is decompressed and being handed out
+
+    ChunkHeader head; // header of chunks[filled], in file byte order until it is complete
+    uint32_t head_pos; // bytes of head read
+    uint32_t got; // bytes of the payload of chunks[filled] read
+
+    bool ended; // the end marker has been read
+    bool done; // and so has the index, if there is one
+    uint64_t count, total; // chunks and symbols so far, to check the index footer against
+    uint64_t skip; // bytes of index entries still to be skipped
+    IndexFooter footer;
+    uint32_t footer_pos; // bytes of footer read
+};
+
+// Copies up to n bytes of src into the output, returns how many fit
+static size_t copy_out(uint8_t **out, size_t *out_len, const uint8_t *src, size_t n) {
+    if (n > *out_len)
+        n = *out_len;
+
+    memcpy(*out, src, n);
+    *out += n;
+    *out_len -= n;
+    return n;
+}
+
+// Takes up to n bytes off the input into dst, returns how many there were
+static size_t copy_in(const uint8_t **in, size_t *in_len, uint8_t *dst, size_t n) {
+    if (n > *in_len)
+        n = *in_len;
+
+    memcpy(dst, *in, n);
+    *in += n;
+    *in_len -= n;
+    return n;
+}
+
+// Makes sure *buf holds at least size bytes, growing it if not
+static bool reserve(uint8_t **buf, uint32_t *buf_size, uint32_t size) {
+    // buffers only grow, every chunk but the last usually has the same size
+    if (size > *buf_size) {
+        free(*buf);
+        *buf_size = size;
+        *buf = (uint8_t *) malloc(size);
+    }
+
+    if (*buf == NULL)
+        *buf_size = 0;
+    return *buf != NULL;
+}
+
+// Makes sure the word table of chunk fits every code of a chunk of ulen symbols, growing it if not
+static bool reserve_table(Chunk *chunk, uint32_t ulen) {
+    // a chunk never holds more phrases than symbols, so its table need not be any larger
+    uint32_t first_code = FIRST_CODE(chunk->policy) + (chunk->lzw ? LITERALS : 0);
+    uint32_t codes = MAX_CODE_BITS(chunk->bits);
+    if (codes > ulen + first_code)
+        codes = ulen + first_code;
+
+    if (chunk->table != NULL && codes <= chunk->codes)
+        return true;
+
+    WordTable *table = wt_create(codes);
+    if (table == NULL || (chunk->policy == POLICY_LRU && !wt_track(table, codes))) {
+        if (table != NULL)
+            wt_delete(table);
+        return false;
+    }
+
+    // the counters belong to the slot, not to the table
+    if (chunk->table != NULL) {
+        table->counters = chunk->table->counters;
+        wt_delete(chunk->table);
+    }
+
+    chunk->table = table;
+    chunk->codes = codes;
+    return true;
+}
+
+// Compresses one chunk on a worker thread
+static void encode_chunk(void *arg) {
+    Chunk *chunk = (Chunk *) arg;
+    chunk->clen = block_encode(chunk->dict, chunk->bits, chunk->policy, chunk->lzw, chunk->in,
+        chunk->ulen, chunk->out, chunk->syms);
+
+    // the checksum covers what the decoder has to reproduce, not the bytes it reads
+    if (chunk->checksum) {
+        store_le32(chunk->out + chunk->clen, crc32c(0, chunk->in, chunk->ulen));
+        chunk->clen += CHECKSUM_SIZE;
+    }
+}
+
+// Decompresses one chunk on a worker thread
+static void decode_chunk(void *arg) {
+    Chunk *chunk = (Chunk *) arg;
+    uint32_t clen = chunk->clen - (chunk->checksum ? CHECKSUM_SIZE : 0);
+
+    chunk->ok = clen <= chunk->clen
+                && block_decode(chunk->table, chunk->bits, chunk->policy, chunk->lzw,
+                       chunk->entropy, chunk->in, clen, chunk->out, chunk->ulen)
+                       == chunk->ulen
+                && (!chunk->checksum
+                    || crc32c(0, chunk->out, chunk->ulen) == load_le32(chunk->in + clen));
+}
+
+// Hands the chunk to the next idle worker, or codes it right here if it cannot be queued
+static void submit(Pool *pool, void (*fn)(void *), Chunk *chunk) {
+    if (!pool_submit(pool, fn, chunk))
+        fn(chunk);
+}
+
+// Every chunk is at worst a header, a block of block_bound, its checksum and its index entry, with
+// only the last one shorter than chunk_size
+size_t chunk_bound(size_t n, uint32_t chunk_size, int bits, bool checksum) {
+    size_t full = n / chunk_size, rest = n % chunk_size;
+    size_t extra = sizeof(ChunkHeader) + (checksum ? CHECKSUM_SIZE : 0) + sizeof(IndexEntry);
+    size_t body = full * (block_bound(chunk_size, bits) + extra)
+                  + (rest > 0 ? block_bound(rest, bits) + extra : 0);
+
+    return sizeof(FileHeader) + body + sizeof(ChunkHeader) + sizeof(IndexFooter);
+}
+
+// Constructor for ChunkEncoder
+ChunkEncoder *chunk_encoder_create(int bits, int policy, bool lzw, bool entropy, bool checksum,
+    int threads, uint32_t chunk_size) {
+    ChunkEncoder *ce = (ChunkEncoder *) calloc(1, sizeof(ChunkEncoder));
+
+    if (ce == NULL)
+        return NULL;
+
+    ce->threads = threads;
+    ce->chunk_size = chunk_size;
+    ce->coff = sizeof(FileHeader);
+    ce->pool = pool_create(threads);
+    ce->chunks = (Chunk *) calloc(threads, sizeof(Chunk));
+    ce->index = (IndexEntry *) malloc(64 * sizeof(IndexEntry));
+    bool ok = ce->pool != NULL && ce->chunks != NULL && ce->index != NULL;
+
+    // a chunk never holds more phrases than symbols, so its dictionary need not be any larger
+    uint32_t first_code = FIRST_CODE(policy) + (lzw ? LITERALS : 0);
+    uint32_t dict_codes = MAX_CODE_BITS(bits);
+    if (dict_codes > chunk_size + first_code)
+        dict_codes = chunk_size + first_code;
+
+    for (int i = 0; ok && i < threads; i++) {
+        Chunk *chunk = &ce->chunks[i];
+        chunk->bits = bits;
+        chunk->policy = policy;
+        chunk->lzw = lzw;
+        chunk->checksum = checksum;
+        chunk->out_size = block_bound(chunk_size, bits) + (checksum ? CHECKSUM_SIZE : 0);
+        chunk->out = (uint8_t *) malloc(chunk->out_size);
+        chunk->syms = entropy ? (uint8_t *) malloc(chunk_size) : NULL;
+        chunk->dict = dict_create(dict_codes);
+        ok = chunk->out != NULL && chunk->dict != NULL && (!entropy || chunk->syms != NULL)
+             && (policy != POLICY_LRU || dict_track(chunk->dict, dict_codes));
+    }
+
+    if (!ok) {
+        chunk_encoder_delete(ce);
+        return NULL;
+    }
+
+    return ce;
+}
+
+// Takes input into the chunks of the batch, submitting each one as soon as it is full
+static bool gather_chunks(ChunkEncoder *ce, const uint8_t **in, size_t *in_len) {
+    while (ce->filled < ce->threads && *in_len > 0) {
+        Chunk *chunk = &ce->chunks[ce->filled];
+        uint32_t want = ce->chunk_size - chunk->ulen;
+
+        // a whole chunk in the input is compressed in place
+        if (chunk->ulen == 0 && *in_len >= want) {
+            chunk->in = *in;
+            chunk->ulen = want;
+            *in += want;
+            *in_len -= want;
+        } else {
+            if (!reserve(&chunk->buffer, &chunk->buffer_size, ce->chunk_size))
+                return false;
+
+            chunk->in = chunk->buffer;
+            chunk->ulen += copy_in(in, in_len, chunk->buffer + chunk->ulen, want);
+        }
+
+        if (chunk->ulen == ce->chunk_size) {
+            submit(ce->pool, encode_chunk, chunk);
+            ce->filled++;
+        }
+    }
+
+    return true;
+}
+
+// Records the offsets of the next chunk in the index, growing it as needed
+static bool index_add(ChunkEncoder *ce, const Chunk *chunk) {
+    // the index doubles whenever it is full, which is whenever count is a power of two
+    if (ce->count >= 64 && (ce->count & (ce->count - 1)) == 0) {
+        IndexEntry *grown
+            = (IndexEntry *) realloc(ce->index, 2 * ce->count * sizeof(IndexEntry));
+
+        if (grown == NULL)
+            return false;
+        ce->index = grown;
+    }
+
+    ce->index[ce->count].uoff = ce->uoff;
+    ce->index[ce->count].coff = ce->coff;
+    ce->count++;
+
+    ce->uoff += chunk->ulen;
+    ce->coff += sizeof(ChunkHeader) + chunk->clen;
+    return true;
+}
+
+// Hands out the compressed chunks of the batch in input order, returns true once all of them are
+static bool drain_chunks(ChunkEncoder *ce, uint8_t **out, size_t *out_len) {
+    while (ce->drained < ce->filled) {
+        Chunk *chunk = &ce->chunks[ce->drained];
+        ChunkHeader head = { chunk->ulen, chunk->clen };
+        uint32_t size = sizeof(ChunkHeader) + chunk->clen;
+
+        swap_chunk_header(&head);
+
+        while (ce->drain_pos < size && *out_len > 0) {
+            if (ce->drain_pos < sizeof(ChunkHeader))
+                ce->drain_pos += copy_out(out, out_len, (uint8_t *) &head + ce->drain_pos,
+                    sizeof(ChunkHeader) - ce->drain_pos);
+            else
+                ce->drain_pos += copy_out(out, out_len,
+                    chunk->out + (ce->drain_pos - sizeof(ChunkHeader)), size - ce->drain_pos);
+        }
+
+        if (ce->drain_pos < size) // output full
+            return false;
+
+        chunk->ulen = 0;
+        ce->drain_pos = 0;
+        ce->drained++;
+    }
+
+    ce->filled = ce->drained = 0;
+    return true;
+}
+
+// Lays out the end marker, the index and its footer in file byte order
+static bool build_trailer(ChunkEncoder *ce) {
+    ChunkHeader end = { 0, 0 };
+    IndexFooter footer = { ce->count, ce->uoff, INDEX_MAGIC, 0 };
+    size_t index_size = ce->count * sizeof(IndexEntry);
+
+    ce->trailer_size = sizeof(ChunkHeader) + index_size + sizeof(IndexFooter);
+    ce->trailer = (uint8_t *) malloc(ce->trailer_size);
+
+    if (ce->trailer == NULL)
+        return false;
+
+    swap_index(ce->index, ce->count);
+    swap_footer(&footer);
+
+    memcpy(ce->trailer, &end, sizeof(ChunkHeader));
+    memcpy(ce->trailer + sizeof(ChunkHeader), ce->index, index_size);
+    memcpy(ce->trailer + sizeof(ChunkHeader) + index_size, &footer, sizeof(IndexFooter));
+    return true;
+}
+
+// Compresses as much input as the output has room for
+lz_status chunk_encode(ChunkEncoder *ce, const uint8_t **in, size_t *in_len, uint8_t **out,
+    size_t *out_len, bool finish) {
+    lz_status status = LZ_OK;
+
+    for (;;) {
+        if (ce->trailer != NULL) {
+            ce->trailer_pos += copy_out(
+                out, out_len, ce->trailer + ce->trailer_pos, ce->trailer_size - ce->trailer_pos);
+            status = ce->trailer_pos == ce->trailer_size ? LZ_STREAM_END : LZ_OK;
+            break;
+        }
+
+        if (ce->draining) {
+            if (!drain_chunks(ce, out, out_len)) // output full
+                break;
+            ce->draining = false;
+        }
+
+        if (!gather_chunks(ce, in, in_len)) {
+            status = LZ_MEM_ERROR;
+            break;
+        }
+
+        bool last = finish && *in_len == 0;
+
+        if (ce->filled < ce->threads && !last) // more input needed to fill the batch
+            break;
+
+        // the last chunk of the input is usually short
+        if (last && ce->filled < ce->threads && ce->chunks[ce->filled].ulen > 0) {
+            submit(ce->pool, encode_chunk, &ce->chunks[ce->filled]);
+            ce->filled++;
+        }
+
+        pool_wait(ce->pool);
+
+        // chunks are written in input order whichever thread finished first
+        for (int i = 0; i < ce->filled; i++) {
+            if (!index_add(ce, &ce->chunks[i])) {
+                status = LZ_MEM_ERROR;
+                break;
+            }
+        }
+
+        if (status != LZ_OK)
+            break;
+
+        if (ce->filled > 0) {
+            ce->draining = true;
+        } else if (!build_trailer(ce)) { // only reached once the input has ended
+            status = LZ_MEM_ERROR;
+            break;
+        }
+    }
+
+    pool_wait(ce->pool); // workers may be reading chunks straight out of the input
+    return status;
+}
+
+// Adds the counters of every chunk slot, which no worker is using between calls
+void chunk_encoder_counters(const ChunkEncoder *ce, Counters *sum) {
+    for (int i = 0; i < ce->threads; i++)
+        counters_add(sum, &ce->chunks[i].dict->counters);
+}
+
+// Starts over without giving any memory back, but the trailer of the previous file
+void chunk_encoder_reset(ChunkEncoder *ce) {
+    for (int i = 0; i < ce->threads; i++) {
+        ce->chunks[i].ulen = 0;
+        memset(&ce->chunks[i].dict->counters, 0, sizeof(Counters));
+    }
+
+    ce->filled = ce->drained = 0;
+    ce->drain_pos = 0;
+    ce->draining = false;
+    ce->count = 0;
+    ce->uoff = 0;
+    ce->coff = sizeof(FileHeader);
+
+    free(ce->trailer);
+    ce->trailer = NULL;
+    ce->trailer_size = ce->trailer_pos = 0;
+}
+
+// Destructor for ChunkEncoder
+void chunk_encoder_delete(ChunkEncoder *ce) {
+    if (ce->pool != NULL)
+        pool_delete(ce->pool);
+
+    for (int i = 0; ce->chunks != NULL && i < ce->threads; i++) {
+        free(ce->chunks[i].buffer);
+        free(ce->chunks[i].out);
+        free(ce->chunks[i].syms);
+        if (ce->chunks[i].dict != NULL)
+            dict_delete(ce->chunks[i].dict);
+    }
+
+    free(ce->chunks);
+    free(ce->index);
+    free(ce->trailer);
+    free(ce);
+}
+
+// Constructor for ChunkDecoder
+ChunkDecoder *chunk_decoder_create(
+    int bits, int policy, bool lzw, bool entropy, bool checksum, int threads, bool indexed) {
+    ChunkDecoder *cd = (ChunkDecoder *) calloc(1, sizeof(ChunkDecoder));
+
+    if (cd == NULL)
+        return NULL;
+
+    cd->threads = threads;
+    cd->bits = bits;
+    cd->indexed = indexed;
+    cd->checksum = checksum;
+    cd->pool = pool_create(threads);
+    cd->chunks = (Chunk *) calloc(threads, sizeof(Chunk));
+    bool ok = cd->pool != NULL && cd->chunks != NULL;
+
+    for (int i = 0; ok && i < threads; i++) {
+        cd->chunks[i].bits = bits;
+        cd->chunks[i].policy = policy;
+        cd->chunks[i].lzw = lzw;
+        cd->chunks[i].entropy = entropy;
+        cd->chunks[i].checksum = checksum;
+        ok = reserve_table(&cd->chunks[i], 0); // tables grow with the chunks they get
+    }
+
+    if (!ok) {
+        chunk_decoder_delete(cd);
+        return NULL;
+    }
+
+    return cd;
+}
+
+// Reads chunks out of the input, submitting each one as soon as its payload is complete, until
+// the batch is full or the end marker is reached
+static lz_status gather_payloads(ChunkDecoder *cd, const uint8_t **in, size_t *in_len) {
+    while (!cd->ended && cd->filled < cd->threads && *in_len > 0) {
+        Chunk *chunk = &cd->chunks[cd->filled];
+
+        if (cd->head_pos < sizeof(ChunkHeader)) {
+            cd->head_pos += copy_in(in, in_len, (uint8_t *) &cd->head + cd->head_pos,
+                sizeof(ChunkHeader) - cd->head_pos);
+
+            if (cd->head_pos < sizeof(ChunkHeader)) // the rest is in the next input
+                break;
+
+            swap_chunk_header(&cd->head);
+
+            if (cd->head.ulen == 0 && cd->head.clen == 0) {
+                cd->ended = true;
+                break;
+            }
+
+            // no valid chunk is larger than the encoder allows, compresses to more than its bound
+            // or decompresses to more than its payload can expand to, which keeps a damaged
+            // header from allocating much more than the input holds
+            if (cd->head.ulen > MAX_CHUNK
+                || cd->head.clen > block_bound(cd->head.ulen, cd->bits)
+                                       + (cd->checksum ? CHECKSUM_SIZE : 0)
+                || cd->head.ulen > block_expansion(cd->head.clen))
+                return LZ_DATA_ERROR;
+
+            chunk->ulen = cd->head.ulen;
+            chunk->clen = cd->head.clen;
+            cd->got = 0;
+
+            if (!reserve(&chunk->out, &chunk->out_size, chunk->ulen)
+                || !reserve_table(chunk, chunk->ulen))
+                return LZ_MEM_ERROR;
+        }
+
+        // a whole payload in the input is decompressed in place
+        if (cd->got == 0 && *in_len >= chunk->clen) {
+            chunk->in = *in;
+            cd->got = chunk->clen;
+            *in += chunk->clen;
+            *in_len -= chunk->clen;
+        } else {
+            if (!reserve(&chunk->buffer, &chunk->buffer_size, chunk->clen))
+                return LZ_MEM_ERROR;
+
+            chunk->in = chunk->buffer;
+            cd->got += copy_in(in, in_len, chunk->buffer + cd->got, chunk->clen - cd->got);
+        }
+
+        if (cd->got == chunk->clen) {
+            submit(cd->pool, decode_chunk, chunk);
+            cd->filled++;
+            cd->head_pos = 0;
+        }
+    }
+
+    return LZ_OK;
+}
+
+// Hands out the decompressed chunks of the batch in file order, returns true once all of them are
+static bool drain_words(ChunkDecoder *cd, uint8_t **out, size_t *out_len) {
+    while (cd->drained < cd->filled) {
+        Chunk *chunk = &cd->chunks[cd->drained];
+
+        cd->drain_pos
+            += copy_out(out, out_len, chunk->out + cd->drain_pos, chunk->ulen - cd->drain_pos);
+
+        if (cd->drain_pos < chunk->ulen) // output full
+            return false;
+
+        cd->drain_pos = 0;
+        cd->drained++;
+    }
+
+    cd->filled = cd->drained = 0;
+    return true;
+}
+
+// Skips the index entries and checks the footer against the chunks that were read
+static lz_status read_trailer(ChunkDecoder *cd, const uint8_t **in, size_t *in_len) {
+    size_t n = *in_len < cd->skip ? *in_len : cd->skip;
+    *in += n;
+    *in_len -= n;
+    cd->skip -= n;
+
+    if (cd->skip > 0)
+        return LZ_OK;
+
+    cd->footer_pos += copy_in(in, in_len, (uint8_t *) &cd->footer + cd->footer_pos,
+        sizeof(IndexFooter) - cd->footer_pos);
+
+    if (cd->footer_pos < sizeof(IndexFooter))
+        return LZ_OK;
+
+    swap_footer(&cd->footer);
+
+    if (cd->footer.magic != INDEX_MAGIC || cd->footer.count != cd->count
+        || cd->footer.total != cd->total)
+        return LZ_DATA_ERROR;
+
+    cd->done = true;
+    return LZ_OK;
+}
+
+// Decompresses as much input as the output has room for
+lz_status chunk_decode(
+    ChunkDecoder *cd, const uint8_t **in, size_t *in_len, uint8_t **out, size_t *out_len) {
+    lz_status status = LZ_OK;
+
+    for (;;) {
+        if (cd->draining) {
+            if (!drain_words(cd, out, out_len)) // output full
+                break;
+            cd->draining = false;
+
+            if (cd->ended) {
+                cd->done = !cd->indexed;
+                cd->skip = cd->count * sizeof(IndexEntry);
+            }
+        }
+
+        if (cd->done) {
+            status = LZ_STREAM_END;
+            break;
+        }
+
+        if (cd->ended) {
+            status = read_trailer(cd, in, in_len);
+
+            if (status != LZ_OK || !cd->done) // damaged, or the rest is in the next input
+                break;
+            continue;
+        }
+
+        status = gather_payloads(cd, in, in_len);
+
+        if (status != LZ_OK)
+            break;
+
+        if (cd->filled < cd->threads && !cd->ended) // more input needed to fill the batch
+            break;
+
+        pool_wait(cd->pool);
+
+        for (int i = 0; i < cd->filled; i++) {
+            if (!cd->chunks[i].ok) {
+                status = LZ_DATA_ERROR;
+                break;
+            }
+
+            cd->count++;
+            cd->total += cd->chunks[i].ulen;
+        }
+
+        if (status != LZ_OK)
+            break;
+
+        cd->draining = true;
+    }
+
+    pool_wait(cd->pool); // workers may be reading chunks straight out of the input
+    return status;
+}
+
+// Adds the counters of every chunk slot, which no worker is using between calls
+void chunk_decoder_counters(const ChunkDecoder *cd, Counters *sum) {
+    for (int i = 0; i < cd->threads; i++)
+        counters_add(sum, &cd->chunks[i].table->counters);
+}
+
+// Starts over without giving any memory back
+void chunk_decoder_reset(ChunkDecoder *cd) {
+    for (int i = 0; i < cd->threads; i++)
+        memset(&cd->chunks[i].table->counters, 0, sizeof(Counters));
+
+    cd->filled = cd->drained = 0;
+    cd->drain_pos = 0;
+    cd->draining = false;
+    cd->head_pos = cd->got = 0;
+    cd->ended = cd->done = false;
+    cd->count = cd->total = cd->skip = 0;
+    cd->footer_pos = 0;
+}
+
+// Destructor for ChunkDecoder
+void chunk_decoder_delete(ChunkDecoder *cd) {
+    if (cd->pool != NULL)
+        pool_delete(cd->pool);
+
+    for (int i = 0; cd->chunks != NULL && i < cd->threads; i++) {
+        free(cd->chunks[i].buffer);
+        free(cd->chunks[i].out);
+        if (cd->chunks[i].table != NULL)
+            wt_delete(cd->chunks[i].table);
+    }
+
+    free(cd->chunks);
+    free(cd);
+}
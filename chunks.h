@@ -0,0 +1,100 @@
+#ifndef __CHUNKS_H__
+#define __CHUNKS_H__
+
+#include "lz78.h"
+#include "stats.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Incremental codec for the body of a chunked file: independent chunks, each coded with
+// block_encode or block_decode on a pool of worker threads and checksummed along the way if asked,
+// followed by the end marker and, if indexed, the chunk index.
+//
+// A batch of as many chunks as there are threads is gathered, coded in parallel and then handed
+// out in order. Chunks that arrive whole in the input are coded straight out of it without being
+// copied, which is why neither call returns while a worker may still be reading the input.
+//
+
+typedef struct ChunkEncoder ChunkEncoder;
+
+typedef struct ChunkDecoder ChunkDecoder;
+
+/*
+ * Constructor: Creates an encoder for chunks of chunk_size bytes with codes of at most bits bits
+ * and a full dictionary handled as policy says, in bare LZW codes if lzw is set or with entropy
+ * coded symbols if entropy is, each followed by its checksum if checksum is set, compressing
+ * threads of them at a time
+ * Returns the new encoder, NULL if memory ran out
+ */
+ChunkEncoder *chunk_encoder_create(int bits, int policy, bool lzw, bool entropy, bool checksum,
+    int threads, uint32_t chunk_size);
+
+/*
+ * Returns the largest chunked file, its header, end marker and index included, that n bytes can be
+ * compressed into by an encoder created with chunk_size, bits and checksum
+ */
+size_t chunk_bound(size_t n, uint32_t chunk_size, int bits, bool checksum);
+
+/*
+ * Compresses input into output, writing the end marker and the index once the input runs out if
+ * finish is set
+ * Returns LZ_STREAM_END once the index has been written out, LZ_MEM_ERROR if it could not be
+ * grown, and LZ_OK otherwise
+ */
+lz_status chunk_encode(ChunkEncoder *ce, const uint8_t **in, size_t *in_len, uint8_t **out,
+    size_t *out_len, bool finish);
+
+/*
+ * Adds the counters of every chunk compressed so far to sum
+ */
+void chunk_encoder_counters(const ChunkEncoder *ce, Counters *sum);
+
+/*
+ * Forgets the chunks, the index and the counters, ready to compress a new file with the threads
+ * and buffers of the previous one
+ */
+void chunk_encoder_reset(ChunkEncoder *ce);
+
+/*
+ * Destructor: Frees the encoder
+ */
+void chunk_encoder_delete(ChunkEncoder *ce);
+
+/*
+ * Constructor: Creates a decoder for chunks with codes of at most bits bits and a full dictionary
+ * handled as policy says, in bare LZW codes if lzw is set or with entropy coded symbols if entropy
+ * is, each followed by a checksum to verify if checksum is set, decompressing threads of them at
+ * a time, which expects an index after the end marker if indexed is set
+ * Returns the new decoder, NULL if memory ran out
+ */
+ChunkDecoder *chunk_decoder_create(
+    int bits, int policy, bool lzw, bool entropy, bool checksum, int threads, bool indexed);
+
+/*
+ * Decompresses input into output
+ * Returns LZ_STREAM_END once the end marker, and the index if there is one, have been read and
+ * every chunk written out, LZ_DATA_ERROR if a chunk or the index is damaged, LZ_MEM_ERROR if a
+ * buffer could not be allocated, and LZ_OK otherwise
+ */
+lz_status chunk_decode(ChunkDecoder *cd, const uint8_t **in, size_t *in_len, uint8_t **out,
+    size_t *out_len);
+
+/*
+ * Adds the counters of every chunk decompressed so far to sum
+ */
+void chunk_decoder_counters(const ChunkDecoder *cd, Counters *sum);
+
+/*
+ * Forgets the chunks read and the counters, ready to decompress a new file with the same
+ * parameters, with the threads and buffers of the previous one
+ */
+void chunk_decoder_reset(ChunkDecoder *cd);
+
+/*
+ * Destructor: Frees the decoder
+ */
+void chunk_decoder_delete(ChunkDecoder *cd);
+
+#endif
@@ -6,6 +6,19 @@
 #define STOP_CODE  0
 #define EMPTY_CODE 1
 #define START_CODE 2
+#define CLEAR_CODE 2 // Only in POLICY_ADAPTIVE streams, where codes start at 3.
+#define LITERALS   256 // One-symbol phrases of LZW streams, the codes after the reserved ones.
 #define MAX_CODE   UINT16_MAX
 
+#define MIN_BITS     12 // Narrowest maximum code width the encoder accepts.
+#define MAX_BITS     24 // Widest maximum code width the encoder accepts.
+#define DEFAULT_BITS 16 // Maximum code width giving MAX_CODE.
+
+#define MAX_CODE_BITS(bits) ((UINT32_C(1) << (bits)) - 1) // MAX_CODE for a given code width.
+
+// Bit length of code, which is also the width of the pair written while it is next_code
+static inline int code_bits(uint32_t code) {
+    return code ? 32 - __builtin_clz(code) : 1;
+}
+
 #endif
@@ -0,0 +1,77 @@
+#include "crc32c.h"
+#include "endian.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define POLY 0x82F63B78 // Castagnoli polynomial, bit-reversed.
+
+static uint32_t table[8][256]; // table[k][b]: CRC of byte b followed by k zero bytes
+static bool hardware; // the crc32 instruction is there
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+// Fills in the tables and checks for SSE4.2
+static void crc32c_init(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++)
+            crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+        table[0][b] = crc;
+    }
+
+    for (uint32_t b = 0; b < 256; b++)
+        for (int k = 1; k < 8; k++)
+            table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+
+#if defined(__x86_64__)
+    hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+// Slice-by-8: the 8 bytes of a word go through 8 tables at once instead of one after the other
+static uint32_t crc32c_tables(uint32_t crc, const uint8_t *buf, size_t n) {
+    for (; n >= 8; buf += 8, n -= 8) {
+        uint64_t word = load_le64(buf) ^ crc;
+        crc = table[7][word & 0xFF] ^ table[6][(word >> 8) & 0xFF]
+              ^ table[5][(word >> 16) & 0xFF] ^ table[4][(word >> 24) & 0xFF]
+              ^ table[3][(word >> 32) & 0xFF] ^ table[2][(word >> 40) & 0xFF]
+              ^ table[1][(word >> 48) & 0xFF] ^ table[0][word >> 56];
+    }
+
+    for (; n > 0; buf++, n--)
+        crc = (crc >> 8) ^ table[0][(crc ^ *buf) & 0xFF];
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+// The crc32 instruction, 8 bytes at a time
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(
+    uint32_t crc, const uint8_t *buf, size_t n) {
+    uint64_t crc64 = crc;
+
+    for (; n >= 8; buf += 8, n -= 8)
+        crc64 = _mm_crc32_u64(crc64, load_le64(buf));
+
+    crc = (uint32_t) crc64;
+    for (; n > 0; buf++, n--)
+        crc = _mm_crc32_u8(crc, *buf);
+
+    return crc;
+}
+#endif
+
+// Works on the inverted CRC, as the definition asks
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t n) {
+    pthread_once(&once, crc32c_init);
+
+#if defined(__x86_64__)
+    if (hardware)
+        return ~crc32c_sse42(~crc, buf, n);
+#endif
+
+    return ~crc32c_tables(~crc, buf, n);
+}
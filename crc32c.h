@@ -0,0 +1,21 @@
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// CRC32C, the Castagnoli polynomial, as used for the checksums of chunks.
+//
+// On x86-64 processors with SSE4.2 the crc32 instruction takes 8 bytes at a time. Everywhere else
+// a slice-by-8 table walk does the same in software, with one load per table for each 8 bytes.
+// Which one is used is decided once, on the first call.
+//
+
+/*
+ * Returns the CRC32C of the n bytes of buf, carrying on from crc, the CRC32C of the bytes before
+ * them or 0 if there are none
+ */
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t n);
+
+#endif
@@ -1,31 +1,233 @@
-#include "code.h"
-#include "trie.h"
-#include "word.h"
+#include "batch.h"
 #include "io.h"
+#include "lz78.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "seek.h"
+#include "stats.h"
 
+#include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <math.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
 
-#define OPTIONS "vhi:o:"
+#define OPTIONS "vhi:I:o:T:r:tf"
+
+#define RANGE_BUFFER (256 * BLOCK) // 1MB at a time with --range
+
+static const struct option long_options[] = {
+    { "range", required_argument, NULL, 'r' },
+    { "stats", required_argument, NULL, 'S' },
+    { "perf", no_argument, NULL, 'P' },
+    { "pipeline", no_argument, NULL, 'L' },
+    { "buffer", required_argument, NULL, 'B' },
+    { "direct", no_argument, NULL, 'D' },
+    { NULL, 0, NULL, 0 },
+};
+
+// Decompresses infile into outfile through s, size bytes at a time, straight out of a mapping if
+// infile is a regular file that is not read with O_DIRECT, and counts the bytes of infile in
+// *size_in. With outfile -1 nothing is written, which only checks that infile decodes.
+static lz_status decompress_file(
+    lz_stream *s, int infile, int outfile, size_t size, bool direct, uint64_t *size_in) {
+    InputMap map;
+    bool mapped = !direct && map_input(infile, &map);
+    uint8_t *in_buf = mapped ? NULL : alloc_buffer(size);
+    uint8_t *out_buf = alloc_buffer(size);
+    lz_status status = (mapped || in_buf != NULL) && out_buf != NULL ? LZ_OK : LZ_MEM_ERROR;
+
+    const uint8_t *next_in = mapped ? map.data : in_buf;
+    size_t avail_in = mapped ? map.size : 0;
+    bool eof = mapped;
+    uint8_t *next_out = out_buf;
+    size_t avail_out = size;
+    *size_in = avail_in;
+
+    while (status == LZ_OK) {
+        if (avail_in == 0 && !eof) {
+            int n = read_bytes(infile, in_buf, size);
+            if (n < 0) {
+                status = LZ_IO_ERROR;
+                break;
+            }
+
+            avail_in = n;
+            next_in = in_buf;
+            eof = avail_in < size; // read_bytes only comes up short at end of file
+            *size_in += avail_in;
+        }
+
+        status = lz_decompress(s, &next_in, &avail_in, &next_out, &avail_out);
+
+        // still waiting for input that will never come
+        if (status == LZ_OK && eof && avail_in == 0 && avail_out > 0)
+            status = LZ_DATA_ERROR;
+
+        // whole buffers only, so that every write but the last one is aligned for O_DIRECT
+        if (avail_out == 0 || status != LZ_OK) {
+            if (outfile >= 0 && write_bytes(outfile, out_buf, next_out - out_buf)
+                                    != next_out - out_buf)
+                status = LZ_IO_ERROR;
+            next_out = out_buf;
+            avail_out = size;
+        }
+    }
+
+    free(in_buf);
+    free(out_buf);
+    if (mapped)
+        unmap_input(&map);
+
+    return status;
+}
+
+// Decompresses infile into outfile through s like decompress_file, but with a reader and a writer
+// thread moving buffers of size bytes in and out, so that neither reads nor writes hold
+// decompression up
+static lz_status decompress_piped(
+    lz_stream *s, int infile, int outfile, size_t size, uint64_t *size_in) {
+    PipeReader *reader = pipe_reader_create(infile, size);
+    PipeWriter *writer = outfile >= 0 ? pipe_writer_create(outfile, size) : NULL;
+    uint8_t *scratch = outfile >= 0 ? NULL : (uint8_t *) malloc(size); // for a test
+    lz_status status
+        = reader != NULL && (writer != NULL || scratch != NULL) ? LZ_OK : LZ_MEM_ERROR;
+
+    const uint8_t *next_in = NULL;
+    size_t avail_in = 0;
+    bool eof = false;
+    uint8_t *out = NULL, *next_out = NULL; // buffer being filled, handed over once it is full
+    size_t avail_out = 0;
+    *size_in = 0;
+
+    while (status == LZ_OK) {
+        if (avail_in == 0 && !eof) {
+            int got = pipe_reader_next(reader, &next_in, &avail_in);
+            if (got < 0) {
+                status = LZ_IO_ERROR;
+                break;
+            }
+
+            eof = got;
+            *size_in += avail_in;
+        }
+
+        if (out == NULL) {
+            out = next_out = writer != NULL ? pipe_writer_buffer(writer) : scratch;
+            avail_out = size;
+
+            if (out == NULL) { // the writer failed, and says why once it is deleted
+                status = LZ_IO_ERROR;
+                break;
+            }
+        }
+
+        status = lz_decompress(s, &next_in, &avail_in, &next_out, &avail_out);
+
+        // still waiting for input that will never come
+        if (status == LZ_OK && eof && avail_in == 0 && avail_out > 0)
+            status = LZ_DATA_ERROR;
+
+        if (avail_out == 0 || status != LZ_OK) {
+            if (writer != NULL)
+                pipe_writer_commit(writer, next_out - out);
+            out = NULL;
+        }
+    }
+
+    if (reader != NULL)
+        pipe_reader_delete(reader);
+    if (writer != NULL && !pipe_writer_delete(writer))
+        status = LZ_IO_ERROR;
+    free(scratch);
+
+    return status;
+}
+
+// Parses a range given as offset:length, each a byte count as accepted by parse_size
+static bool parse_range(const char *arg, uint64_t *offset, uint64_t *length) {
+    char first[32];
+    const char *colon = strchr(arg, ':');
+
+    if (colon == NULL || (size_t) (colon - arg) >= sizeof(first))
+        return false;
+
+    memcpy(first, arg, colon - arg);
+    first[colon - arg] = '\0';
+
+    return parse_size(first, offset) && parse_size(colon + 1, length);
+}
+
+// Decompresses length bytes starting at offset of an indexed chunked file, returns LZ_DATA_ERROR
+// if the file has no usable index or is damaged
+static lz_status decode_range(int infile, int outfile, uint64_t offset, uint64_t length) {
+    SeekReader *reader = seek_open(infile, 1); // every chunk is read once, no need to cache more
+    uint8_t *buf = (uint8_t *) malloc(RANGE_BUFFER);
+    lz_status status = reader != NULL && buf != NULL ? LZ_STREAM_END : LZ_DATA_ERROR;
+
+    while (status == LZ_STREAM_END && length > 0) {
+        int64_t n = seek_read(reader, offset, buf, length < RANGE_BUFFER ? length : RANGE_BUFFER);
+
+        if (n <= 0) { // past the end, or damaged
+            status = n == 0 ? LZ_STREAM_END : LZ_DATA_ERROR;
+            break;
+        }
+
+        if (write_bytes(outfile, buf, n) != n)
+            status = LZ_IO_ERROR;
+        offset += n;
+        length -= n;
+    }
+
+    if (reader != NULL)
+        seek_close(reader);
+    free(buf);
+    return status;
+}
+
+// Nanoseconds on the monotonic clock
+static uint64_t wall_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
 int main(int argc, char **argv) {
     int opt;
     bool verbose = false;
     bool help = false;
+    bool stats = false; // --stats=json
+    bool perf = false; // --perf
+    bool piped = false; // --pipeline
+    uint64_t buffer = 0; // --buffer, 0 for the default of the path taken
+    bool direct = false; // --direct
+    bool force = false; // overwrite the outputs of a batch that exist already
+    uint64_t start = wall_clock();
 
     char *input_file, *output_file;
     input_file = NULL;
     output_file = NULL;
+    BatchList inputs = { NULL, 0, 0 }; // every -i, and the names in every -I list
+    bool listed = false; // -I given, which asks for batch mode even with a single name
+    int infileFD = -1, outfileFD = -1;
+    Perf *counters = NULL; // --perf
+    lz_stream *stream = NULL;
+    int ret = 0; // exit status, every exit once inputs may hold names goes through done
+
+    int threads = 0; // chunks decompressed at a time, or files in batch mode, 0 for the default
+    bool range = false; // only decompress range_length bytes from range_offset
+    bool test = false; // only check that the input decodes, writing nothing
+    uint64_t range_offset = 0, range_length = 0;
 
     int optInd = optind + 1;
 
     // manages user inputs
-    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
         switch (opt) {
         case 'v': {
             verbose = true;
@@ -39,6 +241,20 @@ int main(int argc, char **argv) {
 
         case 'i': {
             input_file = argv[optInd];
+
+            if (!batch_list_add(&inputs, input_file))
+                help = true;
+            break;
+        }
+
+        case 'I': {
+            listed = true;
+
+            if (!batch_list_read(&inputs, argv[optInd])) {
+                fprintf(stderr, "%s: No such file or directory\n", argv[optInd]);
+                ret = 1;
+                goto done;
+            }
             break;
         }
 
@@ -47,6 +263,63 @@ int main(int argc, char **argv) {
             break;
         }
 
+        case 'T': {
+            threads = atoi(argv[optInd]);
+
+            if (threads < 1)
+                help = true;
+            break;
+        }
+
+        case 'r': {
+            range = true;
+
+            if (!parse_range(optarg, &range_offset, &range_length))
+                help = true;
+            break;
+        }
+
+        case 't': {
+            test = true;
+            break;
+        }
+
+        case 'f': {
+            force = true;
+            break;
+        }
+
+        case 'S': {
+            stats = true;
+
+            if (strcmp(optarg, "json") != 0) // the only format for now
+                help = true;
+            break;
+        }
+
+        case 'P': {
+            perf = true;
+            break;
+        }
+
+        case 'L': {
+            piped = true;
+            break;
+        }
+
+        case 'B': {
+            // whole blocks, so that O_DIRECT can take every buffer but the last one
+            if (!parse_size(optarg, &buffer) || buffer < MIN_IO_BUFFER || buffer > MAX_IO_BUFFER
+                || buffer % BLOCK != 0)
+                help = true;
+            break;
+        }
+
+        case 'D': {
+            direct = true;
+            break;
+        }
+
         default: {
             help = true;
             break;
@@ -55,91 +328,157 @@ int main(int argc, char **argv) {
         optInd = optind + 1;
     }
 
-    // usage message
-    if (help == true) {
-        printf("SYNOPSIS:\n   Decompresses files with the LZ78 decompression algorithm.\n   Used "
-               "with files compressed with the corresponding encoder.\n\nUSAGE\n   ./decode [-vh] "
-               "[-i input] [-o output]\n\nOPTIONS\n  -h\t\t\tDisplay program help and usage.\n  "
-               "-v\t\t\tDisplay decompression statistics.\n  -i input\t\tSpecify input to "
-               "decompress (stdin by default)\n  -o output\t\tSpecify output of decompressed input "
-               "(stdout by default)\n");
-        return 0;
-    }
+    // a test reads the whole file, and has no output to put a range into
+    if (test && (range || output_file != NULL))
+        help = true;
 
     // file containing compressed data
-    int infileFD = 0; // defaults to stdin file descriptor
+    infileFD = 0; // defaults to stdin file descriptor
 
     // if input file provided, use that instead of stdin
-    if (input_file != NULL) {
+    bool batch = inputs.count > 1 || listed;
+    if (input_file != NULL && !batch && !help) {
         infileFD = open(input_file, O_RDONLY, 0664); // open to read
 
         // if file doesn't exist in directory
         if (infileFD == -1) {
             printf("%s: No such file or directory\n", input_file);
-            return 0;
+            goto done;
         }
     }
 
+    // many inputs, or an archive, are decompressed side by side, next to themselves or into the
+    // directory at -o, with nothing for a pipeline to add; the archive is told by the file already
+    // open, so a pipe or FIFO is never opened or read twice
+    if (!batch && !help && input_file != NULL && batch_is_archive(infileFD))
+        batch = true;
+    if (batch) {
+        if (infileFD > 0)
+            close(infileFD);
+        infileFD = -1; // none for a batch
+    }
+
+    if (batch && threads == 0)
+        threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    else if (threads == 0)
+        threads = 1;
+
+    if (batch && (range || piped || threads < 1))
+        help = true;
+
+    // usage message
+    if (help == true) {
+        printf("SYNOPSIS:\n   Decompresses files with the LZ78 decompression algorithm.\n   Used "
+               "with files compressed with the corresponding encoder.\n\nUSAGE\n   ./decode [-vh] "
+               "[-i input]... [-I list] [-o output] [-T threads] [-r off:len] [-t] [-f] "
+               "[--stats=json] [--perf] [--pipeline] [--buffer size] [--direct]\n\nOPTIONS\n  "
+               "-h\t\t\tDisplay program help and usage.\n  -v\t\t\tDisplay decompression "
+               "statistics.\n  -i input\t\tSpecify input to decompress (stdin by default), repeat "
+               "for a batch, an archive is one by itself\n  -I list\t\tDecompress every file named "
+               "in list, one per line, as a batch\n  -o output\t\tSpecify output of decompressed "
+               "input (stdout by default), the directory to put a batch into (beside each input by "
+               "default)\n  -T threads\t\tDecompress the chunks of a chunked file on this many "
+               "threads, or this many files of a batch at once (all CPUs by default)\n  -r, "
+               "--range off:len\tOnly decompress len bytes from offset off of a chunked file\n  "
+               "-t\t\t\tOnly test that the input decodes, and matches its checksums, writing "
+               "nothing\n  -f\t\t\tOverwrite outputs of a batch that exist already\n  "
+               "--stats=json\t\tPrint counters as JSON on stderr, in detail if built with STATS=1"
+               "\n  --perf\t\t\tPrint hardware performance counters per MB on stderr\n  "
+               "--pipeline\t\tRead and write on threads of their own, overlapping with "
+               "decompression\n  --buffer size\t\tRead and write size bytes at a time, 64K to 16M "
+               "in 4K steps (256K, 1M with --pipeline)\n  --direct\t\tRead and write with "
+               "O_DIRECT, bypassing the page cache where the file system allows it\n");
+        goto done;
+    }
+
     // file that will contain decompressed file
-    int outfileFD = 1; // defaults to stdout file descriptor
+    outfileFD = test || batch ? -1 : 1; // defaults to stdout, none at all for a test or batch
 
     // if output file provided, use that instead of stdout
-    if (output_file != NULL) {
+    if (output_file != NULL && !batch) {
         outfileFD = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666); // open to write
 
         // if file doesn't exist in directory
         if (outfileFD == -1) {
             printf("%s: No such file or directory\n", output_file);
-            return 0;
+            goto done;
         }
     }
 
-    struct stat header_stats;
-    fstat(infileFD, &header_stats);
+    // where O_DIRECT is refused, the page cache is used as usual
+    if (direct && !batch) {
+        set_direct(infileFD);
+        if (outfileFD >= 0)
+            set_direct(outfileFD);
+    }
 
-    FileHeader *head = (FileHeader *) calloc(1, sizeof(FileHeader));
-    head->magic = MAGIC;
-    head->protection = header_stats.st_mode;
+    if (buffer == 0)
+        buffer = piped ? PIPE_BUFFER : IO_BUFFER;
 
-    read_header(infileFD, head);
-    free(head);
+    if (range) {
+        lz_status status = decode_range(infileFD, outfileFD, range_offset, range_length);
 
-    WordTable *table = wt_create();
-    uint8_t curr_sym = 0;
-    uint16_t curr_code = 0;
-    uint16_t next_code = START_CODE;
-    uint8_t bitLen = 0;
+        if (status == LZ_IO_ERROR) {
+            fprintf(stderr, "I/O error: %s\n", strerror(errno));
+            ret = 1;
+        } else if (status != LZ_STREAM_END) {
+            fprintf(stderr, "%s: --range needs an intact chunked file that can be seeked\n",
+                input_file ? input_file : "stdin");
+            ret = 1;
+        }
 
-    if (next_code >= 1)
-        bitLen = log2(next_code) + 1;
-    else
-        bitLen = 1;
+        goto done;
+    }
 
-    // while there are more pairs to read, add to WordTable
-    while (read_pair(infileFD, &curr_code, &curr_sym, bitLen)) {
-        table[next_code] = word_append_sym(table[curr_code], curr_sym);
-        write_word(outfileFD, table[next_code]);
-        next_code++;
+    // hardware counters, started before the stream so that its worker threads are counted too
+    counters = perf ? perf_start() : NULL;
+    if (perf && counters == NULL)
+        fprintf(stderr, "--perf: No hardware performance counters available\n");
 
-        // reset Wordtable if full
-        if (next_code == MAX_CODE) {
-            wt_reset(table);
-            next_code = START_CODE;
-        }
-        bitLen = log2(next_code) + 1;
+    uint64_t compressed_file_size = 0;
+    lz_status status = LZ_MEM_ERROR;
+    int failed = 0; // files of a batch that could not be decompressed, each reported on stderr
+    lz_stats counts;
+    memset(&counts, 0, sizeof(lz_stats));
+
+    if (batch) {
+        failed = batch_decompress(
+            &inputs, output_file, test, threads, buffer, direct, force, &counts);
+        status = LZ_STREAM_END; // each failed file is reported, as is a batch that cannot start
+        compressed_file_size = counts.total_in;
+    } else if ((stream = lz_decompress_create(threads)) != NULL && piped) {
+        status = decompress_piped(stream, infileFD, outfileFD, buffer, &compressed_file_size);
+    } else if (stream != NULL) {
+        status = decompress_file(
+            stream, infileFD, outfileFD, buffer, direct, &compressed_file_size);
     }
-    flush_words(outfileFD); // write out words that didn't completely fill buffer
+
+    if (counters != NULL)
+        perf_stop(counters);
+
+    if (failed < 0) {
+        ret = 1;
+        goto done;
+    } else if (status == LZ_MEM_ERROR) {
+        fprintf(stderr, "Not enough memory for %d threads\n", threads);
+        ret = 1;
+        goto done;
+    } else if (status == LZ_IO_ERROR) {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+        ret = 1;
+        goto done;
+    } else if (status != LZ_STREAM_END) {
+        fprintf(stderr, "%s: Damaged or truncated file\n", input_file ? input_file : "stdin");
+        ret = 1;
+        goto done;
+    }
+
+    if (stream != NULL)
+        lz_get_stats(stream, &counts);
 
     // verbose statistics for compression
     if (verbose) {
-        uint64_t compressed_file_size = 0;
-        uint64_t uncompressed_file_size = 0;
-
-        if (total_bits % 8 == 0)
-            compressed_file_size = ((total_bits / 8) + 9);
-        else
-            compressed_file_size = ((total_bits / 8) + 10);
-        uncompressed_file_size = total_syms;
+        uint64_t uncompressed_file_size = counts.total_out;
 
         double space_saving = (double) compressed_file_size / uncompressed_file_size;
         space_saving = 1 - space_saving;
@@ -150,9 +489,26 @@ int main(int argc, char **argv) {
         printf("Compression ratio: %.2f%%\n", space_saving);
     }
 
-    close(infileFD);
-    close(outfileFD);
-    wt_delete(table); // free memory by deleting wordtable
+    // counters for monitoring, on stderr since stdout may be the output
+    if (stats)
+        print_stats(stderr, "decompress", &counts, wall_clock() - start);
+
+    // hardware counters per MB of uncompressed data
+    if (counters != NULL)
+        perf_print(counters, stderr, counts.total_out);
+
+    ret = failed > 0;
+
+done:
+    if (counters != NULL)
+        perf_delete(counters);
+    if (stream != NULL)
+        lz_stream_delete(stream);
+    batch_list_free(&inputs);
+    if (infileFD >= 0)
+        close(infileFD);
+    if (outfileFD >= 0)
+        close(outfileFD);
 
-    return 0;
+    return ret;
 }
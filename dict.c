@@ -0,0 +1,146 @@
+#include "dict.h"
+#include "code.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EPOCH_SHIFT 24 // epoch sits right above the code in a slot
+#define CODE_MASK   ((UINT64_C(1) << EPOCH_SHIFT) - 1)
+
+// Builds the key of the phrase made of phrase code followed by sym
+static inline uint32_t dict_key(uint32_t code, uint8_t sym) {
+    return (uint32_t) code << 8 | sym;
+}
+
+// Builds the slot holding child under key in the current epoch
+static inline uint64_t dict_slot(Dict *d, uint32_t key, uint32_t child) {
+    return (uint64_t) key << 32 | (uint64_t) d->epoch << EPOCH_SHIFT | child;
+}
+
+// Checks if slot was written in the current epoch
+static inline bool dict_live(Dict *d, uint64_t slot) {
+    return ((slot >> EPOCH_SHIFT) & 0xFF) == d->epoch;
+}
+
+// Fibonacci hashing: the top bits of key * 2^32 / phi are well mixed
+static inline uint32_t dict_hash(Dict *d, uint32_t key) {
+    return (key * 0x9E3779B1u) >> d->shift;
+}
+
+// Constructor for Dict
+Dict *dict_create(uint32_t max_code) {
+    Dict *d = (Dict *) calloc(1, sizeof(Dict));
+
+    if (d == NULL)
+        return NULL;
+
+    // smallest power of two that is at least twice max_code
+    uint32_t log2_slots = 1;
+    while ((UINT32_C(1) << log2_slots) < 2 * max_code)
+        log2_slots++;
+
+    d->mask = (UINT32_C(1) << log2_slots) - 1;
+    d->shift = 32 - log2_slots;
+    d->slots = (uint64_t *) calloc(d->mask + 1, sizeof(uint64_t));
+    d->epoch = 1; // zeroed slots belong to epoch 0
+
+    if (d->slots == NULL) {
+        free(d);
+        return NULL;
+    }
+
+    return d;
+}
+
+// Tracks the usage order of the phrases
+bool dict_track(Dict *d, uint32_t max_code) {
+    d->lru = lru_create(max_code);
+    return d->lru != NULL;
+}
+
+// Destructor for Dict
+void dict_delete(Dict *d) {
+    free(d->slots);
+    d->slots = NULL;
+
+    if (d->lru != NULL)
+        lru_delete(d->lru);
+
+    free(d);
+}
+
+// Empties the dictionary
+void dict_reset(Dict *d) {
+    d->epoch = (d->epoch + 1) & 0xFF;
+
+    // out of epochs: clear the table so that slots from the previous epoch 1 cannot come back
+    if (d->epoch == 0) {
+        memset(d->slots, 0, (d->mask + 1) * sizeof(uint64_t));
+        d->epoch = 1;
+    }
+
+    if (d->lru != NULL)
+        lru_reset(d->lru);
+}
+
+// returns code of the phrase code + sym, or STOP_CODE if it doesn't exist
+uint32_t dict_step(Dict *d, uint32_t code, uint8_t sym) {
+    uint32_t key = dict_key(code, sym);
+
+    // probe until the key or an empty slot is found; the table is never more than half full
+    for (uint32_t i = dict_hash(d, key);; i = (i + 1) & d->mask) {
+        uint64_t slot = d->slots[i];
+
+        if (!dict_live(d, slot))
+            return STOP_CODE;
+        if ((uint32_t) (slot >> 32) == key)
+            return slot & CODE_MASK;
+    }
+}
+
+// stores child as the code of the phrase code + sym
+void dict_insert(Dict *d, uint32_t code, uint8_t sym, uint32_t child) {
+    uint32_t key = dict_key(code, sym);
+    uint32_t i = dict_hash(d, key);
+
+    while (dict_live(d, d->slots[i]))
+        i = (i + 1) & d->mask;
+
+    d->slots[i] = dict_slot(d, key, child);
+
+    if (d->lru != NULL)
+        lru_add(d->lru, child, code, sym);
+}
+
+// removes the phrase code + sym, which must be in the dictionary
+static void dict_remove(Dict *d, uint32_t code, uint8_t sym) {
+    uint32_t key = dict_key(code, sym);
+    uint32_t hole = dict_hash(d, key);
+
+    while ((uint32_t) (d->slots[hole] >> 32) != key || !dict_live(d, d->slots[hole]))
+        hole = (hole + 1) & d->mask;
+
+    // shift back every later slot of the run that would no longer be found across the hole
+    for (uint32_t i = (hole + 1) & d->mask; dict_live(d, d->slots[i]); i = (i + 1) & d->mask) {
+        uint32_t home = dict_hash(d, (uint32_t) (d->slots[i] >> 32));
+
+        if (((i - home) & d->mask) >= ((i - hole) & d->mask)) {
+            d->slots[hole] = d->slots[i];
+            hole = i;
+        }
+    }
+
+    d->slots[hole] = 0; // epoch 0 is never live
+}
+
+// stores code + sym under the code of the least recently used leaf phrase
+uint32_t dict_recycle(Dict *d, uint32_t code, uint8_t sym) {
+    uint32_t child = lru_evict(d->lru, code);
+
+    if (child != STOP_CODE) {
+        dict_remove(d, d->lru->nodes[child].parent, d->lru->nodes[child].sym);
+        dict_insert(d, code, sym, child);
+    }
+
+    return child;
+}
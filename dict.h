@@ -0,0 +1,79 @@
+#ifndef __DICT_H__
+#define __DICT_H__
+
+#include "lru.h"
+#include "stats.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Encoder dictionary stored as an open-addressed hash table.
+//
+// Each phrase is identified by the code of its prefix (its parent in the trie) and the symbol that
+// extends it, so the table maps (parent_code, sym) to the child code. Every slot is a single 64-bit
+// word holding both the key and the code, and collisions are resolved with linear probing so a miss
+// usually costs one cache line.
+//
+// Slots also carry the epoch they were written in. Resetting the dictionary just starts a new
+// epoch, which turns every older slot into an empty one without touching the table; it is only
+// cleared for real once every 255 resets, when the 8-bit epoch wraps around.
+//
+// With POLICY_LRU the dictionary also tracks which of its phrases were used least recently, so
+// that a full one can recycle their codes one at a time instead of being reset.
+//
+
+typedef struct Dict {
+    uint64_t *slots; // key << 32 | epoch << 24 | code
+    uint32_t mask; // number of slots - 1
+    uint32_t shift; // 32 - log2(number of slots), used by the hash
+    uint32_t epoch; // slots from any other epoch are empty, never 0
+    Lru *lru; // usage order of the phrases after dict_track, NULL otherwise
+    Counters counters; // of the codec using the dictionary, with LZ_STATS
+} Dict;
+
+/*
+ * Constructor: Creates an empty dictionary for codes below max_code
+ * Sized to stay at most half full with max_code entries
+ * Returns the newly allocated dictionary
+ */
+Dict *dict_create(uint32_t max_code);
+
+/*
+ * Destructor: Frees the dictionary and its table
+ */
+void dict_delete(Dict *d);
+
+/*
+ * Starts tracking the usage order of the phrases added from now on, for dict_recycle
+ * max_code must be the one the dictionary was created for
+ * Returns false if memory ran out
+ */
+bool dict_track(Dict *d, uint32_t max_code);
+
+/*
+ * Resets the dictionary: called when code reaches max_code
+ * Removes every entry in constant time by starting a new epoch
+ */
+void dict_reset(Dict *d);
+
+/*
+ * Looks up the phrase made of phrase code followed by sym
+ * Returns its code if found, STOP_CODE if absent
+ */
+uint32_t dict_step(Dict *d, uint32_t code, uint8_t sym);
+
+/*
+ * Adds the phrase made of phrase code followed by sym under the code child
+ * The phrase must not already be in the dictionary
+ */
+void dict_insert(Dict *d, uint32_t code, uint8_t sym, uint32_t child);
+
+/*
+ * Adds the phrase made of phrase code followed by sym under the code of the least recently used
+ * phrase that no other phrase extends, which is removed
+ * The dictionary must be tracked, and the phrase must not already be in it
+ * Returns the code reused, STOP_CODE if code itself is the only such phrase and nothing was added
+ */
+uint32_t dict_recycle(Dict *d, uint32_t code, uint8_t sym);
+
+#endif
@@ -1,44 +1,174 @@
+#include "batch.h"
 #include "code.h"
-#include "trie.h"
-#include "word.h"
 #include "io.h"
+#include "lz78.h"
+#include "perf.h"
+#include "pipeline.h"
+#include "stats.h"
 
+#include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/stat.h>
-#include <math.h>
+#include <getopt.h>
+#include <time.h>
+
+#define OPTIONS "vhi:I:o:w:T:C:p:lecf"
+
+static const struct option long_options[] = {
+    { "stats", required_argument, NULL, 'S' },
+    { "perf", no_argument, NULL, 'P' },
+    { "pipeline", no_argument, NULL, 'L' },
+    { "buffer", required_argument, NULL, 'B' },
+    { "direct", no_argument, NULL, 'D' },
+    { NULL, 0, NULL, 0 },
+};
+
+// Compresses infile into outfile through s, size bytes at a time, straight out of a mapping if
+// infile is a regular file that is not read with O_DIRECT
+static lz_status compress_file(lz_stream *s, int infile, int outfile, size_t size, bool direct) {
+    InputMap map;
+    bool mapped = !direct && map_input(infile, &map);
+    uint8_t *in_buf = mapped ? NULL : alloc_buffer(size);
+    uint8_t *out_buf = alloc_buffer(size);
+    lz_status status = (mapped || in_buf != NULL) && out_buf != NULL ? LZ_OK : LZ_MEM_ERROR;
+
+    const uint8_t *next_in = mapped ? map.data : in_buf;
+    size_t avail_in = mapped ? map.size : 0;
+    bool eof = mapped;
+    uint8_t *next_out = out_buf;
+    size_t avail_out = size;
+
+    while (status == LZ_OK) {
+        if (avail_in == 0 && !eof) {
+            int n = read_bytes(infile, in_buf, size);
+            if (n < 0) {
+                status = LZ_IO_ERROR;
+                break;
+            }
+
+            avail_in = n;
+            next_in = in_buf;
+            eof = avail_in < size; // read_bytes only comes up short at end of file
+        }
 
-#include "code.h"
-#include "trie.h"
-#include "word.h"
-#include "io.h"
+        status = lz_compress(
+            s, &next_in, &avail_in, &next_out, &avail_out, eof ? LZ_FINISH : LZ_RUN);
 
-#include <inttypes.h>
-#include <stdio.h>
-#include <unistd.h>
-#include <stdlib.h>
-#include <fcntl.h>
-#include <sys/stat.h>
-#include <math.h>
+        // whole buffers only, so that every write but the last one is aligned for O_DIRECT
+        if (avail_out == 0 || status != LZ_OK) {
+            if (write_bytes(outfile, out_buf, next_out - out_buf) != next_out - out_buf)
+                status = LZ_IO_ERROR;
+            next_out = out_buf;
+            avail_out = size;
+        }
+    }
+
+    free(in_buf);
+    free(out_buf);
+    if (mapped)
+        unmap_input(&map);
 
-#define OPTIONS "vhi:o:"
+    return status;
+}
+
+// Compresses infile into outfile through s on the main thread, with a reader and a writer thread
+// moving buffers of size bytes in and out, so that neither reads nor writes hold compression up
+static lz_status compress_piped(lz_stream *s, int infile, int outfile, size_t size) {
+    PipeReader *reader = pipe_reader_create(infile, size);
+    PipeWriter *writer = pipe_writer_create(outfile, size);
+    lz_status status = reader != NULL && writer != NULL ? LZ_OK : LZ_MEM_ERROR;
+
+    const uint8_t *next_in = NULL;
+    size_t avail_in = 0;
+    bool eof = false;
+    uint8_t *out = NULL, *next_out = NULL; // buffer being filled, handed over once it is full
+    size_t avail_out = 0;
+
+    while (status == LZ_OK) {
+        if (avail_in == 0 && !eof) {
+            int got = pipe_reader_next(reader, &next_in, &avail_in);
+            if (got < 0) {
+                status = LZ_IO_ERROR;
+                break;
+            }
+
+            eof = got;
+        }
+
+        if (out == NULL) {
+            out = next_out = pipe_writer_buffer(writer);
+            avail_out = size;
+
+            if (out == NULL) { // the writer failed, and says why once it is deleted
+                status = LZ_IO_ERROR;
+                break;
+            }
+        }
+
+        status = lz_compress(
+            s, &next_in, &avail_in, &next_out, &avail_out, eof ? LZ_FINISH : LZ_RUN);
+
+        if (avail_out == 0 || status != LZ_OK) {
+            pipe_writer_commit(writer, next_out - out);
+            out = NULL;
+        }
+    }
+
+    if (reader != NULL)
+        pipe_reader_delete(reader);
+    if (writer != NULL && !pipe_writer_delete(writer))
+        status = LZ_IO_ERROR;
+
+    return status;
+}
+
+// Nanoseconds on the monotonic clock
+static uint64_t wall_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
 int main(int argc, char **argv) {
     int opt;
     bool verbose = false;
     bool help = false;
+    bool stats = false; // --stats=json
+    bool perf = false; // --perf
+    bool piped = false; // --pipeline
+    uint64_t buffer = 0; // --buffer, 0 for the default of the path taken
+    bool direct = false; // --direct
+    bool force = false; // overwrite the outputs of a batch that exist already
+    uint64_t start = wall_clock();
 
     char *input_file, *output_file;
     input_file = NULL;
     output_file = NULL;
+    BatchList inputs = { NULL, 0, 0 }; // every -i, and the names in every -I list
+    bool listed = false; // -I given, which asks for batch mode even with a single name
+    Perf *counters = NULL; // --perf
+    lz_stream *stream = NULL;
+    int ret = 0; // exit status, every exit once inputs may hold names goes through done
+
+    int bits = DEFAULT_BITS; // maximum code width
+    int threads = 0; // 0 writes a single stream, anything else a chunked file
+    int workers = 0; // files compressed at a time in batch mode, set by -T as well
+    bool sized = false; // -C given
+    uint64_t chunk_size = DEFAULT_CHUNK;
+    lz_policy policy = LZ_RESET; // what happens once the dictionary is full
+    bool lzw = false; // codes without symbols
+    bool entropy = false; // entropy coded symbols
+    bool checksum = false; // chunks followed by their CRC32C
 
     int optInd = optind + 1;
 
     // manages user inputs
-    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
         switch (opt) {
         case 'v': {
             verbose = true;
@@ -52,6 +182,20 @@ int main(int argc, char **argv) {
 
         case 'i': {
             input_file = argv[optInd];
+
+            if (!batch_list_add(&inputs, input_file))
+                help = true;
+            break;
+        }
+
+        case 'I': {
+            listed = true;
+
+            if (!batch_list_read(&inputs, argv[optInd])) {
+                fprintf(stderr, "%s: No such file or directory\n", argv[optInd]);
+                ret = 1;
+                goto done;
+            }
             break;
         }
 
@@ -60,6 +204,99 @@ int main(int argc, char **argv) {
             break;
         }
 
+        case 'w': {
+            bits = atoi(argv[optInd]);
+
+            // out of range widths bring up the usage message
+            if (bits < MIN_BITS || bits > MAX_BITS)
+                help = true;
+            break;
+        }
+
+        case 'T': {
+            threads = atoi(argv[optInd]);
+            workers = threads;
+
+            if (threads < 1)
+                help = true;
+            break;
+        }
+
+        case 'C': {
+            if (!parse_size(argv[optInd], &chunk_size) || chunk_size < MIN_CHUNK
+                || chunk_size > MAX_CHUNK)
+                help = true;
+            else if (threads == 0)
+                threads = 1; // a chunk size alone asks for a chunked file
+            sized = true;
+            break;
+        }
+
+        case 'p': {
+            if (strcmp(argv[optInd], "reset") == 0)
+                policy = LZ_RESET;
+            else if (strcmp(argv[optInd], "freeze") == 0)
+                policy = LZ_FREEZE;
+            else if (strcmp(argv[optInd], "adaptive") == 0)
+                policy = LZ_ADAPTIVE;
+            else if (strcmp(argv[optInd], "lru") == 0)
+                policy = LZ_LRU;
+            else
+                help = true;
+            break;
+        }
+
+        case 'S': {
+            stats = true;
+
+            if (strcmp(optarg, "json") != 0) // the only format for now
+                help = true;
+            break;
+        }
+
+        case 'P': {
+            perf = true;
+            break;
+        }
+
+        case 'L': {
+            piped = true;
+            break;
+        }
+
+        case 'B': {
+            // whole blocks, so that O_DIRECT can take every buffer but the last one
+            if (!parse_size(optarg, &buffer) || buffer < MIN_IO_BUFFER || buffer > MAX_IO_BUFFER
+                || buffer % BLOCK != 0)
+                help = true;
+            break;
+        }
+
+        case 'D': {
+            direct = true;
+            break;
+        }
+
+        case 'l': {
+            lzw = true;
+            break;
+        }
+
+        case 'e': {
+            entropy = true;
+            break;
+        }
+
+        case 'c': {
+            checksum = true;
+            break;
+        }
+
+        case 'f': {
+            force = true;
+            break;
+        }
+
         default: {
             help = true;
             break;
@@ -68,134 +305,199 @@ int main(int argc, char **argv) {
         optInd = optind + 1;
     }
 
+    // LZW codes never recycle a phrase, and leave no symbols to entropy code
+    if (lzw && (policy == LZ_LRU || entropy))
+        help = true;
+
+    // only chunks are entropy coded or checksummed, so either asks for a chunked file like a chunk
+    // size does
+    if ((entropy || checksum) && threads == 0)
+        threads = 1;
+
+    // many inputs are compressed side by side, next to themselves or into an archive at -o, each
+    // one chunked only if the options ask for chunks; reading and writing are already overlapped
+    // across files, so there is nothing for a pipeline to add
+    bool batch = inputs.count > 1 || listed;
+    if (batch) {
+        threads = sized || entropy || checksum ? 1 : 0;
+        if (workers == 0)
+            workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (piped || workers < 1)
+            help = true;
+    }
+
     // usage message
     if (help == true) {
         printf("SYNOPSIS:\n   Compresses files using the LZ78 compression algorithm.\n   "
                "Compressed files are decompressed with the corresponding decoder.\n\nUSAGE\n   "
-               "./encode [-vh] [-i input] [-o output]\n\nOPTIONS\n  -h\t\t\tDisplay program help "
-               "and usage.\n  -v\t\t\tDisplay compression statistics.\n  -i input\t\tSpecify input "
-               "to compress (stdin by default)\n  -o output\t\tSpecify output of compressed input "
-               "(stdout by default)\n");
-        return 0;
+               "./encode [-vh] [-i input]... [-I list] [-o output] [-w bits] [-T threads] "
+               "[-C size] [-p policy] [-l] [-e] [-c] [-f] [--stats=json] [--perf] [--pipeline] "
+               "[--buffer size] [--direct]\n\nOPTIONS\n  -h\t\t\tDisplay program help and usage."
+               "\n  -v\t\t\tDisplay compression statistics.\n  -i input\t\tSpecify input to "
+               "compress (stdin by default), repeat for a batch\n  -I list\t\tCompress every file "
+               "named in list, one per line, as a batch\n  -o output\t\tSpecify output of "
+               "compressed input (stdout by default), an archive of every input for a batch "
+               "(input.lz each by default)\n  -w bits\t\tMaximum code width, 12 to 24 (16 by "
+               "default)\n  -T threads\t\tCompress independent chunks on this many threads, or "
+               "this many files of a batch at once (all CPUs by default)\n  -C size\t\tChunk size "
+               "for -T, with optional K, M or G suffix (4M by default)\n  -p policy\t\tOnce the "
+               "dictionary is full: reset, freeze, adaptive or lru (reset by default)\n  "
+               "-l\t\t\tLZW coding: codes without symbols, not with -p lru\n  -e\t\t\tEntropy code "
+               "the symbols of each chunk, not with -l\n  -c\t\t\tFollow each chunk with a CRC32C "
+               "of its contents\n  -f\t\t\tOverwrite outputs of a batch, the archive included, "
+               "that exist already\n  --stats=json\t\tPrint counters as JSON on stderr, in detail "
+               "if built with STATS=1\n  --perf\t\t\tPrint hardware performance counters per MB on "
+               "stderr\n  --pipeline\t\tRead and write on threads of their own, overlapping with "
+               "compression\n  --buffer size\t\tRead and write size bytes at a time, 64K to 16M in "
+               "4K steps (256K, 1M with --pipeline)\n  --direct\t\tRead and write with O_DIRECT, "
+               "bypassing the page cache where the file system allows it\n");
+        goto done;
     }
 
     // file containing message
-    int infileFD = 0; // defaults to stdin file descriptor
+    int infileFD = batch ? -1 : 0; // defaults to stdin file descriptor, none for a batch
 
     // if input file provided, use that instead of stdin
-    if (input_file != NULL) {
+    if (input_file != NULL && !batch) {
         infileFD = open(input_file, O_RDONLY, 0664); // open to read
 
         // if file doesn't exist in directory
         if (infileFD == -1) {
             printf("%s: No such file or directory\n", input_file);
-            return 0;
+            goto done;
         }
     }
 
     // file that will contain compressed file
-    int outfileFD = 1; // defaults to stdout file descriptor
+    int outfileFD = batch ? -1 : 1; // defaults to stdout file descriptor, none for a batch
 
     // if output file provided, use that instead of stdout
-    if (output_file != NULL) {
+    if (output_file != NULL && !batch) {
         outfileFD = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0666); // open to write
 
         // if file doesn't exist in directory
         if (outfileFD == -1) {
             printf("%s: No such file or directory\n", output_file);
-            return 0;
+            goto done;
         }
     }
 
-    struct stat header_stats;
+    // where O_DIRECT is refused, the page cache is used as usual
+    if (direct && !batch) {
+        set_direct(infileFD);
+        set_direct(outfileFD);
+    }
 
-    fstat(outfileFD, &header_stats);
+    if (buffer == 0)
+        buffer = piped ? PIPE_BUFFER : IO_BUFFER;
 
-    FileHeader *head = (FileHeader *) calloc(1, sizeof(FileHeader));
-    head->magic = MAGIC;
-    head->protection = header_stats.st_mode;
+    struct stat header_stats;
 
-    write_header(outfileFD, head);
-    free(head);
+    fstat(outfileFD, &header_stats);
 
-    TrieNode *root = trie_create(); // create trie with root trie code equal to EMPTY_CODE
-    TrieNode *curr_node = root;
-    TrieNode *prev_node = NULL;
-    TrieNode *next_node = NULL;
+    // a batch creates its outputs later, with the mode the umask leaves
+    if (batch) {
+        mode_t mask = umask(0);
+        umask(mask);
+        header_stats.st_mode = S_IFREG | (0666 & ~mask);
+    }
 
-    uint16_t next_code = START_CODE;
-    uint8_t curr_sym = 0;
-    uint8_t prev_sym = 0;
-    uint8_t bitLen = 0; // bit length for next code
+    lz_options options = { bits, threads, (uint32_t) chunk_size, header_stats.st_mode, policy,
+        lzw, entropy, checksum };
+    // hardware counters, started before the stream so that its worker threads are counted too
+    counters = perf ? perf_start() : NULL;
+    if (perf && counters == NULL)
+        fprintf(stderr, "--perf: No hardware performance counters available\n");
+
+    lz_status status = LZ_MEM_ERROR;
+    int failed = 0; // inputs of a batch that could not be compressed, each reported on stderr
+    lz_stats counts;
+    memset(&counts, 0, sizeof(lz_stats));
+
+    if (batch)
+        failed = batch_compress(
+            &inputs, output_file, &options, workers, buffer, direct, force, &counts);
+    else if ((stream = lz_compress_create(&options)) != NULL)
+        status = piped ? compress_piped(stream, infileFD, outfileFD, buffer)
+                       : compress_file(stream, infileFD, outfileFD, buffer, direct);
+
+    // a batch reports every input that failed by itself, and why it could not start if it did not
+    if (failed < 0) {
+        ret = 1;
+        goto done;
+    } else if (batch) {
+        status = LZ_STREAM_END;
+    }
 
-    // while there are more symbols to read
-    while (read_sym(infileFD, &curr_sym)) {
-        next_node = trie_step(curr_node, curr_sym);
+    switch (status) {
+    case LZ_STREAM_END: {
+        break;
+    }
 
-        // if next_node exists, increment
-        if (next_node != NULL) {
-            prev_node = curr_node;
-            curr_node = next_node;
-        }
-        // once all syms are in trie
-        else {
-            if (next_code >= 1)
-                bitLen = log2(next_code) + 1;
-            else
-                bitLen = 1;
+    case LZ_MEM_ERROR: {
+        fprintf(stderr, "Not enough memory for %d threads\n",
+            batch ? workers : threads > 0 ? threads : 1);
+        ret = 1;
+        goto done;
+    }
 
-            write_pair(outfileFD, curr_node->code, curr_sym, bitLen); // write pair to outfile
-            curr_node->children[curr_sym] = trie_node_create(next_code);
-            curr_node = root;
-            next_code++;
-        }
+    case LZ_IO_ERROR: {
+        fprintf(stderr, "I/O error: %s\n", strerror(errno));
+        ret = 1;
+        goto done;
+    }
 
-        if (next_code == MAX_CODE) {
-            trie_reset(root);
-            curr_node = root;
-            next_code = START_CODE;
-        }
-        prev_sym = curr_sym;
+    case LZ_PARAM_ERROR: {
+        fprintf(stderr, "Invalid compression options\n");
+        ret = 1;
+        goto done;
     }
 
-    if (curr_node != root) {
-        if (next_code >= 1)
-            bitLen = log2(next_code) + 1;
-        else
-            bitLen = 1;
-        write_pair(outfileFD, prev_node->code, prev_sym, bitLen);
-        next_code = (next_code + 1) % MAX_CODE;
+    default: {
+        fprintf(stderr, "Compression failed with status %d\n", status);
+        ret = 1;
+        goto done;
+    }
     }
 
-    if (next_code >= 1)
-        bitLen = log2(next_code) + 1;
-    else
-        bitLen = 1;
+    if (stream != NULL)
+        lz_get_stats(stream, &counts);
 
-    write_pair(outfileFD, STOP_CODE, 0, bitLen);
-    flush_pairs(outfileFD);
+    if (counters != NULL)
+        perf_stop(counters);
 
     close(infileFD);
     close(outfileFD);
 
     // verbose statistics for compression
     if (verbose) {
-        uint64_t compressed_file_size = 0;
-
-        if (total_bits % 8 == 0)
-            compressed_file_size = ((total_bits / 8) + 8);
-        else
-            compressed_file_size = ((total_bits / 8) + 9);
+        uint64_t compressed_file_size = counts.total_out;
+        uint64_t uncompressed_file_size = counts.total_in;
 
-        double space_saving = (double) compressed_file_size / total_syms;
+        double space_saving = (double) compressed_file_size / uncompressed_file_size;
         space_saving = 1 - space_saving;
         space_saving *= 100;
 
         printf("Compressed file size: %" PRIu64 " bytes\n", compressed_file_size);
-        printf("Uncompressed file size: %" PRIu64 " bytes\n", total_syms);
+        printf("Uncompressed file size: %" PRIu64 " bytes\n", uncompressed_file_size);
         printf("Compression ratio: %.2f%%\n", space_saving);
     }
 
-    trie_delete(root); // free memory by deleting root
-    return 0;
+    // counters for monitoring, on stderr since stdout may be the output
+    if (stats)
+        print_stats(stderr, "compress", &counts, wall_clock() - start);
+
+    // hardware counters per MB of uncompressed data
+    if (counters != NULL)
+        perf_print(counters, stderr, counts.total_in);
+
+    ret = failed > 0;
+
+done:
+    if (counters != NULL)
+        perf_delete(counters);
+    if (stream != NULL)
+        lz_stream_delete(stream);
+    batch_list_free(&inputs);
+    return ret;
 }
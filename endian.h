@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 static inline bool big_endian(void) {
     uint16_t word = 0x0001;
@@ -43,4 +44,46 @@ static inline uint64_t swap64(uint64_t x) {
     return result;
 }
 
+// Store x at p as 2 little-endian bytes. p need not be aligned.
+static inline void store_le16(uint8_t *p, uint16_t x) {
+    if (big_endian())
+        x = swap16(x);
+    memcpy(p, &x, sizeof(x));
+}
+
+// Load 2 little-endian bytes from p. p need not be aligned.
+static inline uint16_t load_le16(const uint8_t *p) {
+    uint16_t x;
+    memcpy(&x, p, sizeof(x));
+    return big_endian() ? swap16(x) : x;
+}
+
+// Store x at p as 4 little-endian bytes. p need not be aligned.
+static inline void store_le32(uint8_t *p, uint32_t x) {
+    if (big_endian())
+        x = swap32(x);
+    memcpy(p, &x, sizeof(x));
+}
+
+// Load 4 little-endian bytes from p. p need not be aligned.
+static inline uint32_t load_le32(const uint8_t *p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return big_endian() ? swap32(x) : x;
+}
+
+// Store x at p as 8 little-endian bytes. p need not be aligned.
+static inline void store_le64(uint8_t *p, uint64_t x) {
+    if (big_endian())
+        x = swap64(x);
+    memcpy(p, &x, sizeof(x));
+}
+
+// Load 8 little-endian bytes from p. p need not be aligned.
+static inline uint64_t load_le64(const uint8_t *p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return big_endian() ? swap64(x) : x;
+}
+
 #endif
@@ -1,18 +1,19 @@
+#define _GNU_SOURCE // O_DIRECT
 #include "io.h"
 #include "code.h"
 #include "endian.h"
-#include <stdio.h>
+#include "policy.h"
+#include "stats.h"
+#include <errno.h>
 #include <unistd.h>
-#include <assert.h>
-#include <math.h>
+#include <string.h>
 
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 
-uint8_t symBuffer[BLOCK], pairBuffer[BLOCK];
-uint16_t symIndex, symIndexSize, pairIndex, pairSize;
-uint64_t total_syms, total_bits;
+#define INDEX_READ_MAX (1 << 30) // Most bytes of the index read at once, well within an int.
 
 // Reads infile to buffer
 int read_bytes(int infile, uint8_t *buf, int to_read) {
@@ -20,17 +21,24 @@ int read_bytes(int infile, uint8_t *buf, int to_read) {
     ssize_t bytesRead, totalBytesRead;
     bytesRead = 0;
     totalBytesRead = 0;
+    uint64_t start = stat_clock();
 
     do {
-        bytesRead = read(infile, buf, to_read);
+        bytesRead = read(infile, buf + totalBytesRead, to_read); // pipes return short reads
+        STAT_ADD(io_counters.reads, 1);
 
-        if (bytesRead == 0) // no more bytes to read
+        if (bytesRead < 0 && errno == EINVAL && clear_direct(infile)) // not whole blocks
+            continue;
+
+        if (bytesRead <= 0) // no more bytes to read, or an error
             break;
         totalBytesRead += bytesRead;
         to_read -= bytesRead;
     } while (to_read != 0);
 
-    return (int) totalBytesRead;
+    STAT_ADD(io_counters.bytes_read, totalBytesRead);
+    STAT_ADD(io_counters.ns, stat_clock() - start);
+    return bytesRead < 0 ? -1 : (int) totalBytesRead;
 }
 
 // Writes buffer to outfile
@@ -39,486 +47,285 @@ int write_bytes(int outfile, uint8_t *buf, int to_write) {
     ssize_t bytesWritten, totalBytesWritten;
     bytesWritten = 0;
     totalBytesWritten = 0;
+    uint64_t start = stat_clock();
 
     do {
-        bytesWritten = write(outfile, buf, to_write);
+        bytesWritten = write(outfile, buf + totalBytesWritten, to_write);
+        STAT_ADD(io_counters.writes, 1);
+
+        if (bytesWritten < 0 && errno == EINVAL && clear_direct(outfile)) // such as the tail
+            continue;
 
-        if (bytesWritten == 0) // no more bytes to write
+        if (bytesWritten <= 0) // no more bytes to write, or an error
             break;
 
         totalBytesWritten += bytesWritten;
         to_write -= bytesWritten;
     } while (to_write != 0);
 
-    return (int) (totalBytesWritten);
+    STAT_ADD(io_counters.bytes_written, totalBytesWritten);
+    STAT_ADD(io_counters.ns, stat_clock() - start);
+    return bytesWritten < 0 ? -1 : (int) (totalBytesWritten);
 }
 
-// Reads header file from buffer
-void read_header(int infile, FileHeader *header) {
-    uint8_t *buffer = (uint8_t *) header; // create a pointer of type uint8_t that points to header
-    read_bytes(infile, buffer, sizeof(FileHeader)); // read bytes into header
+// Allocates an I/O buffer aligned for O_DIRECT
+uint8_t *alloc_buffer(size_t size) {
+    void *buf;
+    return posix_memalign(&buf, BLOCK, size) == 0 ? (uint8_t *) buf : NULL;
+}
 
-    // make sure endianness of fields match
-    if (big_endian()) {
-        header->magic = swap32(header->magic);
-        header->protection = swap16(header->protection);
-    }
+// Sets O_DIRECT, which the kernel refuses for file systems without it such as tmpfs
+bool set_direct(int fd) {
+    struct stat st;
+    int flags = fcntl(fd, F_GETFL);
 
-    assert(header->magic == MAGIC); // make sure header magic number is equal to magic
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && flags != -1
+           && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
 }
 
-// Writes header file from buffer
-void write_header(int outfile, FileHeader *header) {
+// Clears O_DIRECT
+bool clear_direct(int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && (flags & O_DIRECT) && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
+// Swaps header fields between host and file byte order
+void swap_header(FileHeader *header) {
     // make sure endianness of fields match
     if (big_endian()) {
         header->magic = swap32(header->magic);
         header->protection = swap16(header->protection);
     }
+}
 
-    uint8_t *buffer = (uint8_t *) header; // create a pointer of type uint8_t that points to header
-    write_bytes(outfile, buffer, sizeof(FileHeader)); // write bytes into fileheader
+// Checks a header that was just read
+bool check_header(FileHeader *header) {
+    if (header->bits == 0) // written before the code width was recorded
+        header->bits = DEFAULT_BITS;
+
+    // flags this version does not know were set by a newer encoder, LZW never recycles codes and
+    // has no symbols to entropy code, and only chunks are entropy coded or checksummed
+    uint8_t flags = header->flags;
+    return header->magic == MAGIC && header->bits >= MIN_BITS && header->bits <= MAX_BITS
+           && (flags & ~KNOWN_FLAGS) == 0
+           && !((flags & FLAG_LZW) && HEADER_POLICY(header) == POLICY_LRU)
+           && !((flags & FLAG_ENTROPY) && ((flags & FLAG_LZW) || !(flags & FLAG_CHUNKED)))
+           && !((flags & FLAG_CHECKSUM) && !(flags & FLAG_CHUNKED));
 }
 
-// Read one symbol from buffer, refill buffer if full
-bool read_sym(int infile, uint8_t *sym) {
+// Reads header file from buffer
+bool read_header(int infile, FileHeader *header) {
+    uint8_t *buffer = (uint8_t *) header; // create a pointer of type uint8_t that points to header
 
-    // fill up buffer for the first time
-    if (symIndex == 0)
-        symIndexSize = read_bytes(infile, symBuffer, BLOCK);
+    if (read_bytes(infile, buffer, sizeof(FileHeader)) != sizeof(FileHeader))
+        return false;
 
-    // if the buffer position is at the end, refill buffer
-    if (symIndex == symIndexSize) {
+    swap_header(header);
+    return check_header(header);
+}
 
-        // clear the buffer by setting values to null or 0
-        for (int i = 0; i < symIndexSize; i++)
-            symBuffer[i] = 0;
+// Writes header file from buffer
+void write_header(int outfile, FileHeader *header) {
+    swap_header(header);
 
-        symIndexSize = read_bytes(infile, symBuffer, BLOCK);
-        symIndex = 0;
-    }
+    uint8_t *buffer = (uint8_t *) header; // create a pointer of type uint8_t that points to header
+    write_bytes(outfile, buffer, sizeof(FileHeader)); // write bytes into fileheader
+}
 
-    if (symIndexSize == 0) // if we reached EOF, return false
+// Reads chunk header from infile
+bool read_chunk_header(int infile, ChunkHeader *chunk) {
+    if (read_bytes(infile, (uint8_t *) chunk, sizeof(ChunkHeader)) != sizeof(ChunkHeader))
         return false;
 
-    sym[0] = symBuffer[symIndex]; // fill sym
-
-    // increment global fields
-    total_syms++;
-    symIndex++;
-
+    swap_chunk_header(chunk);
     return true;
 }
 
-// Writes LSB to MSB version of byte, considers only index number of indicies
-uint64_t byte_flipper(uint64_t byte, uint8_t index) {
-
-    uint64_t byteArr[index];
-    uint64_t byte_copy = byte;
-
-    // shift bit values LSB to MSB and calculate each value
-    for (int i = 0; i < index; i++) {
-        byte_copy = (1 & byte >> (index - 1 - i)); // checks if shifted bit is 1 or 0
-        byteArr[i] = (byte_copy * pow(2, i)); // calculates its value based on reverse position
+// Swaps chunk header fields between host and file byte order
+void swap_chunk_header(ChunkHeader *chunk) {
+    // make sure endianness of fields match
+    if (big_endian()) {
+        chunk->ulen = swap32(chunk->ulen);
+        chunk->clen = swap32(chunk->clen);
     }
-
-    // add all the bit values
-    uint64_t flippedByteValue = 0;
-    for (int i = 0; i < index; i++)
-        flippedByteValue += byteArr[i];
-
-    return flippedByteValue;
 }
 
-// Converts decimal value of byte to binary, puts binary values into uint8_t array passed
-void decimalToBinary(uint8_t *binaryArr, uint64_t num, int bitlen) {
+// Parses a byte count with an optional K, M or G suffix
+bool parse_size(const char *arg, uint64_t *size) {
+    char *end;
 
-    uint8_t index = 0;
-    uint64_t num_copy = byte_flipper(num, bitlen); // flip bytes first to read from LSB to MSB
+    if (*arg < '0' || *arg > '9') // strtoull would accept signs and spaces
+        return false;
 
-    // loop will read shifted MSB (rightmost) bit and add to binary array
-    while (num_copy > 0) {
-        if (num_copy & 1)
-            binaryArr[index] = 1;
-        else
-            binaryArr[index] = 0;
+    *size = strtoull(arg, &end, 10);
 
-        num_copy >>= 1;
-        index++;
+    switch (*end) {
+    case 'K': {
+        *size <<= 10;
+        end++;
+        break;
     }
-}
 
-// Takes bits starting from start to end index of byte, place its result in binaryArr
-void bitExtractor(uint8_t *binaryArr, uint8_t byte, uint8_t start, uint8_t end) {
-    uint8_t byteArr[8];
+    case 'M': {
+        *size <<= 20;
+        end++;
+        break;
+    }
 
-    // initialize all values of array to 0
-    for (int i = 0; i < 8; i++)
-        byteArr[i] = 0;
+    case 'G': {
+        *size <<= 30;
+        end++;
+        break;
+    }
 
-    decimalToBinary(byteArr, byte, 8);
+    default: {
+        break;
+    }
+    }
 
-    // store select bits in resultant array
-    for (int i = 0; i < (end - start + 1); i++)
-        binaryArr[i] = byteArr[i + start];
+    return *end == '\0';
 }
 
-// Writes (code, symbol) pair to outfile
-void write_pair(int outfile, uint16_t code, uint8_t sym, int bitlen) {
-
-    uint8_t indexPos = (total_bits % 8); // index position in a byte (0-7)
-    uint8_t flipCodeArr[bitlen]; // array for flipped bits of code
-
-    // make sure all values are initalized to 0
-    for (int i = 0; i < bitlen; i++)
-        flipCodeArr[i] = 0;
-
-    decimalToBinary(flipCodeArr, byte_flipper(code, bitlen),
-        bitlen); // create binary array of flipped value for code
-
-    uint8_t previousByteArr[8];
-
-    // initalize all array values to 0
-    for (int i = 0; i < 8; i++)
-        previousByteArr[i] = 0;
-
-    decimalToBinary(previousByteArr, byte_flipper(pairBuffer[pairIndex], 8), 8);
-
-    uint8_t flipSymArr[8]; // array for flipped bits of sym
-
-    // initalize all array values to 0
-    for (int i = 0; i < 8; i++)
-        flipSymArr[i] = 0;
-
-    sym = byte_flipper(sym, 8);
-    decimalToBinary(flipSymArr, sym, 8);
-
-    uint8_t bufferPairSize = bitlen + 8;
-    uint8_t pairArr[bufferPairSize];
-
-    // make sure all values are initalized to 0
-    for (int i = 0; i < bufferPairSize; i++)
-        pairArr[i] = 0;
-
-    // fill pair array with code array first
-    for (int i = 0; i < bitlen; i++)
-        pairArr[i] = flipCodeArr[i];
-
-    // fill pair array with symbol array next
-    for (int i = bitlen; i < bufferPairSize; i++)
-        pairArr[i] = flipSymArr[i - bitlen];
-
-    uint8_t currentBytePair = 0;
-    uint8_t indexRemainder = (8 - indexPos); // how many times you shift bits right
-
-    // calculate value of bits going into current Byte
-    for (int i = 0; i < indexRemainder; i++)
-        currentBytePair += pow(2, 7 - indexPos - i) * pairArr[i];
-
-    // flip current byte
-    uint8_t remainingBits = (bufferPairSize - indexRemainder);
-
-    // how many full bytes we can write to
-    uint8_t loopCalls = 0;
-    if (remainingBits % 8 != 0)
-        loopCalls = (remainingBits / 8) + 1;
-    else
-        loopCalls = (remainingBits / 8);
-
-    loopCalls -= 1;
-
-    uint8_t currentByte = byte_flipper(pairBuffer[pairIndex], 8);
-    uint8_t finalByteValue = currentByte + currentBytePair;
-
-    // flip the combined byte and put it in buffer
-    pairBuffer[pairIndex] = byte_flipper(finalByteValue, 8);
-    pairIndex++;
-
-    // check if out of bounds
-    if (pairIndex == BLOCK)
-        flush_pairs(outfile);
-
-    // write to buffer loopCalls number of full bytes
-    for (int k = 0; k < loopCalls; k++) {
-        uint8_t nextByte = 0;
-
-        // calculate value of next byte
-        for (int i = 0; i < 8; i++)
-            nextByte += pow(2, (7 - i)) * pairArr[i + indexRemainder];
-
-        pairBuffer[pairIndex] = byte_flipper(nextByte, 8);
-
-        uint8_t nextByteArr[8];
-
-        // initalize all array values to 0
-        for (int i = 0; i < 8; i++)
-            nextByteArr[i] = 0;
-
-        decimalToBinary(nextByteArr, finalByteValue, 8);
-
-        remainingBits -= 8;
-        pairIndex++;
-
-        // check if out of bounds
-        if (pairIndex == BLOCK)
-            flush_pairs(outfile);
-
-        indexRemainder += 8;
+// Swaps index entries between host and file byte order
+void swap_index(IndexEntry *entries, uint64_t count) {
+    // make sure endianness of fields match
+    if (big_endian()) {
+        for (uint64_t i = 0; i < count; i++) {
+            entries[i].uoff = swap64(entries[i].uoff);
+            entries[i].coff = swap64(entries[i].coff);
+        }
     }
+}
 
-    uint8_t nextByte = 0;
-
-    // calculate remaining bits for next byte
-    for (int i = 0; i < remainingBits; i++)
-        nextByte += pow(2, (7 - i)) * pairArr[i + indexRemainder];
-
-    pairBuffer[pairIndex] = byte_flipper(nextByte, 8); // flip byte back to LSB to MSB
-    total_bits += bufferPairSize;
-
-    if (remainingBits == 8) {
-        pairIndex++;
-
-        if (pairIndex == BLOCK)
-            flush_pairs(outfile);
+// Swaps index footer fields between host and file byte order
+void swap_footer(IndexFooter *footer) {
+    // make sure endianness of fields match
+    if (big_endian()) {
+        footer->count = swap64(footer->count);
+        footer->total = swap64(footer->total);
+        footer->magic = swap32(footer->magic);
     }
 }
 
-// Writes out any remaining pairs in buffer to outfile
-void flush_pairs(int outfile) {
-    if (pairIndex == BLOCK)
-        write_bytes(outfile, pairBuffer, pairIndex); // write file buffer to outfile
-    else
-        write_bytes(outfile, pairBuffer, pairIndex + 1); // add stop code
-
-    // reset the buffer
-    for (int i = 0; i < BLOCK; i++)
-        pairBuffer[i] = 0;
-
-    pairIndex = 0;
+// Swaps member header fields between host and file byte order
+void swap_member(MemberHeader *member) {
+    // make sure endianness of fields match
+    if (big_endian()) {
+        member->magic = swap32(member->magic);
+        member->name_len = swap16(member->name_len);
+        member->size = swap64(member->size);
+    }
 }
 
-// Reads (code, symbol) pair to infile
-bool read_pair(int infile, uint16_t *code, uint8_t *sym, int bitlen) {
-    // fill up buffer for the first time
-    if (pairIndex == 0 && total_bits == 0)
-        pairSize = read_bytes(infile, pairBuffer, BLOCK);
+// Checks that the entries describe chunks in file order ahead of the index at offset start, each
+// starting where the one before it ended with between 1 and MAX_CHUNK symbols, so that every
+// offset below total falls in exactly one of them
+static bool check_index(const IndexEntry *entries, uint64_t count, uint64_t total, uint64_t start) {
+    if (count == 0)
+        return total == 0;
 
-    if (pairSize == 0) // if there is nothing in file, return false
+    if (entries[0].uoff != 0)
         return false;
 
-    uint8_t indexPos = (total_bits % 8); // index position in a byte
-    uint8_t bitlen_copy = bitlen;
-    uint8_t firstByteSize = 0;
-
-    // calculate how much of current byte to calculate
-    if ((8 - indexPos) < bitlen)
-        firstByteSize = 8 - indexPos;
-    else
-        firstByteSize = bitlen_copy;
-
-    uint8_t codeArrBinary[bitlen];
-    uint8_t codeFirstByte[8];
-
-    // initalize all array values to 0
-    for (int i = 0; i < 8; i++)
-        codeFirstByte[i] = 0;
-
-    bitExtractor(
-        codeFirstByte, byte_flipper(pairBuffer[pairIndex], 8), indexPos, 7); // extract first byte
+    uint64_t coff = sizeof(FileHeader); // earliest place left for the next ChunkHeader
 
-    if (bitlen_copy >= 8 || (indexPos + firstByteSize) >= 8) {
-        pairIndex++;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t end = i + 1 < count ? entries[i + 1].uoff : total;
 
-        if (pairIndex == BLOCK) {
-
-            for (int i = 0; i < BLOCK; i++)
-                pairBuffer[i] = 0;
-
-            pairSize = read_bytes(infile, pairBuffer, BLOCK);
-            pairIndex = 0;
+        if (end <= entries[i].uoff || end - entries[i].uoff > MAX_CHUNK || entries[i].coff < coff
+            || entries[i].coff > start - sizeof(ChunkHeader))
+            return false;
 
-            if (pairSize == 0) // if we reached EOF, return false
-                return false;
-        }
+        coff = entries[i].coff + sizeof(ChunkHeader);
     }
 
-    total_bits += firstByteSize;
-    indexPos = (total_bits % 8);
-    bitlen -= firstByteSize;
-
-    // initalize all array values to 0
-    for (int i = 0; i < firstByteSize; i++)
-        codeArrBinary[i] = codeFirstByte[i];
-
-    // if there are more code bits to be extracted in other bytes, extract them
-    while (bitlen > 0) {
-        // if there is at least another full byte that contains bits for code
-        if (bitlen >= 8) {
-            uint8_t codeNextByte[8];
-
-            // initalize all array values to 0
-            for (int i = 0; i < 8; i++)
-                codeNextByte[i] = 0;
-
-            decimalToBinary(codeNextByte, byte_flipper(pairBuffer[pairIndex], 8), 8);
-
-            for (int i = 0; i < 8; i++)
-                codeArrBinary[i + firstByteSize] = codeNextByte[i];
-
-            total_bits += 8;
-            indexPos = (total_bits % 8);
-
-            pairIndex++;
-
-            if (pairIndex == BLOCK) {
-                for (int i = 0; i < pairSize; i++)
-                    pairBuffer[i] = 0;
-
-                pairSize = read_bytes(infile, pairBuffer, BLOCK);
-                pairIndex = 0;
-
-                if (pairSize == 0) // if we reached EOF, return false
-                    return false;
-            }
-
-            bitlen -= 8;
-            firstByteSize += 8;
-        }
+    return true;
+}
 
-        // if there is a last byte that contains partial bits for code
-        else if (bitlen < 8) {
-            uint8_t lastByteArr[bitlen];
+// Reads chunk index from the end of infile
+IndexEntry *read_index(int infile, uint64_t *count, uint64_t *total) {
+    IndexFooter footer;
+    off_t end = lseek(infile, 0, SEEK_END);
 
-            // initalize all array values to 0
-            for (int i = 0; i < bitlen; i++)
-                lastByteArr[i] = 0;
+    if (end < (off_t) (sizeof(FileHeader) + sizeof(IndexFooter))) // also fails on pipes
+        return NULL;
 
-            bitExtractor(lastByteArr, byte_flipper(pairBuffer[pairIndex], 8), 0, bitlen);
+    lseek(infile, end - sizeof(IndexFooter), SEEK_SET);
+    if (read_bytes(infile, (uint8_t *) &footer, sizeof(IndexFooter)) != sizeof(IndexFooter))
+        return NULL;
 
-            // add last byte to total code array
-            for (int i = 0; i < bitlen; i++)
-                codeArrBinary[i + firstByteSize] = lastByteArr[i];
+    swap_footer(&footer);
 
-            if (bitlen + indexPos >= 8)
-                pairIndex++;
+    // the index has to fit between the file header and the footer
+    uint64_t room = end - sizeof(FileHeader) - sizeof(IndexFooter);
+    if (footer.magic != INDEX_MAGIC || footer.count > room / sizeof(IndexEntry))
+        return NULL;
 
-            if (pairIndex == BLOCK) {
-                for (int i = 0; i < pairSize; i++)
-                    pairBuffer[i] = 0;
-                pairSize = read_bytes(infile, pairBuffer, BLOCK);
-                pairIndex = 0;
+    size_t size = footer.count * sizeof(IndexEntry);
+    IndexEntry *entries = (IndexEntry *) malloc(size ? size : 1);
+    bool ok = entries != NULL;
 
-                if (pairSize == 0) // if we reached EOF, return false
-                    return false;
-            }
+    // read_bytes counts in an int, and an index of 4K chunks passes 2GB at 512GB of data
+    lseek(infile, end - sizeof(IndexFooter) - size, SEEK_SET);
+    for (size_t done = 0; ok && done < size;) {
+        int part = size - done < INDEX_READ_MAX ? (int) (size - done) : INDEX_READ_MAX;
 
-            total_bits += bitlen;
-            indexPos = (total_bits % 8);
-            bitlen = 0;
-        }
+        ok = read_bytes(infile, (uint8_t *) entries + done, part) == part;
+        done += part;
     }
 
-    uint16_t codeVal = 0;
-
-    // convert binary value of code to decimal
-    for (int i = 0; i < bitlen_copy; i++)
-        codeVal += codeArrBinary[i] * pow(2, bitlen_copy - i - 1);
-
-    codeVal = byte_flipper(codeVal, bitlen_copy);
-
-    // if the code is STOP_CODE, return false
-    if (codeVal == STOP_CODE)
-        return false;
-
-    // store code value into code pointer
-    *code = codeVal;
-
-    uint8_t symArrBinary[8];
-
-    // initalize all array values to 0
-    for (int i = 0; i < 8; i++)
-        symArrBinary[i] = 0;
-
-    firstByteSize = 8 - indexPos;
-    uint8_t symFirstByte[firstByteSize];
-
-    // initalize all array values to 0
-    for (int i = 0; i < 8; i++)
-        symFirstByte[i] = 0;
-
-    bitExtractor(
-        symFirstByte, byte_flipper(pairBuffer[pairIndex], 8), indexPos, 7); // extract first byte
-
-    // update variable counters
-    total_bits += firstByteSize;
-    indexPos = (total_bits % 8);
-    pairIndex++;
-
-    if (pairIndex == BLOCK) {
-        for (int i = 0; i < pairSize; i++)
-            pairBuffer[i] = 0;
-        pairSize = read_bytes(infile, pairBuffer, BLOCK);
-        pairIndex = 0;
-
-        if (pairSize == 0)
-            return false;
+    if (!ok) {
+        free(entries);
+        return NULL;
     }
 
-    // add first byte to total sym array
-    for (int i = 0; i < firstByteSize; i++)
-        symArrBinary[i] = symFirstByte[i];
-
-    // if there are more sym bits in the next byte, extract it
-    if (firstByteSize < 8) {
-        uint8_t secondByteSize = 8 - firstByteSize;
-        uint8_t symSecondByte[secondByteSize];
+    swap_index(entries, footer.count);
 
-        // initalize all array values to 0
-        for (int i = 0; i < secondByteSize; i++)
-            symSecondByte[i] = 0;
-
-        bitExtractor(symSecondByte, byte_flipper(pairBuffer[pairIndex], 8), 0, secondByteSize);
+    if (!check_index(entries, footer.count, footer.total, end - sizeof(IndexFooter) - size)) {
+        free(entries);
+        return NULL;
+    }
 
-        // add second byte to total sym array
-        for (int i = 0; i < secondByteSize; i++)
-            symArrBinary[i + firstByteSize] = symSecondByte[i];
+    *count = footer.count;
+    *total = footer.total;
+    return entries;
+}
 
-        total_bits += secondByteSize;
-        indexPos = (total_bits % 8);
-    }
+// Maps the rest of infile into memory
+bool map_input(int infile, InputMap *map) {
+    struct stat stats;
+    off_t offset = lseek(infile, 0, SEEK_CUR);
 
-    uint8_t symVal = 0;
+    // pipes and terminals cannot be mapped, and neither can an empty remainder
+    if (offset < 0 || fstat(infile, &stats) != 0 || !S_ISREG(stats.st_mode)
+        || stats.st_size <= offset)
+        return false;
 
-    // calculate final sym value
-    for (int i = 0; i < 8; i++)
-        symVal += symArrBinary[i] * pow(2, i);
+    uint64_t start = stat_clock();
+    void *base = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE, infile, 0);
+    STAT_ADD(io_counters.maps, 1);
+    STAT_ADD(io_counters.ns, stat_clock() - start);
 
-    *sym = symVal;
+    if (base == MAP_FAILED)
+        return false;
 
+    // only hints: read ahead aggressively, and use huge pages if the filesystem can
+    madvise(base, stats.st_size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(base, stats.st_size, MADV_HUGEPAGE);
+#endif
+
+    map->base = base;
+    map->length = stats.st_size;
+    map->data = (const uint8_t *) base + offset; // mappings start on a page, the header does not
+    map->size = stats.st_size - offset;
+    STAT_ADD(io_counters.bytes_read, map->size);
     return true;
 }
 
-// Writes word's symbol to outfile
-void write_word(int outfile, Word *w) {
-    // if this word's syms won't fit in this buffer, write to outfile and empty the buffer
-    if ((w->len + symIndex + 1) > BLOCK)
-        flush_words(outfile);
-
-    // write word's syms to buffer
-    for (uint32_t i = 0; i < w->len; i++) {
-        symBuffer[symIndex] = w->syms[i];
-        symIndex++;
-        total_syms++;
-    }
-}
-
-// Writes word's sym to outfile and resets buffer
-void flush_words(int outfile) {
-
-    write_bytes(outfile, symBuffer, symIndex);
-
-    // reset buffer
-    for (int i = 0; i < BLOCK; i++)
-        symBuffer[i] = 0;
-
-    symIndex = 0;
+// Unmaps a mapping made by map_input
+void unmap_input(InputMap *map) {
+    munmap(map->base, map->length);
+    map->base = NULL;
+    map->data = NULL;
 }
@@ -1,21 +1,91 @@
 #ifndef __IO_H__
 #define __IO_H__
 
-#include "word.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#define BLOCK 4096 // 4KB blocks.
+#define BLOCK     4096 // 4KB blocks, also the alignment O_DIRECT asks for.
+#define IO_BUFFER (64 * BLOCK) // Bytes encode and decode read or write at a time by default.
+#define MIN_IO_BUFFER (16 * BLOCK) // Smallest buffer --buffer accepts, 64KB.
+#define MAX_IO_BUFFER (4096 * BLOCK) // Largest buffer --buffer accepts, 16MB.
 #define MAGIC 0xBAADBAAC // Unique encoder/decoder magic number.
 
-extern uint64_t total_syms; // To count the symbols processed.
-extern uint64_t total_bits; // To count the bits processed.
+#define FLAG_CHUNKED  0x01 // Body is a sequence of independently coded chunks.
+#define FLAG_INDEXED  0x02 // Chunked file ends with an index of its chunks.
+#define FLAG_POLICY   0x0C // POLICY_* from policy.h, in these two bits.
+#define FLAG_LZW      0x10 // Codes come without symbols, LZW style, see LITERALS in code.h.
+#define FLAG_ENTROPY  0x20 // Symbols of each chunk are entropy coded, see block.h.
+#define FLAG_CHECKSUM 0x40 // Each chunk ends with a checksum, see ChunkHeader.
+#define POLICY_SHIFT  2
+#define HEADER_POLICY(header) (((header)->flags & FLAG_POLICY) >> POLICY_SHIFT)
+#define KNOWN_FLAGS \
+    (FLAG_CHUNKED | FLAG_INDEXED | FLAG_POLICY | FLAG_LZW | FLAG_ENTROPY | FLAG_CHECKSUM)
+
+#define INDEX_MAGIC 0xBAADB1DC // Marks the footer of a chunk index.
 
 typedef struct FileHeader {
     uint32_t magic;
     uint16_t protection;
+    uint8_t bits; // Maximum code width, 0 in older files meaning DEFAULT_BITS.
+    uint8_t flags; // FLAG_* bits, 0 in older files.
 } FileHeader;
 
+//
+// In a file with FLAG_CHUNKED set, the FileHeader is followed by chunks, each made of a ChunkHeader
+// and clen bytes of pairs that decode to ulen symbols. A ChunkHeader with both lengths 0 ends the
+// file. Like the FileHeader it is stored little-endian.
+//
+// With FLAG_CHECKSUM set, the last CHECKSUM_SIZE bytes counted in clen are the CRC32C of the ulen
+// uncompressed symbols, little-endian, so a chunk that decodes without error to the wrong bytes is
+// caught as well.
+//
+typedef struct ChunkHeader {
+    uint32_t ulen; // Uncompressed length.
+    uint32_t clen; // Compressed length.
+} ChunkHeader;
+
+#define MIN_CHUNK     BLOCK // Smallest chunk size the encoder accepts.
+#define DEFAULT_CHUNK (4 << 20) // 4MB chunks unless asked otherwise.
+#define MAX_CHUNK     (1 << 30) // Largest ulen of a chunk, anything above means a damaged file.
+#define CHECKSUM_SIZE 4 // Bytes of the checksum at the end of a chunk with FLAG_CHECKSUM.
+
+//
+// A chunked file with FLAG_INDEXED set continues after its end marker with an IndexEntry for each
+// chunk, in file order, and ends with an IndexFooter. The index maps the uncompressed offset of
+// every chunk to the file offset of its ChunkHeader, so any byte range can be decompressed by
+// decoding only the chunks that cover it. Like the headers it is stored little-endian.
+//
+typedef struct IndexEntry {
+    uint64_t uoff; // Offset of the first symbol of the chunk in the uncompressed data.
+    uint64_t coff; // Offset of the ChunkHeader of the chunk in the file.
+} IndexEntry;
+
+typedef struct IndexFooter {
+    uint64_t count; // Number of IndexEntry records before the footer.
+    uint64_t total; // Size of the uncompressed data.
+    uint32_t magic; // INDEX_MAGIC.
+    uint32_t reserved;
+} IndexFooter;
+
+#define ARCHIVE_MAGIC 0xBAADA2C7 // Marks each member of an archive.
+
+//
+// An archive written by encode in batch mode is a sequence of members, each made of a MemberHeader,
+// the name_len bytes of its relative path without a terminating NUL, and the size bytes of a whole
+// lz file, one per input in the order they were given. It starts with the magic of its first
+// member, which is how decode tells it from an lz file. Like the other headers it is stored
+// little-endian.
+//
+typedef struct MemberHeader {
+    uint32_t magic; // ARCHIVE_MAGIC.
+    uint16_t name_len; // Bytes of the name, 1 to MAX_MEMBER_NAME.
+    uint16_t reserved;
+    uint64_t size; // Bytes of the lz file.
+} MemberHeader;
+
+#define MAX_MEMBER_NAME 4095 // Longest name of a member, PATH_MAX without the NUL.
+
 //
 // Read up to to_read bytes from infile and store them in buf. Return the number of bytes actually
 // read.
@@ -25,16 +95,42 @@ typedef struct FileHeader {
 // 100 and the first read() call only reads 20 bytes, it should attempt to read 80 bytes the next
 // time it calls read().
 //
+// If infile has O_DIRECT set and refuses a read that is not made of whole aligned blocks, O_DIRECT
+// is cleared and the read is made again through the page cache.
+//
+// Fewer bytes than to_read only means the end of the file was reached. If read() fails instead,
+// return -1 with errno set, whatever was read before, so that an error is never taken for the end.
+//
 int read_bytes(int infile, uint8_t *buf, int to_read);
 
 //
 // Write up to to_write bytes from buf into outfile. Return the number of bytes actually written.
 //
 // Similarly to read_bytes, this function will need to call write() in a loop to ensure that it
-// writes as many bytes as possible.
+// writes as many bytes as possible, and clears O_DIRECT on outfile if it refuses a write, which
+// is how the unaligned tail of a file gets written.
+//
+// If write() fails, return -1 with errno set, such as ENOSPC for a full disk.
 //
 int write_bytes(int outfile, uint8_t *buf, int to_write);
 
+//
+// Allocate a buffer of size bytes aligned to BLOCK, as O_DIRECT needs, to be freed with free().
+// Return NULL if memory ran out.
+//
+uint8_t *alloc_buffer(size_t size);
+
+//
+// Set O_DIRECT on fd, so that reads and writes of whole aligned blocks bypass the page cache.
+// Return false if fd is not a regular file or its file system does not support O_DIRECT.
+//
+bool set_direct(int fd);
+
+//
+// Clear O_DIRECT on fd. Return false if it was not set, or could not be cleared.
+//
+bool clear_direct(int fd);
+
 //
 // Read a file header from infile into *header.
 //
@@ -55,11 +151,19 @@ int write_bytes(int outfile, uint8_t *buf, int to_write);
 // not what we want, so you would have to change the order of those bytes in memory. A little-endian
 // computer will interpret that as 0xBAADBAAC.
 //
-// This function should also make sure the magic number is correct. Since it has no return value you
-// may call assert() to do that, or print out an error message and exit the program, or use some
-// other way to report the error.
+// This function should also make sure the header is valid with check_header, and return false if it
+// is not or if infile ends before a whole header.
+//
+bool read_header(int infile, FileHeader *header);
+
+//
+// Check the magic number, code width and flags of a header that is in host byte order. Return
+// false if it was not written by a compatible encoder.
+//
+// Files written before the code width was recorded have 0 in its place; bits is set to
+// DEFAULT_BITS for them, so callers always get the real width.
 //
-void read_header(int infile, FileHeader *header);
+bool check_header(FileHeader *header);
 
 //
 // Write a file header from *header to outfile. Like above, this function should swap the byte order
@@ -68,74 +172,54 @@ void read_header(int infile, FileHeader *header);
 void write_header(int outfile, FileHeader *header);
 
 //
-// Read one symbol from infile into *sym. Return true if a symbol was successfully read, false
-// otherwise.
+// Read a chunk header from infile into *chunk, swapping its fields on big-endian systems. Return
+// false if the file ends before a whole chunk header.
 //
-// Reading one symbol at a time is slow, so this function will need to maintain a global buffer
-// (an array) of BLOCK bytes. Most calls will only need to read a symbol out of that buffer, and
-// then update some counter so that the function knows what position in the buffer it is at. If
-// there are no more bytes in the buffer for it to return, it will have to call read_bytes to refill
-// the buffer with fresh data. If this call fails then you cannot read a symbol and should return
-// false.
-//
-bool read_sym(int infile, uint8_t *sym);
+bool read_chunk_header(int infile, ChunkHeader *chunk);
 
 //
-// Write a pair -- bitlen bits of code, followed by all 8 bits of sym -- to outfile.
-//
-// This function should also use a buffer. It writes into individual bits in the buffer, starting
-// with the least significant bit of the first byte, until the most significant bit of the first
-// byte, and then the least significant bit of the second byte, and so on. You will need bitwise
-// arithmetic to manipulate individual bits within your buffer -- consult asgn3/set.c if you don't
-// remember how to do this.
-//
-// The first bit of code to be written is the least significant bit, and the same holds for sym.
+// Swap the fields of a header, chunk header, count index entries, index footer or member header in
+// place between host byte order and the little-endian file byte order. These do nothing on
+// little-endian systems, and are used by the library, which builds and parses files in memory.
 //
-// This function will need to track which *bit* in the buffer will be written to next. If it ever
-// reaches the end of the buffer it needs to write out the contents of the buffer to outfile; you
-// may use flush_pairs to do this.
-//
-void write_pair(int outfile, uint16_t code, uint8_t sym, int bitlen);
+void swap_header(FileHeader *header);
+void swap_chunk_header(ChunkHeader *chunk);
+void swap_index(IndexEntry *entries, uint64_t count);
+void swap_footer(IndexFooter *footer);
+void swap_member(MemberHeader *member);
 
 //
-// Write any pairs that are in write_pair's buffer but haven't been written yet to outfile.
-//
-// This function will need to be called at the end of encode since otherwise those pairs would never
-// be written. You don't have to, but it would be easy to make this function also work when called
-// by write_pair, since otherwise you would write essentially the same code in two places.
+// Read the chunk index at the end of infile, which must be seekable. Return the entries in a newly
+// allocated array and store their number in *count and the uncompressed size in *total, or return
+// NULL if infile does not end with a valid index.
 //
-// If not all bits of the last byte in your buffer have been written to, make sure that the
-// unwritten bits are set to zero. An easy way to do this is by zeroing the entire buffer after
-// flushing it every time.
-//
-void flush_pairs(int outfile);
+IndexEntry *read_index(int infile, uint64_t *count, uint64_t *total);
 
 //
-// Read bitlen bits of a code into *code, and then a full 8-bit symbol into *sym, from infile.
-// Return true if the complete pair was read and false otherwise.
+// Parse a byte count such as 4096, 64K, 4M or 1G into *size. Return false if arg is malformed.
 //
-// Like write_pair, this function must read the least significant bit of each input byte first, and
-// will store those bits into the LSB of *code and of *sym first.
+bool parse_size(const char *arg, uint64_t *size);
+
 //
-// It may be useful to write a helper function that reads a single bit from a file using a buffer.
+// A regular file mapped into memory, from the offset it was at when it was mapped to its end.
 //
-bool read_pair(int infile, uint16_t *code, uint8_t *sym, int bitlen);
+typedef struct InputMap {
+    const uint8_t *data; // Input from the mapped offset on.
+    size_t size; // Bytes in data.
+    void *base; // Whole mapping, for unmapping.
+    size_t length;
+} InputMap;
 
 //
-// Write every symbol from w into outfile.
+// Map infile into *map from its current offset on, hinting the kernel that it will be read
+// sequentially. Return false if infile is not a regular file with data left, such as a pipe or
+// stdin, in which case it has to be read with read_bytes as usual.
 //
-// These symbols should also be buffered and the buffer flushed whenever necessary (note you will
-// likely sometimes fill up your buffer in the middle of writing a word, so you cannot only check
-// that the buffer is full at the end of this function).
-//
-void write_word(int outfile, Word *w);
+bool map_input(int infile, InputMap *map);
 
 //
-// Write any unwritten word symbols from the buffer used by write_word to outfile.
-//
-// Similarly to flush_pairs, this function must be called at the end of decode since otherwise you
-// would have symbols remaining in the buffer that were never written.
+// Unmap a mapping made by map_input.
 //
-void flush_words(int outfile);
+void unmap_input(InputMap *map);
 
 #endif
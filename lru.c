@@ -0,0 +1,84 @@
+#include "lru.h"
+#include "code.h"
+#include <stdlib.h>
+
+// Takes code out of the list
+static inline void lru_unlink(LruNode *nodes, uint32_t code) {
+    nodes[nodes[code].prev].next = nodes[code].next;
+    nodes[nodes[code].next].prev = nodes[code].prev;
+}
+
+// Puts code into the list between the neighbours prev and next
+static inline void lru_link(LruNode *nodes, uint32_t code, uint32_t prev, uint32_t next) {
+    nodes[code].prev = prev;
+    nodes[code].next = next;
+    nodes[prev].next = code;
+    nodes[next].prev = code;
+}
+
+// Constructor for Lru
+Lru *lru_create(uint32_t max_code) {
+    Lru *l = (Lru *) calloc(1, sizeof(Lru));
+
+    if (l == NULL)
+        return NULL;
+
+    // max_code is the sentinel, so it needs a node as well
+    l->nodes = (LruNode *) malloc(((size_t) max_code + 1) * sizeof(LruNode));
+    l->max_code = max_code;
+
+    if (l->nodes == NULL) {
+        lru_delete(l);
+        return NULL;
+    }
+
+    lru_reset(l);
+    return l;
+}
+
+// Destructor for Lru
+void lru_delete(Lru *l) {
+    free(l->nodes);
+
+    free(l);
+}
+
+// Empties the list
+void lru_reset(Lru *l) {
+    // every other node is written by lru_add before it is read
+    l->nodes[l->max_code].prev = l->max_code;
+    l->nodes[l->max_code].next = l->max_code;
+}
+
+// Adds code as the most recently used leaf
+void lru_add(Lru *l, uint32_t code, uint32_t parent, uint8_t sym) {
+    LruNode *nodes = l->nodes;
+
+    nodes[code].parent = parent;
+    nodes[code].sym = sym;
+    nodes[code].children = 0;
+    lru_link(nodes, code, nodes[l->max_code].prev, l->max_code);
+
+    if (parent != EMPTY_CODE && nodes[parent].children++ == 0)
+        lru_unlink(nodes, parent);
+}
+
+// Takes the least recently used leaf other than keep out of the list
+uint32_t lru_evict(Lru *l, uint32_t keep) {
+    LruNode *nodes = l->nodes;
+    uint32_t code = nodes[l->max_code].next;
+
+    if (code == keep)
+        code = nodes[code].next;
+    if (code == l->max_code)
+        return STOP_CODE;
+
+    lru_unlink(nodes, code);
+
+    // a parent left without children is older than every leaf still in the list
+    uint32_t parent = nodes[code].parent;
+    if (parent != EMPTY_CODE && --nodes[parent].children == 0)
+        lru_link(nodes, parent, l->max_code, nodes[l->max_code].next);
+
+    return code;
+}
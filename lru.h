@@ -0,0 +1,62 @@
+#ifndef __LRU_H__
+#define __LRU_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Order in which the leaf phrases of a dictionary were last used, for recycling their codes once
+// the dictionary is full.
+//
+// Only leaves, phrases no other phrase extends, can be recycled without breaking the phrases
+// built on top of them, so only leaves are kept in the list. Using a leaf as the prefix of a pair
+// gives it a child, so a leaf was last used when it was added: new phrases go to the most recent
+// end of the list. A phrase whose last child is recycled becomes a leaf again, and was last used
+// no later than that child, the least recent leaf there was, so it goes to the least recent end.
+// Every operation is a handful of stores into 16-byte nodes indexed by code, one cache line per
+// phrase touched, with max_code itself as the sentinel of the circular list.
+//
+
+typedef struct LruNode {
+    uint32_t prev; // leaf used just before this one, max_code for the least recent
+    uint32_t next; // leaf used just after this one, max_code for the most recent
+    uint32_t parent; // code of the phrase without its last symbol
+    uint16_t children; // number of phrases extending this one, 0 for leaves
+    uint8_t sym; // last symbol of the phrase
+} LruNode;
+
+typedef struct Lru {
+    LruNode *nodes;
+    uint32_t max_code; // sentinel
+} Lru;
+
+/*
+ * Constructor: Creates an empty list for codes below max_code
+ * Returns the new list, NULL if memory ran out
+ */
+Lru *lru_create(uint32_t max_code);
+
+/*
+ * Destructor: Frees the list
+ */
+void lru_delete(Lru *l);
+
+/*
+ * Empties the list, in constant time
+ */
+void lru_reset(Lru *l);
+
+/*
+ * Adds code, the phrase parent followed by sym, as the most recently used leaf
+ * parent is no longer a leaf, unless it is EMPTY_CODE which is never in the list
+ */
+void lru_add(Lru *l, uint32_t code, uint32_t parent, uint8_t sym);
+
+/*
+ * Takes the least recently used leaf other than keep out of the list
+ * Its parent and symbol stay readable until its code is added again
+ * Returns its code, STOP_CODE if keep is the only leaf
+ */
+uint32_t lru_evict(Lru *l, uint32_t keep);
+
+#endif
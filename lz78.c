@@ -0,0 +1,386 @@
+#include "lz78.h"
+#include "block.h"
+#include "chunks.h"
+#include "code.h"
+#include "dict.h"
+#include "io.h"
+#include "policy.h"
+#include "seek.h"
+#include "stats.h"
+#include "stream.h"
+#include "word.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct lz_stream {
+    bool compress;
+    int threads; // chunks decompressed at a time
+    lz_status status; // LZ_OK until the stream ends or fails
+
+    uint8_t header[sizeof(FileHeader)]; // in file byte order
+    uint32_t header_pos; // bytes of header written out or read in
+
+    // exactly one of these codes the body, chosen by the header
+    StreamEncoder *se;
+    StreamDecoder *sd;
+    ChunkEncoder *ce;
+    ChunkDecoder *cd;
+    FileHeader coded; // header sd or cd was created for, in host byte order
+
+    uint64_t total_in, total_out;
+    uint64_t codec_ns; // with LZ_STATS
+};
+
+// Constructor for a compressing lz_stream
+lz_stream *lz_compress_create(const lz_options *options) {
+    lz_options defaults = { 0, 0, 0, 0, LZ_RESET, false, false, false };
+    if (options == NULL)
+        options = &defaults;
+
+    int bits = options->bits ? options->bits : DEFAULT_BITS;
+    uint32_t chunk_size = options->chunk_size ? options->chunk_size : DEFAULT_CHUNK;
+
+    if (bits < MIN_BITS || bits > MAX_BITS || options->threads < 0 || chunk_size < MIN_CHUNK
+        || chunk_size > MAX_CHUNK || options->policy < LZ_RESET || options->policy > LZ_LRU
+        || (options->lzw && options->policy == LZ_LRU)
+        || (options->entropy && (options->lzw || options->threads == 0))
+        || (options->checksum && options->threads == 0))
+        return NULL;
+
+    lz_stream *s = (lz_stream *) calloc(1, sizeof(lz_stream));
+    if (s == NULL)
+        return NULL;
+
+    s->compress = true;
+
+    FileHeader head;
+    head.magic = MAGIC;
+    head.protection = options->protection;
+    head.bits = bits == DEFAULT_BITS ? 0 : bits; // default files stay identical to older ones
+    head.flags = options->threads > 0 ? FLAG_CHUNKED | FLAG_INDEXED : 0;
+    head.flags |= options->policy << POLICY_SHIFT;
+    head.flags |= options->lzw ? FLAG_LZW : 0;
+    head.flags |= options->entropy ? FLAG_ENTROPY : 0;
+    head.flags |= options->checksum ? FLAG_CHECKSUM : 0;
+
+    swap_header(&head);
+    memcpy(s->header, &head, sizeof(FileHeader));
+
+    if (options->threads > 0)
+        s->ce = chunk_encoder_create(bits, options->policy, options->lzw, options->entropy,
+            options->checksum, options->threads, chunk_size);
+    else
+        s->se = stream_encoder_create(bits, options->policy, options->lzw);
+
+    if (s->ce == NULL && s->se == NULL) {
+        lz_stream_delete(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+// Compresses input into output, header first
+lz_status lz_compress(lz_stream *s, const uint8_t **next_in, size_t *avail_in,
+    uint8_t **next_out, size_t *avail_out, lz_flush flush) {
+    if (!s->compress)
+        return LZ_PARAM_ERROR;
+    if (s->status != LZ_OK) // ended streams stay ended, failed ones failed
+        return s->status == LZ_STREAM_END ? LZ_PARAM_ERROR : s->status;
+
+    const uint8_t *in = *next_in;
+    uint8_t *out = *next_out;
+    lz_status status = LZ_OK;
+    uint64_t start = stat_clock();
+
+    if (s->header_pos < sizeof(FileHeader)) {
+        size_t n = sizeof(FileHeader) - s->header_pos;
+        if (n > *avail_out)
+            n = *avail_out;
+
+        memcpy(*next_out, s->header + s->header_pos, n);
+        *next_out += n;
+        *avail_out -= n;
+        s->header_pos += n;
+    }
+
+    if (s->header_pos == sizeof(FileHeader)) {
+        if (s->ce != NULL)
+            status = chunk_encode(
+                s->ce, next_in, avail_in, next_out, avail_out, flush == LZ_FINISH);
+        else
+            status = stream_encode(
+                s->se, next_in, avail_in, next_out, avail_out, flush == LZ_FINISH);
+    }
+
+    s->total_in += *next_in - in;
+    s->total_out += *next_out - out;
+    s->status = status;
+    STAT_ADD(s->codec_ns, stat_clock() - start);
+    return status;
+}
+
+// Constructor for a decompressing lz_stream
+lz_stream *lz_decompress_create(int threads) {
+    if (threads < 1)
+        return NULL;
+
+    lz_stream *s = (lz_stream *) calloc(1, sizeof(lz_stream));
+    if (s == NULL)
+        return NULL;
+
+    s->threads = threads;
+    return s;
+}
+
+// Reads the header, and creates the decoder it asks for once it is complete
+static lz_status read_stream_header(lz_stream *s, const uint8_t **next_in, size_t *avail_in) {
+    size_t n = sizeof(FileHeader) - s->header_pos;
+    if (n > *avail_in)
+        n = *avail_in;
+
+    memcpy(s->header + s->header_pos, *next_in, n);
+    *next_in += n;
+    *avail_in -= n;
+    s->header_pos += n;
+
+    if (s->header_pos < sizeof(FileHeader)) // the rest is in the next input
+        return LZ_OK;
+
+    FileHeader head;
+    memcpy(&head, s->header, sizeof(FileHeader));
+    swap_header(&head);
+
+    if (!check_header(&head))
+        return LZ_DATA_ERROR;
+
+    // a decoder kept by lz_stream_reset goes on if it codes the same way, whatever the protection
+    if (s->cd != NULL || s->sd != NULL) {
+        if (head.bits == s->coded.bits && head.flags == s->coded.flags)
+            return LZ_OK;
+
+        if (s->cd != NULL)
+            chunk_decoder_delete(s->cd);
+        if (s->sd != NULL)
+            stream_decoder_delete(s->sd);
+        s->cd = NULL;
+        s->sd = NULL;
+    }
+
+    s->coded = head;
+    if (head.flags & FLAG_CHUNKED)
+        s->cd = chunk_decoder_create(head.bits, HEADER_POLICY(&head), head.flags & FLAG_LZW,
+            head.flags & FLAG_ENTROPY, head.flags & FLAG_CHECKSUM, s->threads,
+            head.flags & FLAG_INDEXED);
+    else
+        s->sd = stream_decoder_create(head.bits, HEADER_POLICY(&head), head.flags & FLAG_LZW);
+
+    return s->cd == NULL && s->sd == NULL ? LZ_MEM_ERROR : LZ_OK;
+}
+
+// Decompresses input into output, header first
+lz_status lz_decompress(lz_stream *s, const uint8_t **next_in, size_t *avail_in,
+    uint8_t **next_out, size_t *avail_out) {
+    if (s->compress)
+        return LZ_PARAM_ERROR;
+    if (s->status != LZ_OK) // ended streams stay ended, failed ones failed
+        return s->status == LZ_STREAM_END ? LZ_PARAM_ERROR : s->status;
+
+    const uint8_t *in = *next_in;
+    uint8_t *out = *next_out;
+    lz_status status = LZ_OK;
+    uint64_t start = stat_clock();
+
+    if (s->header_pos < sizeof(FileHeader))
+        status = read_stream_header(s, next_in, avail_in);
+
+    if (status == LZ_OK && s->cd != NULL)
+        status = chunk_decode(s->cd, next_in, avail_in, next_out, avail_out);
+    else if (status == LZ_OK && s->sd != NULL)
+        status = stream_decode(s->sd, next_in, avail_in, next_out, avail_out);
+
+    s->total_in += *next_in - in;
+    s->total_out += *next_out - out;
+    s->status = status;
+    STAT_ADD(s->codec_ns, stat_clock() - start);
+    return status;
+}
+
+// Bytes consumed so far
+uint64_t lz_total_in(const lz_stream *s) {
+    return s->total_in;
+}
+
+// Bytes produced so far
+uint64_t lz_total_out(const lz_stream *s) {
+    return s->total_out;
+}
+
+// Sums the counters of whichever codec the stream uses
+void lz_get_stats(const lz_stream *s, lz_stats *stats) {
+    Counters sum;
+    FileHeader head; // flags are a single byte, so file byte order does not matter
+    memset(&sum, 0, sizeof(sum));
+    memset(stats, 0, sizeof(lz_stats));
+    memcpy(&head, s->header, sizeof(FileHeader));
+
+    if (s->se != NULL)
+        stream_encoder_counters(s->se, &sum);
+    if (s->sd != NULL)
+        stream_decoder_counters(s->sd, &sum);
+    if (s->ce != NULL)
+        chunk_encoder_counters(s->ce, &sum);
+    if (s->cd != NULL)
+        chunk_decoder_counters(s->cd, &sum);
+
+#ifdef LZ_STATS
+    stats->counters = true;
+#endif
+    stats->total_in = s->total_in;
+    stats->total_out = s->total_out;
+    stats->lookups = sum.lookups;
+    stats->resets = sum.resets;
+    stats->codec_ns = s->codec_ns;
+    stats->lzw = head.flags & FLAG_LZW;
+
+    for (int i = 0; i <= MAX_BITS; i++) {
+        stats->pairs[i] = sum.pairs[i];
+        stats->phrases += sum.pairs[i];
+    }
+}
+
+// Starts over with the codec of the previous file, the header of a compressing stream included
+void lz_stream_reset(lz_stream *s) {
+    s->status = LZ_OK;
+    s->header_pos = 0;
+    s->total_in = s->total_out = 0;
+    s->codec_ns = 0;
+
+    if (s->se != NULL)
+        stream_encoder_reset(s->se);
+    if (s->sd != NULL)
+        stream_decoder_reset(s->sd);
+    if (s->ce != NULL)
+        chunk_encoder_reset(s->ce);
+    if (s->cd != NULL)
+        chunk_decoder_reset(s->cd);
+}
+
+// Destructor for lz_stream
+void lz_stream_delete(lz_stream *s) {
+    if (s->se != NULL)
+        stream_encoder_delete(s->se);
+    if (s->sd != NULL)
+        stream_decoder_delete(s->sd);
+    if (s->ce != NULL)
+        chunk_encoder_delete(s->ce);
+    if (s->cd != NULL)
+        chunk_decoder_delete(s->cd);
+
+    free(s);
+}
+
+// Worst case of a default stream: the header, and every symbol ending a phrase
+size_t lz_compress_bound(size_t n) {
+    return sizeof(FileHeader) + block_bound(n, DEFAULT_BITS);
+}
+
+// Runs all of src through s in one call and frees s
+static int64_t run_stream(
+    lz_stream *s, const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    if (s == NULL)
+        return -1;
+
+    const uint8_t *in = src;
+    uint8_t *out = dst;
+    lz_status status = s->compress ? lz_compress(s, &in, &n, &out, &cap, LZ_FINISH)
+                                   : lz_decompress(s, &in, &n, &out, &cap);
+
+    lz_stream_delete(s);
+    return status == LZ_STREAM_END ? out - dst : -1;
+}
+
+// Compresses a buffer as a single stream
+int64_t lz_compress_buf(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    // only a dst that can take the worst case is safe for the 8-byte stores of block_encode
+    if (cap < lz_compress_bound(n) || n > UINT32_MAX)
+        return run_stream(lz_compress_create(NULL), src, n, dst, cap);
+
+    // no more phrases than symbols, so small inputs only need a small dictionary
+    uint32_t codes = MAX_CODE_BITS(DEFAULT_BITS);
+    if (codes > n + START_CODE)
+        codes = n + START_CODE;
+
+    Dict *dict = dict_create(codes);
+    if (dict == NULL)
+        return -1;
+
+    FileHeader head = { MAGIC, 0, 0, 0 };
+    swap_header(&head);
+    memcpy(dst, &head, sizeof(FileHeader));
+
+    // a whole stream is coded exactly like a chunk
+    uint32_t size = block_encode(
+        dict, DEFAULT_BITS, POLICY_RESET, false, src, n, dst + sizeof(FileHeader), NULL);
+
+    dict_delete(dict);
+    return sizeof(FileHeader) + (int64_t) size;
+}
+
+// Decompresses a buffer holding a whole file
+int64_t lz_decompress_buf(const uint8_t *src, size_t n, uint8_t *dst, size_t cap) {
+    FileHeader head;
+
+    if (n < sizeof(FileHeader))
+        return -1;
+
+    memcpy(&head, src, sizeof(FileHeader));
+    swap_header(&head);
+
+    if (!check_header(&head))
+        return -1;
+
+    // chunked files, and anything too big for block_decode, go through a stream
+    n -= sizeof(FileHeader);
+    if ((head.flags & FLAG_CHUNKED) || n >= UINT32_MAX)
+        return run_stream(lz_decompress_create(1), src, n + sizeof(FileHeader), dst, cap);
+
+    // every pair or LZW code takes at least 9 bits, so there are fewer codes than bytes
+    uint32_t codes = MAX_CODE_BITS(head.bits);
+    uint32_t first_code = FIRST_CODE(HEADER_POLICY(&head)) + (head.flags & FLAG_LZW ? LITERALS : 0);
+    if (codes > n + first_code)
+        codes = n + first_code;
+
+    WordTable *table = wt_create(codes);
+    if (table == NULL || (HEADER_POLICY(&head) == POLICY_LRU && !wt_track(table, codes))) {
+        if (table != NULL)
+            wt_delete(table);
+        return -1;
+    }
+
+    uint32_t len = block_decode(table, head.bits, HEADER_POLICY(&head), head.flags & FLAG_LZW,
+        false, src + sizeof(FileHeader), n, dst, cap < UINT32_MAX ? cap : UINT32_MAX - 1);
+
+    wt_delete(table);
+    return len == UINT32_MAX ? -1 : (int64_t) len;
+}
+
+// Opens an indexed file for random access
+lz_reader *lz_reader_open(int fd, int cache) {
+    return seek_open(fd, cache);
+}
+
+// Size of the uncompressed contents
+uint64_t lz_reader_size(lz_reader *r) {
+    return seek_size(r);
+}
+
+// Copies a range of the uncompressed contents into buf
+int64_t lz_reader_read(lz_reader *r, uint64_t offset, uint8_t *buf, uint64_t len) {
+    return seek_read(r, offset, buf, len);
+}
+
+// Destructor for lz_reader
+void lz_reader_close(lz_reader *r) {
+    seek_close(r);
+}
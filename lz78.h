@@ -0,0 +1,181 @@
+#ifndef __LZ78_H__
+#define __LZ78_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_EXPORT __attribute__((visibility("default")))
+
+//
+// liblz78: compression into and out of the files written by encode, without any global state.
+//
+// Everything a compression or decompression needs lives in its lz_stream, so a process can run any
+// number of them at once, each from one thread at a time. Data is pushed through incrementally,
+// like zlib: every call consumes what it can of the avail_in bytes at *next_in and produces what
+// fits into the avail_out bytes at *next_out, advancing both pointers and lowering both counts.
+// Input that was not consumed must be passed again, unchanged, on the next call.
+//
+
+typedef struct lz_stream lz_stream;
+
+typedef enum lz_status {
+    LZ_OK = 0, // Progress was made; call again with more input or output space.
+    LZ_STREAM_END = 1, // The whole file has been produced.
+    LZ_DATA_ERROR = -1, // The compressed input is damaged, truncated or not an lz file.
+    LZ_MEM_ERROR = -2, // Out of memory.
+    LZ_PARAM_ERROR = -3, // Bad options, or the stream was used after it ended.
+    LZ_IO_ERROR = -4, // Reading or writing a file failed, see errno; never returned by the codec.
+} lz_status;
+
+typedef enum lz_flush {
+    LZ_RUN = 0, // More input follows.
+    LZ_FINISH = 1, // The input passed with this call is the last of it.
+} lz_flush;
+
+typedef enum lz_policy {
+    LZ_RESET = 0, // Start over with an empty dictionary once it is full.
+    LZ_FREEZE = 1, // Keep the full dictionary, without adding to it.
+    LZ_ADAPTIVE = 2, // Keep it, but clear it once the compression ratio degrades.
+    LZ_LRU = 3, // Give each new phrase the code of the least recently used one.
+} lz_policy;
+
+typedef struct lz_options {
+    int bits; // Maximum code width from 12 to 24, 0 for the default of 16.
+    int threads; // 0 for a single stream, otherwise chunks compressed this many at a time.
+    uint32_t chunk_size; // Uncompressed size of each chunk when threads is set, 0 for 4MB.
+    uint16_t protection; // Recorded in the file header.
+    lz_policy policy; // What happens once the dictionary is full, recorded in the header.
+    bool lzw; // LZW coding: codes only, no symbols; not with LZ_LRU.
+    bool entropy; // Entropy code the symbols of each chunk; needs threads, not with lzw.
+    bool checksum; // Follow each chunk with the CRC32C of its contents; needs threads.
+} lz_options;
+
+/*
+ * Constructor: Creates a stream compressing with options, or the defaults if options is NULL
+ * Returns the new stream, NULL if the options are out of range or memory ran out
+ */
+LZ_EXPORT lz_stream *lz_compress_create(const lz_options *options);
+
+/*
+ * Compresses input into output, see above
+ * flush is LZ_FINISH once all of the input has been passed, after which the call has to be
+ * repeated with more output space until it returns LZ_STREAM_END
+ * Returns LZ_OK, LZ_STREAM_END, or an error which every later call returns as well
+ */
+LZ_EXPORT lz_status lz_compress(lz_stream *s, const uint8_t **next_in, size_t *avail_in,
+    uint8_t **next_out, size_t *avail_out, lz_flush flush);
+
+/*
+ * Constructor: Creates a stream decompressing any lz file, the chunks of chunked files threads
+ * at a time
+ * Returns the new stream, NULL if memory ran out
+ */
+LZ_EXPORT lz_stream *lz_decompress_create(int threads);
+
+/*
+ * Decompresses input into output, see above
+ * Only returns LZ_OK once all of the input is consumed or the output is full, so LZ_OK with
+ * output space to spare means more input is needed, and at the end of the file that it was
+ * truncated
+ * Returns LZ_OK, LZ_STREAM_END, or an error which every later call returns as well
+ */
+LZ_EXPORT lz_status lz_decompress(lz_stream *s, const uint8_t **next_in, size_t *avail_in,
+    uint8_t **next_out, size_t *avail_out);
+
+/*
+ * Returns the number of bytes consumed from next_in so far
+ */
+LZ_EXPORT uint64_t lz_total_in(const lz_stream *s);
+
+/*
+ * Returns the number of bytes produced into next_out so far
+ */
+LZ_EXPORT uint64_t lz_total_out(const lz_stream *s);
+
+typedef struct lz_stats {
+    bool counters; // The library was built with LZ_STATS; if not, only the totals below are set.
+    uint64_t total_in, total_out; // As returned by lz_total_in and lz_total_out.
+    uint64_t lookups; // Dictionary lookups, one per symbol compressed, 0 when decompressing.
+    uint64_t phrases; // Pairs coded, not counting the stop pair of each stream or chunk.
+    uint64_t resets; // Times the dictionary filled up and started over.
+    uint64_t pairs[25]; // Phrases whose code took i bits, each i + 8 bits with its symbol.
+    bool lzw; // The stream is LZW coded, so the phrases above took i bits only.
+    uint64_t codec_ns; // Wall time spent inside lz_compress or lz_decompress.
+} lz_stats;
+
+/*
+ * Fills *stats with what the stream has done so far, see above
+ */
+LZ_EXPORT void lz_get_stats(const lz_stream *s, lz_stats *stats);
+
+/*
+ * Readies the stream, whether or not it ended, for a new file with the options or threads it was
+ * created with, keeping its dictionaries, buffers and threads so that none have to be set up again
+ * A decompressing stream keeps its decoder for as long as the files it reads have the same code
+ * width and flags
+ */
+LZ_EXPORT void lz_stream_reset(lz_stream *s);
+
+/*
+ * Destructor: Frees the stream, whether or not it ended
+ */
+LZ_EXPORT void lz_stream_delete(lz_stream *s);
+
+//
+// One-shot calls for data that is already in memory. They write and read the same file format as
+// the streams, but code straight from src to dst without any file descriptors or staging buffers
+// in between.
+//
+
+/*
+ * Returns the largest size lz_compress_buf can produce from n bytes, header included
+ */
+LZ_EXPORT size_t lz_compress_bound(size_t n);
+
+/*
+ * Compresses the n bytes of src into dst, which has room for cap bytes, with the default options
+ * Compression is fastest with a cap of at least lz_compress_bound(n)
+ * Returns the size of the compressed data, -1 if it does not fit into cap or memory ran out
+ */
+LZ_EXPORT int64_t lz_compress_buf(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+/*
+ * Decompresses the whole lz file of n bytes at src into dst, which has room for cap bytes
+ * Returns the size of the decompressed data, -1 if src is damaged, it does not fit into cap or
+ * memory ran out
+ */
+LZ_EXPORT int64_t lz_decompress_buf(const uint8_t *src, size_t n, uint8_t *dst, size_t cap);
+
+//
+// Random access to indexed chunked files, which encode writes whenever it writes chunks. Only the
+// chunks overlapping a read are read and decompressed, and the ones used last stay decompressed
+// in a cache of a size given when opening, so that repeated or nearby reads only cost a copy.
+//
+
+typedef struct lz_reader lz_reader;
+
+/*
+ * Constructor: Opens the indexed chunked file at fd, which must be seekable, keeping up to cache
+ * decompressed chunks of up to a chunk size each around, at least one
+ * Returns the new reader, NULL if the file has no intact chunk index or memory ran out
+ */
+LZ_EXPORT lz_reader *lz_reader_open(int fd, int cache);
+
+/*
+ * Returns the size of the uncompressed contents
+ */
+LZ_EXPORT uint64_t lz_reader_size(lz_reader *r);
+
+/*
+ * Copies up to len uncompressed bytes starting at offset into buf
+ * Returns the number of bytes copied, 0 at or past the end, -1 if the file is damaged
+ */
+LZ_EXPORT int64_t lz_reader_read(lz_reader *r, uint64_t offset, uint8_t *buf, uint64_t len);
+
+/*
+ * Destructor: Frees the reader and its cache, fd stays open
+ */
+LZ_EXPORT void lz_reader_close(lz_reader *r);
+
+#endif
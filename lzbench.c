@@ -0,0 +1,562 @@
+#include "block.h"
+#include "chunks.h"
+#include "code.h"
+#include "io.h"
+#include "lz78.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPTIONS "hn:s:d:w:T:"
+
+#define DEFAULT_RUNS 5
+#define DEFAULT_SIZE (4 << 20) // 4MB per generated corpus.
+#define TINY_MIN     32 // Tiny items are 32 bytes to 1KB.
+#define TINY_MAX     1024
+
+// One corpus: a list of items, each compressed and decompressed on its own
+typedef struct Corpus {
+    const char *name;
+    uint8_t **items;
+    size_t *sizes;
+    size_t count;
+} Corpus;
+
+// Measurements of one corpus, sent from the child that ran it to the parent
+typedef struct Result {
+    uint64_t bytes, compressed;
+    double compress_time, decompress_time; // seconds over all runs
+    double compress_p50, compress_p99, decompress_p50, decompress_p99; // microseconds per item
+    bool ok; // every item came back unchanged
+} Result;
+
+// Benchmark settings
+typedef struct Settings {
+    int runs;
+    uint64_t size;
+    int bits;
+    int threads;
+} Settings;
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15; // fixed seed, so every run sees the same corpora
+
+// xorshift64*, good enough for test data and identical everywhere
+static uint64_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * UINT64_C(2685821657736338717);
+}
+
+static const char *words[] = { "the", "of", "and", "to", "a", "in", "is", "it", "that", "was",
+    "for", "on", "are", "with", "as", "be", "at", "this", "have", "from", "or", "by", "one",
+    "had", "not", "but", "what", "all", "were", "when", "we", "there", "can", "an", "your",
+    "which", "their", "said", "if", "do", "will", "each", "about", "how", "up", "out", "them",
+    "then", "she", "many", "some", "so", "these", "would", "other", "into", "has", "more", "her",
+    "two", "like", "him", "see", "time", "could", "no", "make", "than", "first", "been", "its",
+    "who", "now", "people", "my", "made", "over", "did", "down", "only", "way", "find", "use",
+    "may", "water", "long", "little", "very", "after", "words", "called", "just", "where",
+    "most", "know", "compression", "dictionary", "symbol", "phrase", "stream" };
+
+#define WORDS (sizeof(words) / sizeof(words[0]))
+
+static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+static const char *paths[] = { "/api/v1/items", "/api/v1/users", "/healthz", "/api/v2/search",
+    "/static/app.js", "/login" };
+
+// Appends at most cap - *len bytes of str to buf
+static void append(uint8_t *buf, size_t *len, size_t cap, const char *str) {
+    size_t n = strlen(str);
+    if (n > cap - *len)
+        n = cap - *len;
+
+    memcpy(buf + *len, str, n);
+    *len += n;
+}
+
+// English-like text, word frequencies skewed towards the start of the list like real text
+static void gen_text(uint8_t *buf, size_t size) {
+    size_t len = 0;
+    int sentence = 0;
+
+    while (len < size) {
+        size_t r = rng() % WORDS;
+        const char *word = words[(r * r) / WORDS];
+
+        append(buf, &len, size, word);
+        sentence++;
+
+        if (sentence > 6 && rng() % 8 == 0) {
+            append(buf, &len, size, rng() % 4 ? ". " : ".\n");
+            sentence = 0;
+        } else {
+            append(buf, &len, size, rng() % 12 ? " " : ", ");
+        }
+    }
+}
+
+// Service logs: timestamps that move forward, a few levels and paths, varying ids and latencies
+static void gen_logs(uint8_t *buf, size_t size) {
+    size_t len = 0;
+    uint64_t ms = 1700000000000;
+    char line[256];
+
+    while (len < size) {
+        ms += rng() % 50;
+        snprintf(line, sizeof(line),
+            "%" PRIu64 ".%03u %s [worker-%u] request id=%08" PRIx64 " path=%s/%u status=%u "
+            "latency_ms=%u\n",
+            ms / 1000, (unsigned) (ms % 1000), levels[rng() % 6], (unsigned) (rng() % 16),
+            rng() & 0xFFFFFFFF, paths[rng() % 6], (unsigned) (rng() % 10000),
+            rng() % 20 ? 200 : 500, (unsigned) (rng() % 300));
+        append(buf, &len, size, line);
+    }
+}
+
+// Table of fixed-size binary records, with counters, small enums, floats and zero padding
+static void gen_binary(uint8_t *buf, size_t size) {
+    uint32_t id = 0;
+
+    for (size_t len = 0; len < size;) {
+        uint8_t record[32] = { 0 };
+        float value = (float) (rng() % 100000) / 100;
+
+        id += 1 + rng() % 3;
+        memcpy(record, &id, sizeof(id));
+        record[4] = rng() % 5;
+        record[5] = rng() % 2;
+        memcpy(record + 8, &value, sizeof(value));
+
+        size_t n = size - len < sizeof(record) ? size - len : sizeof(record);
+        memcpy(buf + len, record, n);
+        len += n;
+    }
+}
+
+// Incompressible bytes
+static void gen_random(uint8_t *buf, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        buf[i] = rng();
+}
+
+// A short block repeated over and over, with the odd byte changed
+static void gen_repetitive(uint8_t *buf, size_t size) {
+    uint8_t block[64];
+    gen_text(block, sizeof(block));
+
+    for (size_t i = 0; i < size; i++)
+        buf[i] = rng() % 4096 ? block[i % sizeof(block)] : (uint8_t) rng();
+}
+
+// Allocates a corpus of count items
+static Corpus *corpus_create(const char *name, size_t count) {
+    Corpus *c = (Corpus *) calloc(1, sizeof(Corpus));
+
+    if (c == NULL)
+        return NULL;
+
+    c->name = name;
+    c->count = count;
+    c->items = (uint8_t **) calloc(count, sizeof(uint8_t *));
+    c->sizes = (size_t *) calloc(count, sizeof(size_t));
+
+    if (c->items == NULL || c->sizes == NULL) {
+        free(c->items);
+        free(c->sizes);
+        free(c);
+        return NULL;
+    }
+
+    return c;
+}
+
+// Frees a corpus and its items
+static void corpus_delete(Corpus *c) {
+    for (size_t i = 0; i < c->count; i++)
+        free(c->items[i]);
+
+    free(c->items);
+    free(c->sizes);
+    free(c);
+}
+
+// Generates the built-in corpus called name, size bytes in all
+static Corpus *generate(const char *name, size_t size) {
+    static const struct {
+        const char *name;
+        void (*gen)(uint8_t *, size_t);
+    } gens[] = { { "text", gen_text }, { "logs", gen_logs }, { "binary", gen_binary },
+        { "random", gen_random }, { "repetitive", gen_repetitive } };
+
+    rng_state = 0x9E3779B97F4A7C15; // the same data whichever corpora ran before
+
+    // tiny: many small items of text and logs, as in RPC bodies and cache values
+    if (strcmp(name, "tiny") == 0) {
+        size_t count = size / ((TINY_MIN + TINY_MAX) / 2);
+        Corpus *c = corpus_create(name, count ? count : 1);
+
+        for (size_t i = 0; c != NULL && i < c->count; i++) {
+            c->sizes[i] = TINY_MIN + rng() % (TINY_MAX - TINY_MIN + 1);
+            c->items[i] = (uint8_t *) malloc(c->sizes[i]);
+
+            if (c->items[i] == NULL) {
+                corpus_delete(c);
+                return NULL;
+            }
+            (i % 2 ? gen_logs : gen_text)(c->items[i], c->sizes[i]);
+        }
+
+        return c;
+    }
+
+    for (size_t g = 0; g < sizeof(gens) / sizeof(gens[0]); g++) {
+        if (strcmp(name, gens[g].name) != 0)
+            continue;
+
+        Corpus *c = corpus_create(name, 1);
+        if (c == NULL)
+            return NULL;
+
+        c->sizes[0] = size;
+        c->items[0] = (uint8_t *) malloc(size ? size : 1);
+
+        if (c->items[0] == NULL) {
+            corpus_delete(c);
+            return NULL;
+        }
+
+        gens[g].gen(c->items[0], size);
+        return c;
+    }
+
+    return NULL;
+}
+
+// Loads the file at path as a corpus of one item
+static Corpus *load(const char *path, const char *name) {
+    int fd = open(path, O_RDONLY);
+    struct stat stats;
+
+    if (fd == -1 || fstat(fd, &stats) != 0 || !S_ISREG(stats.st_mode)
+        || stats.st_size > INT32_MAX) {
+        if (fd != -1)
+            close(fd);
+        return NULL;
+    }
+
+    Corpus *c = corpus_create(name, 1);
+
+    if (c != NULL) {
+        c->sizes[0] = stats.st_size;
+        c->items[0] = (uint8_t *) malloc(stats.st_size ? stats.st_size : 1);
+
+        if (c->items[0] == NULL
+            || read_bytes(fd, c->items[0], stats.st_size) != (int) stats.st_size) {
+            corpus_delete(c);
+            c = NULL;
+        }
+    }
+
+    close(fd);
+    return c;
+}
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Orders doubles for qsort
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// The q quantile of the n latencies in times, which get sorted
+static double percentile(double *times, size_t n, double q) {
+    qsort(times, n, sizeof(double), compare_doubles);
+
+    size_t i = (size_t) ceil(q * n);
+    return times[i > 0 ? i - 1 : 0];
+}
+
+// Returns true if items are coded with the one-shot calls, which take the default options only,
+// rather than through a stream
+static bool one_shot(const Settings *settings) {
+    return settings->threads == 0 && settings->bits == DEFAULT_BITS;
+}
+
+// Runs all of src through s in one call and frees s, returns the size written or -1 on failure
+static int64_t run(
+    lz_stream *s, const uint8_t *src, size_t n, uint8_t *dst, size_t cap, bool compress) {
+    if (s == NULL)
+        return -1;
+
+    const uint8_t *in = src;
+    uint8_t *out = dst;
+    lz_status status = compress ? lz_compress(s, &in, &n, &out, &cap, LZ_FINISH)
+                                : lz_decompress(s, &in, &n, &out, &cap);
+
+    lz_stream_delete(s);
+    return status == LZ_STREAM_END ? out - dst : -1;
+}
+
+// Compresses and decompresses every item of c settings->runs times, timing each item
+static Result measure(Corpus *c, Settings *settings) {
+    Result result = { 0 };
+    size_t largest = 0, samples = c->count * settings->runs;
+    lz_options options = { settings->bits, settings->threads, 0, 0, LZ_RESET, false, false, false };
+
+    for (size_t i = 0; i < c->count; i++)
+        if (c->sizes[i] > largest)
+            largest = c->sizes[i];
+
+    // lz_compress_bound only covers a stream at the default width
+    size_t cap = settings->threads ? chunk_bound(largest, DEFAULT_CHUNK, settings->bits, false)
+                                   : sizeof(FileHeader) + block_bound(largest, settings->bits);
+    uint8_t *packed = (uint8_t *) malloc(cap);
+    uint8_t *unpacked = (uint8_t *) malloc(largest + 1); // a spare byte to see the stop pair in
+    double *compress_times = (double *) malloc(samples * sizeof(double));
+    double *decompress_times = (double *) malloc(samples * sizeof(double));
+
+    result.ok = packed != NULL && unpacked != NULL && compress_times != NULL
+                && decompress_times != NULL;
+
+    bool buf = one_shot(settings);
+    int threads = settings->threads ? settings->threads : 1;
+
+    for (size_t r = 0, k = 0; result.ok && r < (size_t) settings->runs; r++) {
+        for (size_t i = 0; result.ok && i < c->count; i++, k++) {
+            const uint8_t *item = c->items[i];
+            size_t n = c->sizes[i];
+
+            // a stream sizes its tables for the whole code space, which the tiny items would
+            // mostly measure, while the one-shot calls size them to the item
+            double start = now();
+            int64_t clen = buf ? lz_compress_buf(item, n, packed, cap)
+                               : run(lz_compress_create(&options), item, n, packed, cap, true);
+            size_t packed_len = clen < 0 ? 0 : clen;
+            double middle = now();
+            int64_t ulen = buf ? lz_decompress_buf(packed, packed_len, unpacked, largest + 1)
+                               : run(lz_decompress_create(threads), packed, packed_len, unpacked,
+                                   largest + 1, false);
+            double end = now();
+
+            result.ok = clen >= 0 && ulen == (int64_t) n && memcmp(unpacked, item, n) == 0;
+
+            compress_times[k] = middle - start;
+            decompress_times[k] = end - middle;
+            result.compress_time += middle - start;
+            result.decompress_time += end - middle;
+
+            if (r == 0) {
+                result.bytes += n;
+                result.compressed += clen;
+            }
+        }
+    }
+
+    if (result.ok) {
+        result.compress_p50 = percentile(compress_times, samples, 0.50) * 1e6;
+        result.compress_p99 = percentile(compress_times, samples, 0.99) * 1e6;
+        result.decompress_p50 = percentile(decompress_times, samples, 0.50) * 1e6;
+        result.decompress_p99 = percentile(decompress_times, samples, 0.99) * 1e6;
+    }
+
+    free(packed);
+    free(unpacked);
+    free(compress_times);
+    free(decompress_times);
+    return result;
+}
+
+// Prints the result of one corpus as a line of JSON
+static void report(const char *name, size_t items, Result *result, long rss, Settings *settings) {
+    double runs = settings->runs;
+
+    printf("{\"corpus\":\"%s\",\"items\":%zu,\"bytes\":%" PRIu64 ",\"compressed\":%" PRIu64
+           ",\"ratio\":%.4f,\"compress_mbps\":%.2f,\"decompress_mbps\":%.2f,"
+           "\"compress_p50_us\":%.2f,\"compress_p99_us\":%.2f,\"decompress_p50_us\":%.2f,"
+           "\"decompress_p99_us\":%.2f,\"peak_rss_kb\":%ld,\"runs\":%d,\"bits\":%d,"
+           "\"threads\":%d,\"api\":\"%s\",\"ok\":%s}\n",
+        name, items, result->bytes, result->compressed,
+        result->bytes ? (double) result->compressed / result->bytes : 0.0,
+        result->compress_time > 0 ? result->bytes * runs / result->compress_time / 1e6 : 0.0,
+        result->decompress_time > 0 ? result->bytes * runs / result->decompress_time / 1e6 : 0.0,
+        result->compress_p50, result->compress_p99, result->decompress_p50,
+        result->decompress_p99, rss, settings->runs, settings->bits,
+        settings->threads, one_shot(settings) ? "buf" : "stream", result->ok ? "true" : "false");
+    fflush(stdout);
+}
+
+// Benchmarks one corpus in a child process, so peak RSS covers nothing but that corpus
+static bool bench(const char *name, const char *path, Settings *settings) {
+    int fds[2];
+    Result result = { 0 };
+    Corpus *c = NULL;
+
+    if (pipe(fds) != 0)
+        return false;
+
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        close(fds[0]);
+        c = path != NULL ? load(path, name) : generate(name, settings->size);
+
+        if (c != NULL) {
+            result = measure(c, settings);
+            write_bytes(fds[1], (uint8_t *) &c->count, sizeof(c->count));
+            write_bytes(fds[1], (uint8_t *) &result, sizeof(Result));
+        }
+        _exit(c != NULL && result.ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+
+    size_t items = 0;
+    bool got = pid > 0 && read_bytes(fds[0], (uint8_t *) &items, sizeof(items)) == sizeof(items)
+               && read_bytes(fds[0], (uint8_t *) &result, sizeof(Result)) == sizeof(Result);
+    close(fds[0]);
+
+    int status = 1;
+    struct rusage usage = { 0 };
+    if (pid > 0)
+        wait4(pid, &status, 0, &usage);
+
+    if (!got) {
+        fprintf(stderr, "lzbench: %s: Could not be benchmarked\n", path != NULL ? path : name);
+        return false;
+    }
+
+    report(name, items, &result, usage.ru_maxrss, settings);
+    return result.ok;
+}
+
+// Prints usage
+static void usage(void) {
+    printf("SYNOPSIS\n"
+           "    Benchmarks LZ78 compression and decompression on a fixed set of corpora, printing\n"
+           "    one line of JSON per corpus.\n"
+           "\n"
+           "USAGE\n"
+           "    ./lzbench [-h] [-n runs] [-s size] [-d dir] [-w bits] [-T threads] [corpus...]\n"
+           "\n"
+           "OPTIONS\n"
+           "    -h          Display program help and usage.\n"
+           "    -n runs     Times each corpus is run (default: %d).\n"
+           "    -s size     Bytes per generated corpus, K, M or G suffix allowed (default: 4M).\n"
+           "    -d dir      Benchmark each regular file in dir instead of generated corpora.\n"
+           "    -w bits     Maximum code width from 12 to 24 (default: 16).\n"
+           "    -T threads  Compress in chunks this many at a time (default: 0, one stream).\n"
+           "    corpus...   Any of text, logs, binary, random, repetitive and tiny\n"
+           "                (default: all).\n",
+        DEFAULT_RUNS);
+}
+
+int main(int argc, char **argv) {
+    static const char *corpora[] = { "text", "logs", "binary", "random", "repetitive", "tiny" };
+    Settings settings = { DEFAULT_RUNS, DEFAULT_SIZE, DEFAULT_BITS, 0 };
+    char *dir = NULL;
+    bool help = false;
+    int opt = 0;
+    int optInd = optind + 1;
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'h': {
+            help = true;
+            break;
+        }
+
+        case 'n': {
+            settings.runs = atoi(argv[optInd]);
+            if (settings.runs < 1)
+                help = true;
+            break;
+        }
+
+        case 's': {
+            if (!parse_size(argv[optInd], &settings.size) || settings.size > INT32_MAX)
+                help = true;
+            break;
+        }
+
+        case 'd': {
+            dir = argv[optInd];
+            break;
+        }
+
+        case 'w': {
+            settings.bits = atoi(argv[optInd]);
+            if (settings.bits < MIN_BITS || settings.bits > MAX_BITS)
+                help = true;
+            break;
+        }
+
+        case 'T': {
+            settings.threads = atoi(argv[optInd]);
+            if (settings.threads < 0)
+                help = true;
+            break;
+        }
+
+        default: {
+            help = true;
+            break;
+        }
+        }
+        optInd = optind + 1;
+    }
+
+    if (help == true) {
+        usage();
+        return 0;
+    }
+
+    bool ok = true;
+
+    if (dir != NULL) {
+        struct dirent **entries;
+        int n = scandir(dir, &entries, NULL, alphasort); // sorted, so runs line up
+
+        if (n < 0) {
+            fprintf(stderr, "lzbench: %s: Could not be opened\n", dir);
+            return 1;
+        }
+
+        char path[4096];
+
+        for (int i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+
+            struct stat stats;
+            if (entries[i]->d_name[0] != '.' && stat(path, &stats) == 0 && S_ISREG(stats.st_mode))
+                ok = bench(entries[i]->d_name, path, &settings) && ok;
+
+            free(entries[i]);
+        }
+
+        free(entries);
+    } else if (optind < argc) {
+        for (int i = optind; i < argc; i++)
+            ok = bench(argv[i], NULL, &settings) && ok;
+    } else {
+        for (size_t i = 0; i < sizeof(corpora) / sizeof(corpora[0]); i++)
+            ok = bench(corpora[i], NULL, &settings) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,634 @@
+#include "bits.h"
+#include "block.h"
+#include "code.h"
+#include "dict.h"
+#include "policy.h"
+#include "rans.h"
+#include "trie.h"
+#include "word.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPTIONS "hn:o:k:"
+
+#define DEFAULT_RUNS 5
+#define DEFAULT_OPS  (1 << 20) // Operations timed per run of a kernel.
+#define MIN_WIDTH    2 // Pair code widths swept by the bit packing kernels.
+#define MAX_WIDTH    16
+#define BLOCK_SIZE   (1 << 20) // Symbols per block_encode and block_decode call.
+
+static const uint32_t phrase_lens[] = { 1, 2, 4, 8, 16, 64, 255 };
+
+#define PHRASE_LENS (sizeof(phrase_lens) / sizeof(phrase_lens[0]))
+
+//
+// A kernel sets up its inputs for parameter param, then times runs passes of about ops operations
+// each into times, leaving setup and teardown out of the measurement. It returns the number of
+// operations in each pass, or 0 if it could not allocate its inputs.
+//
+typedef uint64_t (*Kernel)(uint32_t param, uint32_t ops, int runs, double *times);
+
+static volatile uint64_t sink; // results go here so the kernels are not optimized away
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15; // fixed seed, so every run codes the same data
+
+// xorshift64*, good enough for test data and identical everywhere
+static uint64_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * UINT64_C(2685821657736338717);
+}
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Orders doubles for qsort
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Number of phrases of len symbols that fit below MAX_CODE side by side, at most one per symbol
+static uint32_t chains_of(uint32_t len) {
+    uint32_t chains = (MAX_CODE - START_CODE) / len;
+    return chains < 256 ? chains : 256;
+}
+
+// Makes chains phrases of len symbols, each starting with a different symbol
+static uint8_t *make_paths(uint32_t chains, uint32_t len) {
+    uint8_t *path = (uint8_t *) malloc((size_t) chains * len);
+
+    for (uint32_t c = 0; path != NULL && c < chains; c++) {
+        path[c * len] = c;
+        for (uint32_t i = 1; i < len; i++)
+            path[c * len + i] = rng();
+    }
+
+    return path;
+}
+
+// trie_step: walks every phrase of param symbols down a trie holding them, one op per step
+static uint64_t trie_step_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint32_t chains = chains_of(param);
+    uint64_t per_pass = (uint64_t) chains * param;
+    uint64_t passes = (ops + per_pass - 1) / per_pass;
+    uint8_t *path = make_paths(chains, param);
+    TrieNode *root = trie_create();
+    uint32_t code = START_CODE;
+
+    for (uint32_t c = 0; path != NULL && root != NULL && c < chains; c++) {
+        TrieNode *n = root;
+        for (uint32_t i = 0; i < param; i++)
+            n = n->children[path[c * param + i]] = trie_node_create(root, code++);
+    }
+
+    for (int r = 0; path != NULL && root != NULL && r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++) {
+            for (uint32_t c = 0; c < chains; c++) {
+                TrieNode *n = root;
+                for (uint32_t i = 0; i < param; i++)
+                    n = trie_step(n, path[c * param + i]);
+                sink += n->code;
+            }
+        }
+
+        times[r] = now() - start;
+    }
+
+    bool ok = path != NULL && root != NULL;
+    free(path);
+    if (root != NULL)
+        trie_delete(root);
+
+    return ok ? passes * per_pass : 0;
+}
+
+// dict_step: the same walk through the dictionary that replaced the trie, one op per step
+static uint64_t dict_step_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint32_t chains = chains_of(param);
+    uint64_t per_pass = (uint64_t) chains * param;
+    uint64_t passes = (ops + per_pass - 1) / per_pass;
+    uint8_t *path = make_paths(chains, param);
+    Dict *d = dict_create(MAX_CODE);
+    uint32_t code = START_CODE;
+
+    for (uint32_t c = 0; path != NULL && d != NULL && c < chains; c++) {
+        uint32_t prev = EMPTY_CODE;
+        for (uint32_t i = 0; i < param; i++, prev = code++)
+            dict_insert(d, prev, path[c * param + i], code);
+    }
+
+    for (int r = 0; path != NULL && d != NULL && r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++) {
+            for (uint32_t c = 0; c < chains; c++) {
+                uint32_t curr = EMPTY_CODE;
+                for (uint32_t i = 0; i < param; i++)
+                    curr = dict_step(d, curr, path[c * param + i]);
+                sink += curr;
+            }
+        }
+
+        times[r] = now() - start;
+    }
+
+    bool ok = path != NULL && d != NULL;
+    free(path);
+    if (d != NULL)
+        dict_delete(d);
+
+    return ok ? passes * per_pass : 0;
+}
+
+// trie_node_create and trie_reset: fills the codes of a param-bit width, then resets, one op per
+// node
+static uint64_t trie_fill_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint32_t max_code = MAX_CODE_BITS(param);
+    uint64_t per_pass = max_code - START_CODE;
+    uint64_t passes = (ops + per_pass - 1) / per_pass;
+    TrieNode *root = trie_create();
+
+    if (root == NULL)
+        return 0;
+
+    for (int r = 0; r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++) {
+            TrieNode *n = root;
+            for (uint32_t code = START_CODE; code < max_code; code++)
+                n = n->children[code & 0xFF] = trie_node_create(root, code);
+            trie_reset(root);
+        }
+
+        times[r] = now() - start;
+    }
+
+    trie_delete(root);
+    return passes * per_pass;
+}
+
+// dict_insert and dict_reset: the same fill through the dictionary, one op per code
+static uint64_t dict_fill_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint32_t max_code = MAX_CODE_BITS(param);
+    uint64_t per_pass = max_code - START_CODE;
+    uint64_t passes = (ops + per_pass - 1) / per_pass;
+    Dict *d = dict_create(max_code);
+
+    if (d == NULL)
+        return 0;
+
+    for (int r = 0; r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++) {
+            for (uint32_t code = START_CODE; code < max_code; code++)
+                dict_insert(d, code - 1, code & 0xFF, code);
+            dict_reset(d);
+        }
+
+        times[r] = now() - start;
+    }
+
+    dict_delete(d);
+    return passes * per_pass;
+}
+
+// Makes ops random codes of width bits, with the symbol of each pair above it
+static uint64_t *make_pairs(uint32_t bits, uint32_t ops) {
+    uint64_t *pairs = (uint64_t *) malloc((size_t) ops * sizeof(uint64_t));
+
+    for (uint32_t i = 0; pairs != NULL && i < ops; i++)
+        pairs[i] = (rng() & ((UINT64_C(1) << (bits + 8)) - 1));
+
+    return pairs;
+}
+
+// bw_put, which replaced write_pair: packs pairs with param-bit codes, one op per pair
+static uint64_t bw_put_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint64_t *pairs = make_pairs(param, ops);
+    uint8_t *buf = (uint8_t *) malloc(block_bound(ops, param));
+
+    for (int r = 0; pairs != NULL && buf != NULL && r < runs; r++) {
+        BitWriter bw = { 0, 0, 0, buf };
+        double start = now();
+
+        for (uint32_t i = 0; i < ops; i++)
+            bw_put(&bw, pairs[i], param + 8);
+        bw_finish(&bw);
+
+        times[r] = now() - start;
+        sink += bw.pos;
+    }
+
+    bool ok = pairs != NULL && buf != NULL;
+    free(pairs);
+    free(buf);
+    return ok ? ops : 0;
+}
+
+// br_refill and br_get, which replaced read_pair: unpacks pairs with param-bit codes the way
+// block_decode does, one op per pair
+static uint64_t br_get_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint64_t *pairs = make_pairs(param, ops);
+    size_t size = block_bound(ops, param);
+    uint8_t *buf = (uint8_t *) malloc(size);
+    BitWriter bw = { 0, 0, 0, buf };
+
+    for (uint32_t i = 0; pairs != NULL && buf != NULL && i < ops; i++)
+        bw_put(&bw, pairs[i], param + 8);
+    if (buf != NULL)
+        bw_finish(&bw);
+
+    for (int r = 0; pairs != NULL && buf != NULL && r < runs; r++) {
+        BitReader br = { 0, 0, 0, bw.pos, buf };
+        uint64_t sum = 0;
+        double start = now();
+
+        for (uint32_t i = 0; i < ops; i++) {
+            if (br.count < param + 8)
+                br_refill(&br);
+            sum += br_get(&br, param);
+            sum += br_get(&br, 8);
+        }
+
+        times[r] = now() - start;
+        sink += sum;
+    }
+
+    bool ok = pairs != NULL && buf != NULL;
+    free(pairs);
+    free(buf);
+    return ok ? ops : 0;
+}
+
+// Adds chains words of len symbols to wt, returns the code after the last one
+static uint32_t add_words(WordTable *wt, uint32_t chains, uint32_t len) {
+    uint32_t code = START_CODE;
+
+    for (uint32_t c = 0; c < chains; c++) {
+        uint32_t prev = EMPTY_CODE;
+        for (uint32_t i = 0; i < len; i++, prev = code++)
+            wt_add(wt, code, prev, c + i);
+    }
+
+    return code;
+}
+
+// wt_add, which replaced word_append_sym: builds words of param symbols, one op per symbol
+static uint64_t wt_add_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint32_t chains = chains_of(param);
+    uint64_t per_pass = (uint64_t) chains * param;
+    uint64_t passes = (ops + per_pass - 1) / per_pass;
+    WordTable *wt = wt_create(MAX_CODE);
+
+    if (wt == NULL)
+        return 0;
+
+    for (int r = 0; r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++) {
+            sink += add_words(wt, chains, param);
+            wt_reset(wt);
+        }
+
+        times[r] = now() - start;
+    }
+
+    wt_delete(wt);
+    return passes * per_pass;
+}
+
+// wt_copy, which replaced write_word: writes out words of param symbols, one op per symbol
+static uint64_t wt_copy_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint32_t chains = chains_of(param);
+    uint64_t per_pass = (uint64_t) chains * param;
+    uint64_t passes = (ops + per_pass - 1) / per_pass;
+    WordTable *wt = wt_create(MAX_CODE);
+    uint8_t *out = (uint8_t *) malloc(per_pass);
+
+    if (wt != NULL)
+        add_words(wt, chains, param);
+
+    for (int r = 0; wt != NULL && out != NULL && r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++) {
+            uint8_t *o = out;
+            for (uint32_t c = 0; c < chains; c++)
+                o += wt_copy(wt, START_CODE + (c + 1) * param - 1, o);
+            sink += out[p % per_pass];
+        }
+
+        times[r] = now() - start;
+    }
+
+    bool ok = wt != NULL && out != NULL;
+    if (wt != NULL)
+        wt_delete(wt);
+    free(out);
+    return ok ? passes * per_pass : 0;
+}
+
+// Makes n symbols from a 16-letter alphabet, which codes into phrases of a few symbols
+static uint8_t *make_syms(uint32_t n) {
+    uint8_t *syms = (uint8_t *) malloc(n);
+
+    for (uint32_t i = 0; syms != NULL && i < n; i++)
+        syms[i] = 'a' + rng() % 16;
+
+    return syms;
+}
+
+// block_encode, the whole encoder loop that took over from read_sym, with a maximum code width of
+// param and the symbols entropy coded if entropy is set, one op per symbol
+static uint64_t time_block_encode(
+    uint32_t param, bool entropy, uint32_t ops, int runs, double *times) {
+    uint64_t passes = (ops + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint8_t *syms = make_syms(BLOCK_SIZE);
+    uint8_t *packed = (uint8_t *) malloc(block_bound(BLOCK_SIZE, param));
+    uint8_t *split = entropy ? (uint8_t *) malloc(BLOCK_SIZE) : NULL;
+    Dict *d = dict_create(MAX_CODE_BITS(param));
+    bool ok = syms != NULL && packed != NULL && (!entropy || split != NULL) && d != NULL;
+
+    for (int r = 0; ok && r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++)
+            sink += block_encode(d, param, POLICY_RESET, false, syms, BLOCK_SIZE, packed, split);
+
+        times[r] = now() - start;
+    }
+
+    free(syms);
+    free(packed);
+    free(split);
+    if (d != NULL)
+        dict_delete(d);
+
+    return ok ? passes * BLOCK_SIZE : 0;
+}
+
+// block_decode, the whole decoder loop, with a maximum code width of param and the symbols entropy
+// coded if entropy is set, one op per symbol
+static uint64_t time_block_decode(
+    uint32_t param, bool entropy, uint32_t ops, int runs, double *times) {
+    uint64_t passes = (ops + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint8_t *syms = make_syms(BLOCK_SIZE);
+    uint8_t *packed = (uint8_t *) malloc(block_bound(BLOCK_SIZE, param));
+    uint8_t *split = entropy ? (uint8_t *) malloc(BLOCK_SIZE) : NULL;
+    uint8_t *out = (uint8_t *) malloc(BLOCK_SIZE);
+    Dict *d = dict_create(MAX_CODE_BITS(param));
+    WordTable *wt = wt_create(MAX_CODE_BITS(param));
+    bool ok = syms != NULL && packed != NULL && (!entropy || split != NULL) && out != NULL
+              && d != NULL && wt != NULL;
+    uint32_t size
+        = ok ? block_encode(d, param, POLICY_RESET, false, syms, BLOCK_SIZE, packed, split) : 0;
+
+    for (int r = 0; ok && r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++)
+            ok = block_decode(
+                     wt, param, POLICY_RESET, false, entropy, packed, size, out, BLOCK_SIZE)
+                     == BLOCK_SIZE
+                 && ok;
+
+        times[r] = now() - start;
+    }
+
+    ok = ok && memcmp(out, syms, BLOCK_SIZE) == 0;
+    free(syms);
+    free(packed);
+    free(split);
+    free(out);
+    if (d != NULL)
+        dict_delete(d);
+    if (wt != NULL)
+        wt_delete(wt);
+
+    return ok ? passes * BLOCK_SIZE : 0;
+}
+
+// block_encode with pairs
+static uint64_t block_encode_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    return time_block_encode(param, false, ops, runs, times);
+}
+
+// block_decode with pairs
+static uint64_t block_decode_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    return time_block_decode(param, false, ops, runs, times);
+}
+
+// block_encode with the symbols rANS coded
+static uint64_t block_encode_entropy_kernel(
+    uint32_t param, uint32_t ops, int runs, double *times) {
+    return time_block_encode(param, true, ops, runs, times);
+}
+
+// block_decode with the symbols rANS coded
+static uint64_t block_decode_entropy_kernel(
+    uint32_t param, uint32_t ops, int runs, double *times) {
+    return time_block_decode(param, true, ops, runs, times);
+}
+
+// rans_decode alone, on symbols drawn from 2^param equally likely values, all 256 from 8 bits up,
+// one op per symbol
+static uint64_t rans_decode_kernel(uint32_t param, uint32_t ops, int runs, double *times) {
+    uint64_t passes = (ops + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t values = param < 8 ? UINT32_C(1) << param : 256;
+    uint8_t *syms = (uint8_t *) malloc(BLOCK_SIZE);
+    uint8_t *coded = (uint8_t *) malloc(2 * BLOCK_SIZE);
+    uint8_t *out = (uint8_t *) malloc(BLOCK_SIZE);
+    bool ok = syms != NULL && coded != NULL && out != NULL;
+
+    for (uint32_t i = 0; ok && i < BLOCK_SIZE; i++)
+        syms[i] = (uint8_t) (rng() % values);
+
+    size_t size = ok ? rans_encode(syms, BLOCK_SIZE, coded, 2 * BLOCK_SIZE) : 0;
+    ok = ok && size > 0;
+
+    for (int r = 0; ok && r < runs; r++) {
+        double start = now();
+
+        for (uint64_t p = 0; p < passes; p++)
+            ok = rans_decode(coded, size, out, BLOCK_SIZE) && ok;
+
+        times[r] = now() - start;
+    }
+
+    ok = ok && memcmp(out, syms, BLOCK_SIZE) == 0;
+    free(syms);
+    free(coded);
+    free(out);
+
+    return ok ? passes * BLOCK_SIZE : 0;
+}
+
+// What a kernel sweeps: pair code widths, phrase lengths, or maximum code widths
+typedef enum Sweep { WIDTHS, LENGTHS, MAX_WIDTHS } Sweep;
+
+static const struct {
+    const char *name;
+    Kernel kernel;
+    Sweep sweep;
+} kernels[] = {
+    { "trie_step", trie_step_kernel, LENGTHS },
+    { "dict_step", dict_step_kernel, LENGTHS },
+    { "trie_node_create", trie_fill_kernel, WIDTHS },
+    { "dict_insert", dict_fill_kernel, WIDTHS },
+    { "bw_put", bw_put_kernel, WIDTHS },
+    { "br_get", br_get_kernel, WIDTHS },
+    { "wt_add", wt_add_kernel, LENGTHS },
+    { "wt_copy", wt_copy_kernel, LENGTHS },
+    { "block_encode", block_encode_kernel, MAX_WIDTHS },
+    { "block_decode", block_decode_kernel, MAX_WIDTHS },
+    { "block_encode_entropy", block_encode_entropy_kernel, MAX_WIDTHS },
+    { "block_decode_entropy", block_decode_entropy_kernel, MAX_WIDTHS },
+    { "rans_decode", rans_decode_kernel, WIDTHS },
+};
+
+#define KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+// Runs kernel k with param and prints the best and median pass as a line of JSON
+static bool measure(size_t k, uint32_t param, uint32_t ops, int runs) {
+    double *times = (double *) malloc(runs * sizeof(double));
+    uint64_t done = times != NULL ? kernels[k].kernel(param, ops, runs, times) : 0;
+
+    if (done == 0) {
+        fprintf(stderr, "microbench: %s: Could not be run\n", kernels[k].name);
+        free(times);
+        return false;
+    }
+
+    qsort(times, runs, sizeof(double), compare_doubles);
+
+    printf("{\"kernel\":\"%s\",\"%s\":%u,\"ops\":%llu,\"ns_per_op_min\":%.3f,"
+           "\"ns_per_op_p50\":%.3f,\"mops\":%.2f,\"runs\":%d}\n",
+        kernels[k].name, kernels[k].sweep == LENGTHS ? "phrase_len" : "bits", param,
+        (unsigned long long) done, times[0] * 1e9 / done, times[runs / 2] * 1e9 / done,
+        done / times[0] / 1e6, runs);
+    fflush(stdout);
+
+    free(times);
+    return true;
+}
+
+// Prints usage
+static void usage(void) {
+    printf("SYNOPSIS\n"
+           "    Times the hot kernels of the codec one at a time on synthetic inputs, sweeping\n"
+           "    pair code widths from %d to %d, phrase lengths, and maximum code widths. Prints\n"
+           "    one line of JSON per kernel and parameter.\n"
+           "\n"
+           "USAGE\n"
+           "    ./microbench [-h] [-n runs] [-o ops] [-k kernel]\n"
+           "\n"
+           "OPTIONS\n"
+           "    -h          Display program help and usage.\n"
+           "    -n runs     Timed passes per kernel and parameter, best and median are kept"
+           " (default: %d).\n"
+           "    -o ops      Operations per pass (default: %d).\n"
+           "    -k kernel   Only run this kernel:",
+        MIN_WIDTH, MAX_WIDTH, DEFAULT_RUNS, DEFAULT_OPS);
+
+    for (size_t k = 0; k < KERNELS; k++)
+        printf(" %s", kernels[k].name);
+    printf(".\n");
+}
+
+int main(int argc, char **argv) {
+    int runs = DEFAULT_RUNS;
+    long ops = DEFAULT_OPS;
+    const char *only = NULL;
+    bool help = false;
+    int opt = 0;
+    int optInd = optind + 1;
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'h': {
+            help = true;
+            break;
+        }
+
+        case 'n': {
+            runs = atoi(argv[optInd]);
+            if (runs < 1)
+                help = true;
+            break;
+        }
+
+        case 'o': {
+            ops = atol(argv[optInd]);
+            if (ops < 1 || ops > (1 << 28))
+                help = true;
+            break;
+        }
+
+        case 'k': {
+            only = argv[optInd];
+            break;
+        }
+
+        default: {
+            help = true;
+            break;
+        }
+        }
+        optInd = optind + 1;
+    }
+
+    if (help == true) {
+        usage();
+        return 0;
+    }
+
+    bool ok = true, found = false;
+
+    for (size_t k = 0; k < KERNELS; k++) {
+        if (only != NULL && strcmp(only, kernels[k].name) != 0)
+            continue;
+        found = true;
+
+        switch (kernels[k].sweep) {
+        case WIDTHS: {
+            for (uint32_t bits = MIN_WIDTH; bits <= MAX_WIDTH; bits++)
+                ok = measure(k, bits, ops, runs) && ok;
+            break;
+        }
+
+        case LENGTHS: {
+            for (size_t i = 0; i < PHRASE_LENS; i++)
+                ok = measure(k, phrase_lens[i], ops, runs) && ok;
+            break;
+        }
+
+        case MAX_WIDTHS: {
+            for (uint32_t bits = MIN_BITS; bits <= DEFAULT_BITS; bits++)
+                ok = measure(k, bits, ops, runs) && ok;
+            break;
+        }
+        }
+    }
+
+    if (!found) {
+        usage();
+        return 1;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+#include "perf.h"
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CACHE_EVENT(cache, result) ((cache) | PERF_COUNT_HW_CACHE_OP_READ << 8 | (result) << 16)
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} events[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1d-misses", PERF_TYPE_HW_CACHE,
+        CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "LLC-misses", PERF_TYPE_HW_CACHE,
+        CACHE_EVENT(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "dTLB-misses", PERF_TYPE_HW_CACHE,
+        CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+};
+
+#define EVENTS (sizeof(events) / sizeof(events[0]))
+
+struct Perf {
+    int fds[EVENTS]; // -1 for events that could not be opened
+};
+
+// Opens one counter for the calling thread and the threads it starts, disabled
+static int open_event(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1; // chunk workers are started after this
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Constructor for Perf
+Perf *perf_start(void) {
+    Perf *p = (Perf *) malloc(sizeof(Perf));
+    int opened = 0;
+
+    if (p == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < EVENTS; i++) {
+        p->fds[i] = open_event(events[i].type, events[i].config);
+        opened += p->fds[i] != -1;
+    }
+
+    if (opened == 0) {
+        free(p);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < EVENTS; i++)
+        if (p->fds[i] != -1)
+            ioctl(p->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+
+    return p;
+}
+
+// Stops every counter
+void perf_stop(Perf *p) {
+    for (size_t i = 0; i < EVENTS; i++)
+        if (p->fds[i] != -1)
+            ioctl(p->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+}
+
+// Prints the counters in total and per MB
+void perf_print(Perf *p, FILE *out, uint64_t bytes) {
+    double mb = bytes / 1e6;
+
+    for (size_t i = 0; i < EVENTS; i++) {
+        uint64_t values[3]; // value, time enabled, time running
+
+        if (p->fds[i] == -1 || read(p->fds[i], values, sizeof(values)) != sizeof(values)) {
+            fprintf(out, "%s: not available\n", events[i].name);
+            continue;
+        }
+
+        // multiplexed counters only ran part of the time
+        double value = values[0];
+        if (values[2] > 0 && values[2] < values[1])
+            value *= (double) values[1] / values[2];
+
+        fprintf(out, "%s: %.0f (%.0f per MB)\n", events[i].name, value, mb > 0 ? value / mb : 0.0);
+    }
+}
+
+// Destructor for Perf
+void perf_delete(Perf *p) {
+    for (size_t i = 0; i < EVENTS; i++)
+        if (p->fds[i] != -1)
+            close(p->fds[i]);
+
+    free(p);
+}
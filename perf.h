@@ -0,0 +1,40 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Hardware performance counters around a stretch of code, through perf_event_open.
+//
+// Every event is opened on its own, so one the CPU or the hypervisor does not offer is simply
+// left out instead of failing the whole set. Only user space is counted, which is all that
+// perf_event_paranoid allows unprivileged processes by default, and threads started after
+// perf_start are counted along with the calling one.
+//
+
+typedef struct Perf Perf;
+
+/*
+ * Constructor: Opens and starts every counter available
+ * Returns the counters, NULL if none could be opened
+ */
+Perf *perf_start(void);
+
+/*
+ * Stops the counters
+ */
+void perf_stop(Perf *p);
+
+/*
+ * Prints every counter in total and per MB of bytes, scaled up if the kernel had to share the
+ * hardware between more events than it has counters
+ */
+void perf_print(Perf *p, FILE *out, uint64_t bytes);
+
+/*
+ * Destructor: Closes the counters
+ */
+void perf_delete(Perf *p);
+
+#endif
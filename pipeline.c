@@ -0,0 +1,508 @@
+#include "pipeline.h"
+#include "io.h"
+#include "stats.h"
+#include "uring.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define URING_ENTRIES (2 * PIPE_SLOTS) // Room for a request per slot, and then some.
+
+// Buffers passed in order from a producer thread to a consumer thread and back
+typedef struct Ring {
+    uint8_t *bufs[PIPE_SLOTS];
+    size_t size; // bytes in each buffer
+    size_t sizes[PIPE_SLOTS]; // bytes filled in each buffer
+
+    // slot i % PIPE_SLOTS is free once released > i, full once produced > i and being consumed
+    // once consumed > i
+    uint64_t produced, consumed, released;
+    bool finished; // the producer is done, nothing is produced after the current last slot
+    bool stopped; // the consumer is done, the producer gives up
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // signalled whenever any of the above changes
+} Ring;
+
+struct PipeReader {
+    Ring ring;
+    int infile;
+    bool taken; // a buffer is held by the coder
+    int error; // errno of the read that ended the last buffer early, 0 if the file ended there
+    pthread_t thread;
+    IoCounters io; // counted on the thread, handed over when it stops
+};
+
+struct PipeWriter {
+    Ring ring;
+    int outfile;
+    int error; // errno of the first write that failed, 0 if none did
+    pthread_t thread;
+    IoCounters io;
+};
+
+// Allocates the buffers of a ring, aligned for O_DIRECT, returns false if memory ran out
+static bool ring_init(Ring *r, size_t size) {
+    bool ok = true;
+
+    r->size = size;
+    for (int i = 0; i < PIPE_SLOTS; i++) {
+        r->bufs[i] = alloc_buffer(size);
+        ok = ok && r->bufs[i] != NULL;
+    }
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->changed, NULL);
+    return ok;
+}
+
+// Frees the buffers of a ring
+static void ring_free(Ring *r) {
+    for (int i = 0; i < PIPE_SLOTS; i++)
+        free(r->bufs[i]);
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->changed);
+}
+
+// Producer: returns the buffer of slot seq, at or after the next one to push, once it is free,
+// waiting for it only if wait is set
+// Returns NULL if it is still in use, or once the consumer has stopped
+static uint8_t *ring_slot(Ring *r, uint64_t seq, bool wait) {
+    pthread_mutex_lock(&r->lock);
+
+    while (wait && seq - r->released >= PIPE_SLOTS && !r->stopped)
+        pthread_cond_wait(&r->changed, &r->lock);
+
+    bool free = seq - r->released < PIPE_SLOTS && !r->stopped;
+    uint8_t *buf = free ? r->bufs[seq % PIPE_SLOTS] : NULL;
+    pthread_mutex_unlock(&r->lock);
+    return buf;
+}
+
+// Producer: waits for the next free slot, returns its buffer, or NULL once the consumer has stopped
+static uint8_t *ring_produce(Ring *r) {
+    return ring_slot(r, r->produced, true); // produced only moves on this thread
+}
+
+// Producer: hands the slot returned by ring_produce over with n bytes in it
+static void ring_push(Ring *r, size_t n, bool last) {
+    pthread_mutex_lock(&r->lock);
+    r->sizes[r->produced % PIPE_SLOTS] = n;
+    r->produced++;
+    r->finished = last;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Producer: ends the ring after the slots pushed so far
+static void ring_finish(Ring *r) {
+    pthread_mutex_lock(&r->lock);
+    r->finished = true;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Consumer: takes the next full slot, waiting for one only if wait is set
+// Returns false if there is none, *last is set if no slot will follow the one taken, or the ones
+// taken before if there was none
+static bool ring_take(Ring *r, bool wait, uint8_t **buf, size_t *n, bool *last) {
+    pthread_mutex_lock(&r->lock);
+
+    while (wait && r->consumed == r->produced && !r->finished)
+        pthread_cond_wait(&r->changed, &r->lock);
+
+    bool ok = r->consumed < r->produced;
+    if (ok) {
+        *buf = r->bufs[r->consumed % PIPE_SLOTS];
+        *n = r->sizes[r->consumed % PIPE_SLOTS];
+        r->consumed++;
+    }
+
+    *last = r->finished && r->consumed == r->produced;
+
+    pthread_mutex_unlock(&r->lock);
+    return ok;
+}
+
+// Consumer: gives the oldest slot taken back to the producer
+static void ring_release(Ring *r) {
+    pthread_mutex_lock(&r->lock);
+    r->released++;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Consumer: tells the producer to give up
+static void ring_stop(Ring *r) {
+    pthread_mutex_lock(&r->lock);
+    r->stopped = true;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+}
+
+// Sets up an io_uring over the buffers of a ring for fd, if fd is a regular file and the kernel
+// lets us, and stores the offset fd is at in *offset
+// Pipes and terminals are left to read() and write(), which take their bytes in order
+static Uring *ring_uring(Ring *r, int fd, uint64_t *offset) {
+    struct stat st;
+    off_t pos;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (pos = lseek(fd, 0, SEEK_CUR)) < 0)
+        return NULL;
+
+    *offset = (uint64_t) pos;
+    return uring_create(URING_ENTRIES, r->bufs, PIPE_SLOTS, r->size);
+}
+
+// Reader thread with read(): fills buffers one after the other until the file ends or the coder
+// stops
+static void read_blocking(PipeReader *pr) {
+    uint8_t *buf;
+
+    while ((buf = ring_produce(&pr->ring)) != NULL) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        int n = read_bytes(pr->infile, buf, pr->ring.size);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        // read_bytes only comes up short at end of file, or when it fails
+        if (n < 0)
+            pr->error = errno;
+
+        bool last = n < (int) pr->ring.size;
+        ring_push(&pr->ring, n > 0 ? n : 0, last);
+        if (last)
+            break;
+    }
+}
+
+// Reader thread with io_uring: keeps a read in flight into every free slot, and pushes the slots in
+// file order as their reads complete, in whatever order that is
+static void read_uring(PipeReader *pr, Uring *u, uint64_t start) {
+    Ring *r = &pr->ring;
+    size_t size = r->size;
+    size_t filled[PIPE_SLOTS] = { 0 };
+    bool done[PIPE_SLOTS] = { false };
+    bool refused[PIPE_SLOTS]; // a read into the slot came back with EINVAL
+    int errors[PIPE_SLOTS]; // errno of the read that ended the slot early, 0 if none
+    uint64_t queued = 0, pushed = 0; // slots given a read, and handed over to the coder
+    uint64_t last = UINT64_MAX; // first slot that came back short, where the file ends
+    uint64_t total = 0; // bytes read
+    unsigned inflight = 0;
+    uint8_t *buf;
+
+    for (;;) {
+        // a slot is only waited for when there is nothing else to wait for
+        while (queued <= last && pr->error == 0
+               && (buf = ring_slot(r, queued, inflight == 0)) != NULL) {
+            filled[queued % PIPE_SLOTS] = 0;
+            refused[queued % PIPE_SLOTS] = false;
+
+            // never with a request per slot, but a read that is not in flight must not be waited
+            // for, so nothing from this slot on is pushed
+            if (!uring_read(
+                    u, pr->infile, queued % PIPE_SLOTS, buf, size, start + queued * size, queued)) {
+                pr->error = EBUSY;
+                break;
+            }
+
+            queued++;
+            inflight++;
+        }
+
+        uint64_t seq;
+        int res;
+        if (inflight == 0) // the file ended, the coder stopped, or a read could not be queued
+            break;
+
+        if (!uring_wait(u, &seq, &res)) { // the reads in flight are lost
+            pr->error = errno;
+            break;
+        }
+
+        inflight--;
+        int slot = seq % PIPE_SLOTS;
+        if (res > 0) {
+            filled[slot] += res;
+            total += res;
+        }
+
+        // O_DIRECT refuses reads that are not whole aligned blocks, such as the one after the last
+        // whole block, which are made once more through the page cache
+        bool again = res == -EINVAL && !refused[slot];
+        if (again) {
+            refused[slot] = true;
+            clear_direct(pr->infile);
+        }
+
+        // a short read is only the end of the file when nothing more comes after it
+        if ((res > 0 && filled[slot] < size) || again) {
+            if (uring_read(u, pr->infile, slot, r->bufs[slot] + filled[slot],
+                    size - filled[slot], start + seq * size + filled[slot], seq)) {
+                inflight++;
+                continue;
+            }
+
+            res = -EBUSY;
+        }
+
+        // a read that failed ends the file early, which only matters if the file goes on after it
+        done[slot] = true;
+        errors[slot] = res < 0 ? -res : 0;
+        if (filled[slot] < size && seq < last)
+            last = seq;
+
+        for (; pushed <= last && pushed < queued && done[pushed % PIPE_SLOTS]; pushed++) {
+            done[pushed % PIPE_SLOTS] = false;
+            if (pushed == last)
+                pr->error = errors[pushed % PIPE_SLOTS];
+            ring_push(r, filled[pushed % PIPE_SLOTS], pushed == last);
+        }
+    }
+
+    ring_finish(r); // after an error, the coder sees it along with the last buffer pushed
+    lseek(pr->infile, (off_t) (start + total), SEEK_SET); // where read() would have left it
+    STAT_ADD(io_counters.bytes_read, total);
+}
+
+// Reader thread: fills buffers until the file ends or the coder stops
+static void *reader_main(void *arg) {
+    PipeReader *pr = (PipeReader *) arg;
+    uint64_t start;
+
+    // only a blocked read can be cancelled, never a wait holding the lock of the ring
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    Uring *u = ring_uring(&pr->ring, pr->infile, &start);
+    if (u != NULL) {
+        read_uring(pr, u, start);
+        uring_delete(u);
+    } else {
+        read_blocking(pr);
+    }
+
+    pr->io = io_counters;
+    return NULL;
+}
+
+// Constructor for PipeReader
+PipeReader *pipe_reader_create(int infile, size_t size) {
+    PipeReader *pr = (PipeReader *) calloc(1, sizeof(PipeReader));
+
+    if (pr == NULL)
+        return NULL;
+
+    pr->infile = infile;
+
+    if (!ring_init(&pr->ring, size) || pthread_create(&pr->thread, NULL, reader_main, pr) != 0) {
+        ring_free(&pr->ring);
+        free(pr);
+        return NULL;
+    }
+
+    return pr;
+}
+
+// Takes the next buffer read, giving the previous one back
+int pipe_reader_next(PipeReader *pr, const uint8_t **data, size_t *n) {
+    uint8_t *buf = NULL;
+    bool last;
+
+    if (pr->taken)
+        ring_release(&pr->ring);
+
+    pr->taken = ring_take(&pr->ring, true, &buf, n, &last);
+    if (!pr->taken) // asked again after the last buffer
+        *n = 0;
+
+    *data = buf;
+
+    // the error is set before the last buffer is pushed, which ring_take synchronizes with
+    if (last && pr->error != 0) {
+        errno = pr->error;
+        return -1;
+    }
+
+    return last;
+}
+
+// Destructor for PipeReader
+void pipe_reader_delete(PipeReader *pr) {
+    ring_stop(&pr->ring);
+    pthread_cancel(pr->thread);
+    pthread_join(pr->thread, NULL);
+
+    io_counters_add(&io_counters, &pr->io);
+    ring_free(&pr->ring);
+    free(pr);
+}
+
+// Writer thread: records the first write that failed and stops taking buffers, which makes the
+// coder give up too rather than fill buffers that are never written
+static void writer_fail(PipeWriter *pw, int error) {
+    if (pw->error == 0)
+        pw->error = error;
+    ring_stop(&pw->ring);
+}
+
+// Writer thread with write(): writes buffers out one after the other until the coder is done
+static void write_blocking(PipeWriter *pw) {
+    uint8_t *buf;
+    size_t n;
+    bool last;
+
+    while (ring_take(&pw->ring, true, &buf, &n, &last)) {
+        int written = write_bytes(pw->outfile, buf, n);
+        if (written != (int) n) {
+            writer_fail(pw, written < 0 ? errno : EIO);
+            return;
+        }
+
+        ring_release(&pw->ring);
+    }
+}
+
+// Writer thread with io_uring: keeps a write in flight from every full slot, and gives the slots
+// back in order as their writes complete, in whatever order that is
+static void write_uring(PipeWriter *pw, Uring *u, uint64_t start) {
+    Ring *r = &pw->ring;
+    size_t sizes[PIPE_SLOTS], written[PIPE_SLOTS];
+    uint64_t offsets[PIPE_SLOTS];
+    bool refused[PIPE_SLOTS]; // a write from the slot came back with EINVAL
+    bool done[PIPE_SLOTS] = { false };
+    uint64_t taken = 0, released = 0, offset = start;
+    unsigned inflight = 0;
+    uint8_t *buf;
+    size_t n;
+    bool last;
+
+    for (;;) {
+        // a full slot is only waited for when there is nothing else to wait for
+        while (pw->error == 0 && ring_take(r, inflight == 0, &buf, &n, &last)) {
+            int slot = taken % PIPE_SLOTS;
+            sizes[slot] = n;
+            written[slot] = 0;
+            offsets[slot] = offset;
+            refused[slot] = false;
+
+            // never with a request per slot, but a write that is not in flight is lost
+            if (!uring_write(u, pw->outfile, slot, buf, n, offset, taken)) {
+                writer_fail(pw, EBUSY);
+                break;
+            }
+
+            offset += n;
+            taken++;
+            inflight++;
+        }
+
+        uint64_t seq;
+        int res;
+        if (inflight == 0) // the coder is done, or a write failed and the rest have completed
+            break;
+
+        if (!uring_wait(u, &seq, &res)) { // the writes in flight are lost
+            writer_fail(pw, errno);
+            break;
+        }
+
+        inflight--;
+        int slot = seq % PIPE_SLOTS;
+        if (res > 0) {
+            written[slot] += res;
+            STAT_ADD(io_counters.bytes_written, res);
+        }
+
+        // like in write_bytes, the unaligned tail O_DIRECT refuses goes through the page cache
+        bool again = res == -EINVAL && !refused[slot];
+        if (again) {
+            refused[slot] = true;
+            clear_direct(pw->outfile);
+        }
+
+        // a short write goes on with the rest of its buffer
+        if ((res > 0 && written[slot] < sizes[slot]) || again) {
+            if (uring_write(u, pw->outfile, slot, r->bufs[slot] + written[slot],
+                    sizes[slot] - written[slot], offsets[slot] + written[slot], seq)) {
+                inflight++;
+                continue;
+            }
+
+            res = -EBUSY;
+        }
+
+        // a write that failed or moved nothing loses the rest of its buffer, and the output
+        if (written[slot] < sizes[slot])
+            writer_fail(pw, res < 0 ? -res : EIO);
+
+        done[slot] = true;
+        for (; released < taken && done[released % PIPE_SLOTS]; released++) {
+            done[released % PIPE_SLOTS] = false;
+            ring_release(r);
+        }
+    }
+
+    lseek(pw->outfile, (off_t) offset, SEEK_SET); // where write() would have left it
+}
+
+// Writer thread: writes buffers out in order until the coder is done
+static void *writer_main(void *arg) {
+    PipeWriter *pw = (PipeWriter *) arg;
+    uint64_t start;
+
+    Uring *u = ring_uring(&pw->ring, pw->outfile, &start);
+    if (u != NULL) {
+        write_uring(pw, u, start);
+        uring_delete(u);
+    } else {
+        write_blocking(pw);
+    }
+
+    pw->io = io_counters;
+    return NULL;
+}
+
+// Constructor for PipeWriter
+PipeWriter *pipe_writer_create(int outfile, size_t size) {
+    PipeWriter *pw = (PipeWriter *) calloc(1, sizeof(PipeWriter));
+
+    if (pw == NULL)
+        return NULL;
+
+    pw->outfile = outfile;
+
+    if (!ring_init(&pw->ring, size) || pthread_create(&pw->thread, NULL, writer_main, pw) != 0) {
+        ring_free(&pw->ring);
+        free(pw);
+        return NULL;
+    }
+
+    return pw;
+}
+
+// Returns the next free buffer, NULL once the writer has failed
+uint8_t *pipe_writer_buffer(PipeWriter *pw) {
+    return ring_produce(&pw->ring);
+}
+
+// Queues the buffer to be written out
+void pipe_writer_commit(PipeWriter *pw, size_t n) {
+    ring_push(&pw->ring, n, false);
+}
+
+// Destructor for PipeWriter
+bool pipe_writer_delete(PipeWriter *pw) {
+    ring_finish(&pw->ring);
+    pthread_join(pw->thread, NULL);
+
+    int error = pw->error; // only set on the thread just joined
+    io_counters_add(&io_counters, &pw->io);
+    ring_free(&pw->ring);
+    free(pw);
+
+    if (error != 0)
+        errno = error;
+    return error == 0;
+}
@@ -0,0 +1,78 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Reader and writer threads for encode and decode, so that file I/O overlaps with coding.
+//
+// Each one shares a ring of PIPE_SLOTS buffers, of PIPE_BUFFER bytes by default, with the thread
+// doing the coding. A PipeReader reads its file into free buffers ahead of the coder, which takes
+// them in file order and hands each one back when it asks for the next. A PipeWriter takes the
+// buffers the coder has filled and writes them out in order while the coder fills the next free
+// one. Neither side waits unless the ring is full or empty, so a read() or write() that stalls for
+// milliseconds on a network volume is hidden behind the coding of the buffers around it.
+//
+// Regular files are read and written through an io_uring where the kernel has one, see uring.h,
+// with a request in flight on every buffer that is free to fill or waiting to be written.
+//
+
+#define PIPE_SLOTS  4 // Buffers in each ring.
+#define PIPE_BUFFER (1 << 20) // Default bytes in each buffer, read or written with a single call.
+
+typedef struct PipeReader PipeReader;
+
+typedef struct PipeWriter PipeWriter;
+
+/*
+ * Constructor: Starts a thread reading infile from where it is now until it ends, size bytes at a
+ * time, a multiple of BLOCK for O_DIRECT
+ * Returns the new reader, NULL if memory ran out or the thread could not be started
+ */
+PipeReader *pipe_reader_create(int infile, size_t size);
+
+/*
+ * Hands the buffer taken by the previous call back to the reader and takes the next one, waiting
+ * for it to be read if need be
+ * Returns 1 if it is the last one, which ends where infile does, 0 if more follow, or -1 with
+ * errno set if reading infile failed before its end, after which nothing more comes
+ */
+int pipe_reader_next(PipeReader *pr, const uint8_t **data, size_t *n);
+
+/*
+ * Destructor: Stops the thread, even in the middle of a read, and frees the reader
+ * infile stays open
+ */
+void pipe_reader_delete(PipeReader *pr);
+
+/*
+ * Constructor: Starts a thread writing buffers of size bytes out to outfile, a multiple of BLOCK
+ * for O_DIRECT
+ * Returns the new writer, NULL if memory ran out or the thread could not be started
+ */
+PipeWriter *pipe_writer_create(int outfile, size_t size);
+
+/*
+ * Returns a free buffer of the size given to pipe_writer_create to fill, waiting for one to be
+ * written out if need be
+ * Returns NULL once a write has failed, which pipe_writer_delete reports
+ */
+uint8_t *pipe_writer_buffer(PipeWriter *pw);
+
+/*
+ * Queues the first n bytes of the buffer returned by the last call to pipe_writer_buffer to be
+ * written out
+ */
+void pipe_writer_commit(PipeWriter *pw, size_t n);
+
+/*
+ * Destructor: Waits for every queued buffer to be written out, then stops the thread and frees
+ * the writer
+ * outfile stays open
+ * Returns false with errno set if any write failed
+ */
+bool pipe_writer_delete(PipeWriter *pw);
+
+#endif
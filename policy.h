@@ -0,0 +1,94 @@
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include "code.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// What the encoder and decoder do once the dictionary is full, recorded in the FileHeader flags.
+//
+// POLICY_RESET starts over with an empty dictionary, as every file without a policy did.
+// POLICY_FREEZE keeps the full dictionary for the rest of the stream or chunk: phrases are still
+// coded as (code, symbol) pairs, but nothing new is added. POLICY_ADAPTIVE freezes as well, then
+// watches the compression ratio window by window and clears the dictionary once it stops doing
+// better than it did while filling up, or does clearly worse than it has since, telling the
+// decoder with a CLEAR_CODE in place of a pair. CLEAR_CODE is reserved in adaptive streams only,
+// so their phrase codes start one higher.
+//
+// POLICY_LRU never drops the whole dictionary: once it is full, each new phrase takes over the
+// code of the least recently used phrase that no other phrase extends, in the order encoder and
+// decoder both keep in an Lru.
+//
+#define POLICY_RESET    0
+#define POLICY_FREEZE   1
+#define POLICY_ADAPTIVE 2
+#define POLICY_LRU      3
+
+#define FIRST_CODE(policy) ((policy) == POLICY_ADAPTIVE ? CLEAR_CODE + 1 : START_CODE)
+
+#define CLEAR_WINDOW (1 << 15) // Symbols coded between two looks at the ratio.
+
+//
+// Ratio of the dictionary, from when it was last cleared, one window of at least CLEAR_WINDOW
+// symbols at a time once it is full.
+//
+typedef struct Monitor {
+    uint64_t start; // Position of the first symbol of the window.
+    uint64_t bits; // Bits written in the window.
+    uint64_t fill; // Bits per 1024 symbols while the dictionary filled up.
+    uint64_t best; // Lowest bits per 1024 symbols since the dictionary was cleared.
+} Monitor;
+
+//
+// Start watching a dictionary that was cleared at symbol position pos.
+//
+static inline void monitor_start(Monitor *m, uint64_t pos) {
+    m->start = pos;
+    m->bits = 0;
+    m->fill = UINT64_MAX;
+    m->best = UINT64_MAX;
+}
+
+//
+// Count a pair of n bits written while the dictionary is filling up.
+//
+static inline void monitor_count(Monitor *m, uint32_t n) {
+    m->bits += n;
+}
+
+//
+// The dictionary filled up at symbol position pos. What it achieved while filling is roughly what
+// a cleared one would achieve again, so the frozen windows have to beat it.
+//
+static inline void monitor_full(Monitor *m, uint64_t pos) {
+    if (pos > m->start)
+        m->fill = m->best = (m->bits << 10) / (pos - m->start);
+
+    m->start = pos;
+    m->bits = 0;
+}
+
+//
+// Count a pair of n bits ending at symbol position pos in a full dictionary. Return true if the
+// window it closes coded no better than the dictionary did while filling up, or more than an
+// eighth worse than the best window, either of which means the dictionary should be cleared.
+//
+static inline bool monitor_pair(Monitor *m, uint64_t pos, uint32_t n) {
+    m->bits += n;
+
+    if (pos - m->start < CLEAR_WINDOW)
+        return false;
+
+    uint64_t rate = (m->bits << 10) / (pos - m->start);
+    bool stale = rate >= m->fill || rate > m->best + (m->best >> 3);
+
+    if (rate < m->best)
+        m->best = rate;
+
+    m->start = pos;
+    m->bits = 0;
+    return stale;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct Job Job;
+
+struct Job {
+    void (*fn)(void *);
+    void *arg;
+    Job *next;
+};
+
+struct Pool {
+    pthread_t *threads;
+    int nthreads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work; // signalled when a job is queued or the pool stops
+    pthread_cond_t idle; // signalled when the last running job finishes
+
+    Job *head, *tail; // queued jobs, oldest first
+    int running; // jobs taken off the queue but not finished yet
+    bool stop;
+};
+
+// Worker loop: run queued jobs until the pool stops
+static void *pool_worker(void *arg) {
+    Pool *p = (Pool *) arg;
+
+    pthread_mutex_lock(&p->lock);
+
+    for (;;) {
+        while (p->head == NULL && !p->stop)
+            pthread_cond_wait(&p->work, &p->lock);
+
+        if (p->head == NULL) // stopping and nothing left to do
+            break;
+
+        Job *job = p->head;
+        p->head = job->next;
+        if (p->head == NULL)
+            p->tail = NULL;
+        p->running++;
+
+        pthread_mutex_unlock(&p->lock);
+        job->fn(job->arg);
+        free(job);
+        pthread_mutex_lock(&p->lock);
+
+        p->running--;
+        if (p->head == NULL && p->running == 0)
+            pthread_cond_broadcast(&p->idle);
+    }
+
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// Constructor for Pool
+Pool *pool_create(int threads) {
+    Pool *p = (Pool *) calloc(1, sizeof(Pool));
+
+    if (p == NULL)
+        return NULL;
+
+    p->threads = (pthread_t *) calloc(threads, sizeof(pthread_t));
+
+    if (p->threads == NULL) {
+        free(p);
+        return NULL;
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->idle, NULL);
+
+    // keep whatever workers could be started, at least one is needed
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&p->threads[i], NULL, pool_worker, p) != 0)
+            break;
+        p->nthreads++;
+    }
+
+    if (p->nthreads == 0) {
+        pool_delete(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+// Queue a job at the tail
+bool pool_submit(Pool *p, void (*fn)(void *), void *arg) {
+    Job *job = (Job *) malloc(sizeof(Job));
+
+    if (job == NULL)
+        return false;
+
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&p->lock);
+
+    if (p->tail != NULL)
+        p->tail->next = job;
+    else
+        p->head = job;
+    p->tail = job;
+
+    pthread_cond_signal(&p->work);
+    pthread_mutex_unlock(&p->lock);
+
+    return true;
+}
+
+// Block until the queue is empty and no job is running
+void pool_wait(Pool *p) {
+    pthread_mutex_lock(&p->lock);
+
+    while (p->head != NULL || p->running > 0)
+        pthread_cond_wait(&p->idle, &p->lock);
+
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Destructor for Pool
+void pool_delete(Pool *p) {
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+
+    for (int i = 0; i < p->nthreads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->idle);
+
+    free(p->threads);
+    free(p);
+}
@@ -0,0 +1,34 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdbool.h>
+
+//
+// Fixed-size pool of worker threads running jobs in the order they were submitted.
+//
+
+typedef struct Pool Pool;
+
+/*
+ * Constructor: Starts threads worker threads waiting for jobs
+ * Returns the new pool, NULL if it could not be created
+ */
+Pool *pool_create(int threads);
+
+/*
+ * Queues fn(arg) to run on the next idle worker
+ * Returns false if the job could not be queued
+ */
+bool pool_submit(Pool *p, void (*fn)(void *), void *arg);
+
+/*
+ * Waits until every submitted job has finished
+ */
+void pool_wait(Pool *p);
+
+/*
+ * Destructor: Finishes the queued jobs, stops the workers and frees the pool
+ */
+void pool_delete(Pool *p);
+
+#endif
@@ -0,0 +1,158 @@
+#include "rans.h"
+#include "endian.h"
+#include <string.h>
+
+#define SCALE_BITS 12
+#define SCALE      (UINT32_C(1) << SCALE_BITS) // Sum of the frequencies.
+#define RANS_L     (UINT32_C(1) << 23) // Lower bound of a normalized state.
+#define STATES     4
+
+#define TABLE_SIZE  (256 * 2) // Frequency of every symbol, 2 bytes each.
+#define HEADER_SIZE (TABLE_SIZE + STATES * 4) // Table and final states.
+
+// Decoding step of the symbol owning a slot
+typedef struct Slot {
+    uint16_t freq;
+    uint16_t bias; // position of the slot within the range of its symbol
+} Slot;
+
+// Scales the counts of n symbols to frequencies summing to SCALE, keeping every symbol that occurs
+static void normalize(const uint32_t *counts, uint32_t n, uint32_t *freqs) {
+    uint32_t total = 0;
+    int largest = 0;
+
+    for (int s = 0; s < 256; s++) {
+        freqs[s] = (uint32_t) ((uint64_t) counts[s] * SCALE / n);
+        if (counts[s] > 0 && freqs[s] == 0)
+            freqs[s] = 1;
+
+        total += freqs[s];
+        if (counts[s] > counts[largest])
+            largest = s;
+    }
+
+    // the most frequent symbol absorbs the rounding error at the smallest cost per bit
+    if (total <= SCALE || freqs[largest] > total - SCALE) {
+        freqs[largest] = freqs[largest] + SCALE - total;
+        return;
+    }
+
+    // so many rare symbols were rounded up that every other symbol has to give some back
+    while (total > SCALE) {
+        for (int s = 0; s < 256 && total > SCALE; s++) {
+            if (freqs[s] > 1) {
+                freqs[s]--;
+                total--;
+            }
+        }
+    }
+}
+
+// Codes the symbols last to first, so that the decoder gets them first to last
+size_t rans_encode(const uint8_t *src, uint32_t n, uint8_t *dst, size_t cap) {
+    uint32_t counts[256] = { 0 };
+    uint32_t freqs[256], cums[256];
+
+    if (n == 0 || cap < HEADER_SIZE)
+        return 0;
+
+    for (uint32_t i = 0; i < n; i++)
+        counts[src[i]]++;
+
+    normalize(counts, n, freqs);
+
+    for (uint32_t s = 0, cum = 0; s < 256; s++) {
+        cums[s] = cum;
+        cum += freqs[s];
+        store_le16(dst + 2 * s, (uint16_t) freqs[s]);
+    }
+
+    // the stream grows down from the end of dst and is moved up against the header afterwards
+    uint32_t x[STATES] = { RANS_L, RANS_L, RANS_L, RANS_L };
+    uint8_t *end = dst + cap;
+    uint8_t *p = end;
+
+    for (uint32_t i = n; i-- > 0;) {
+        uint32_t *state = &x[i % STATES];
+        uint32_t freq = freqs[src[i]];
+        uint32_t x_max = ((RANS_L >> SCALE_BITS) << 8) * freq;
+
+        while (*state >= x_max) {
+            if (p == dst + HEADER_SIZE)
+                return 0;
+
+            *--p = (uint8_t) *state;
+            *state >>= 8;
+        }
+
+        *state = ((*state / freq) << SCALE_BITS) + *state % freq + cums[src[i]];
+    }
+
+    for (int j = 0; j < STATES; j++)
+        store_le32(dst + TABLE_SIZE + 4 * j, x[j]);
+
+    memmove(dst + HEADER_SIZE, p, end - p);
+    return HEADER_SIZE + (end - p);
+}
+
+// Takes the next symbol off a state and refills it from the stream
+static inline uint8_t decode_symbol(uint32_t *x, const Slot *slots, const uint8_t *syms,
+    const uint8_t **p, const uint8_t *end) {
+    uint32_t slot = *x & (SCALE - 1);
+    *x = slots[slot].freq * (*x >> SCALE_BITS) + slots[slot].bias;
+
+    while (*x < RANS_L && *p < end)
+        *x = *x << 8 | *(*p)++;
+
+    return syms[slot];
+}
+
+// Decodes STATES symbols per round, one from each state, while the states last
+bool rans_decode(const uint8_t *src, size_t size, uint8_t *dst, uint32_t n) {
+    Slot slots[SCALE];
+    uint8_t syms[SCALE];
+    uint32_t x[STATES];
+    uint32_t cum = 0;
+
+    if (size < HEADER_SIZE)
+        return false;
+
+    for (int s = 0; s < 256; s++) {
+        uint32_t freq = load_le16(src + 2 * s);
+        if (freq > SCALE - cum)
+            return false;
+
+        for (uint32_t k = 0; k < freq; k++) {
+            slots[cum + k] = (Slot) { (uint16_t) freq, (uint16_t) k };
+            syms[cum + k] = (uint8_t) s;
+        }
+
+        cum += freq;
+    }
+
+    if (cum != SCALE)
+        return false;
+
+    for (int j = 0; j < STATES; j++)
+        x[j] = load_le32(src + TABLE_SIZE + 4 * j);
+
+    const uint8_t *p = src + HEADER_SIZE;
+    const uint8_t *end = src + size;
+    uint32_t i = 0;
+
+    for (; i + STATES <= n; i += STATES) {
+        dst[i] = decode_symbol(&x[0], slots, syms, &p, end);
+        dst[i + 1] = decode_symbol(&x[1], slots, syms, &p, end);
+        dst[i + 2] = decode_symbol(&x[2], slots, syms, &p, end);
+        dst[i + 3] = decode_symbol(&x[3], slots, syms, &p, end);
+    }
+
+    for (; i < n; i++)
+        dst[i] = decode_symbol(&x[i % STATES], slots, syms, &p, end);
+
+    // every state is back where the encoder started it, with the whole stream consumed
+    bool ok = p == end;
+    for (int j = 0; j < STATES; j++)
+        ok = ok && x[j] == RANS_L;
+    return ok;
+}
@@ -0,0 +1,30 @@
+#ifndef __RANS_H__
+#define __RANS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Static order-0 rANS coder for the symbols of a chunk.
+//
+// The symbol counts of the whole block are scaled to frequencies summing to 4096 and stored in
+// front of the coded bytes, so no model is adapted while coding. Four states take the symbols in
+// turn, which lets the decoder work on four independent dependency chains at once, and decoding a
+// symbol is a lookup in a 4096-slot table followed by a multiply and a byte-wise refill: no
+// divisions and no branches beyond the refill.
+//
+
+/*
+ * Codes the n symbols of src into dst, frequency table and final states included
+ * Returns the number of bytes written, or 0 if n is 0 or they would not fit in cap bytes
+ */
+size_t rans_encode(const uint8_t *src, uint32_t n, uint8_t *dst, size_t cap);
+
+/*
+ * Decodes n symbols out of the size bytes of src, written by rans_encode, into dst
+ * Returns false if src is damaged
+ */
+bool rans_decode(const uint8_t *src, size_t size, uint8_t *dst, uint32_t n);
+
+#endif
@@ -0,0 +1,214 @@
+#include "seek.h"
+#include "block.h"
+#include "code.h"
+#include "crc32c.h"
+#include "endian.h"
+#include "io.h"
+#include "policy.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Decompressed chunk kept in the cache
+typedef struct CachedChunk {
+    uint64_t chunk; // index of the chunk held, UINT64_MAX if none
+    uint64_t used; // tick of the last read that touched it
+    uint8_t *data;
+    uint32_t size; // bytes allocated for data
+    uint32_t ulen;
+} CachedChunk;
+
+struct lz_reader {
+    int infile;
+    int bits;
+    int policy;
+    bool lzw;
+    bool entropy;
+    bool checksum;
+
+    IndexEntry *index;
+    uint64_t count; // number of chunks
+    uint64_t total; // uncompressed size
+
+    WordTable *table;
+    uint8_t *in; // compressed bytes of the chunk being decoded
+    uint32_t in_size;
+
+    CachedChunk *cache;
+    int ncache;
+    uint64_t tick;
+};
+
+// Constructor for SeekReader
+SeekReader *seek_open(int infile, int cache) {
+    FileHeader head;
+
+    if (lseek(infile, 0, SEEK_SET) != 0) // not seekable
+        return NULL;
+
+    if (!read_header(infile, &head) || !(head.flags & FLAG_INDEXED))
+        return NULL;
+
+    SeekReader *r = (SeekReader *) calloc(1, sizeof(SeekReader));
+    if (r == NULL)
+        return NULL;
+
+    r->infile = infile;
+    r->bits = head.bits;
+    r->policy = HEADER_POLICY(&head);
+    r->lzw = head.flags & FLAG_LZW;
+    r->entropy = head.flags & FLAG_ENTROPY;
+    r->checksum = head.flags & FLAG_CHECKSUM;
+    r->ncache = cache > 1 ? cache : 1;
+    r->index = read_index(infile, &r->count, &r->total);
+    r->table = wt_create(MAX_CODE_BITS(r->bits));
+    r->cache = (CachedChunk *) calloc(r->ncache, sizeof(CachedChunk));
+
+    if (r->index == NULL || r->table == NULL || r->cache == NULL
+        || (r->policy == POLICY_LRU && !wt_track(r->table, MAX_CODE_BITS(r->bits)))) {
+        seek_close(r);
+        return NULL;
+    }
+
+    for (int i = 0; i < r->ncache; i++)
+        r->cache[i].chunk = UINT64_MAX;
+
+    return r;
+}
+
+// Size of the uncompressed contents
+uint64_t seek_size(SeekReader *r) {
+    return r->total;
+}
+
+// Finds the chunk holding offset: the last one starting at or before it
+static uint64_t seek_find(SeekReader *r, uint64_t offset) {
+    uint64_t lo = 0, hi = r->count; // answer is in [lo, hi)
+
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo) / 2;
+
+        if (r->index[mid].uoff <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+// Reads and decompresses chunk into slot, returns false if it is damaged
+static bool seek_decode(SeekReader *r, uint64_t chunk, CachedChunk *slot) {
+    ChunkHeader head;
+    uint64_t end = chunk + 1 < r->count ? r->index[chunk + 1].uoff : r->total;
+    uint32_t checksum = r->checksum ? CHECKSUM_SIZE : 0;
+
+    slot->chunk = UINT64_MAX; // stays empty unless everything below works out
+
+    if (lseek(r->infile, r->index[chunk].coff, SEEK_SET) == (off_t) -1
+        || !read_chunk_header(r->infile, &head))
+        return false;
+
+    // the chunk has to agree with the index about its size, and its payload has to be able to
+    // expand to it
+    if (head.ulen != end - r->index[chunk].uoff || head.ulen > MAX_CHUNK
+        || head.clen > block_bound(head.ulen, r->bits) + checksum || head.clen < checksum
+        || head.ulen > block_expansion(head.clen))
+        return false;
+
+    // buffers only grow, every chunk but the last usually has the same size
+    if (head.clen > r->in_size) {
+        free(r->in);
+        r->in = (uint8_t *) malloc(head.clen);
+        r->in_size = r->in != NULL ? head.clen : 0;
+    }
+    if (head.ulen > slot->size) {
+        free(slot->data);
+        slot->data = (uint8_t *) malloc(head.ulen);
+        slot->size = slot->data != NULL ? head.ulen : 0;
+    }
+
+    if (r->in == NULL || slot->data == NULL)
+        return false;
+
+    slot->ulen = head.ulen;
+
+    uint32_t clen = head.clen - checksum;
+    if (read_bytes(r->infile, r->in, head.clen) != (int) head.clen
+        || block_decode(r->table, r->bits, r->policy, r->lzw, r->entropy, r->in, clen,
+               slot->data, head.ulen)
+               != head.ulen
+        || (r->checksum && crc32c(0, slot->data, head.ulen) != load_le32(r->in + clen)))
+        return false;
+
+    slot->chunk = chunk;
+    return true;
+}
+
+// Returns the cached copy of chunk, decompressing it into the least recently used slot if needed
+static CachedChunk *seek_load(SeekReader *r, uint64_t chunk) {
+    CachedChunk *victim = &r->cache[0];
+
+    for (int i = 0; i < r->ncache; i++) {
+        if (r->cache[i].chunk == chunk) {
+            victim = &r->cache[i];
+            victim->used = ++r->tick;
+            return victim;
+        }
+
+        if (r->cache[i].used < victim->used)
+            victim = &r->cache[i];
+    }
+
+    if (!seek_decode(r, chunk, victim))
+        return NULL;
+
+    victim->used = ++r->tick;
+    return victim;
+}
+
+// Copies a range of the uncompressed contents into buf
+int64_t seek_read(SeekReader *r, uint64_t offset, uint8_t *buf, uint64_t len) {
+    if (r->count == 0 && r->total > 0) // read_index turns such an index down, but nothing to seek
+        return -1;
+    if (offset >= r->total)
+        return 0;
+    if (len > r->total - offset)
+        len = r->total - offset;
+
+    uint64_t done = 0;
+
+    while (done < len) {
+        uint64_t chunk = seek_find(r, offset + done);
+        CachedChunk *slot = seek_load(r, chunk);
+
+        uint64_t skip = offset + done - r->index[chunk].uoff;
+
+        // an index claiming an empty chunk, or one that ends early, is damaged
+        if (slot == NULL || skip >= slot->ulen)
+            return -1;
+
+        uint64_t n = slot->ulen - skip;
+        if (n > len - done)
+            n = len - done;
+
+        memcpy(buf + done, slot->data + skip, n);
+        done += n;
+    }
+
+    return done;
+}
+
+// Destructor for SeekReader
+void seek_close(SeekReader *r) {
+    for (int i = 0; r->cache != NULL && i < r->ncache; i++)
+        free(r->cache[i].data);
+
+    free(r->cache);
+    free(r->in);
+    free(r->index);
+    if (r->table != NULL)
+        wt_delete(r->table);
+
+    free(r);
+}
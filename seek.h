@@ -0,0 +1,42 @@
+#ifndef __SEEK_H__
+#define __SEEK_H__
+
+#include "lz78.h"
+#include <stdint.h>
+
+//
+// Random access to the uncompressed contents of an indexed chunked file.
+//
+// Reads go through the chunk index at the end of the file, so only the chunks overlapping the
+// requested range are read and decompressed. The last few decompressed chunks are kept in a small
+// LRU cache, which makes repeated or nearby reads cheap.
+//
+// The library exports these as lz_reader_open and the rest, see lz78.h.
+//
+
+typedef struct lz_reader SeekReader;
+
+/*
+ * Constructor: Opens the indexed chunked file infile, which must be seekable
+ * Keeps up to cache decompressed chunks around, at least one
+ * Returns the new reader, NULL if infile has no chunk index
+ */
+SeekReader *seek_open(int infile, int cache);
+
+/*
+ * Returns the size of the uncompressed contents
+ */
+uint64_t seek_size(SeekReader *r);
+
+/*
+ * Copies up to len uncompressed bytes starting at offset into buf
+ * Returns the number of bytes copied, 0 at or past the end, -1 if the file is damaged
+ */
+int64_t seek_read(SeekReader *r, uint64_t offset, uint8_t *buf, uint64_t len);
+
+/*
+ * Destructor: Frees the reader and its cache, infile stays open
+ */
+void seek_close(SeekReader *r);
+
+#endif
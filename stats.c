@@ -0,0 +1,71 @@
+#include "stats.h"
+#include <inttypes.h>
+
+_Thread_local IoCounters io_counters;
+
+// Adds c to sum
+void counters_add(Counters *sum, const Counters *c) {
+    sum->lookups += c->lookups;
+    sum->resets += c->resets;
+
+    for (int i = 0; i <= MAX_BITS; i++)
+        sum->pairs[i] += c->pairs[i];
+}
+
+// Adds up I/O counters
+void io_counters_add(IoCounters *sum, const IoCounters *c) {
+    sum->reads += c->reads;
+    sum->writes += c->writes;
+    sum->maps += c->maps;
+    sum->uring_ops += c->uring_ops;
+    sum->uring_enters += c->uring_enters;
+    sum->bytes_read += c->bytes_read;
+    sum->bytes_written += c->bytes_written;
+    sum->ns += c->ns;
+}
+
+// Prints stats as one line of JSON
+void print_stats(FILE *out, const char *mode, const lz_stats *stats, uint64_t wall_ns) {
+    bool compress = mode[0] == 'c';
+    uint64_t raw = compress ? stats->total_in : stats->total_out;
+    uint64_t packed = compress ? stats->total_out : stats->total_in;
+
+    fprintf(out,
+        "{\"mode\":\"%s\",\"counters\":%s,\"bytes_in\":%" PRIu64 ",\"bytes_out\":%" PRIu64
+        ",\"ratio\":%.4f,\"wall_ns\":%" PRIu64,
+        mode, stats->counters ? "true" : "false", stats->total_in, stats->total_out,
+        raw ? (double) packed / raw : 0.0, wall_ns);
+
+    if (stats->counters) {
+        uint64_t bits = 0;
+
+        fprintf(out,
+            ",\"codec_ns\":%" PRIu64 ",\"io_ns\":%" PRIu64 ",\"lookups\":%" PRIu64
+            ",\"phrases\":%" PRIu64 ",\"avg_phrase_len\":%.3f,\"resets\":%" PRIu64,
+            stats->codec_ns, io_counters.ns, stats->lookups, stats->phrases,
+            stats->phrases ? (double) raw / stats->phrases : 0.0, stats->resets);
+
+        // code bits and their symbols, by the width of the code
+        int sym_bits = stats->lzw ? 0 : 8;
+        fprintf(out, ",\"bits_by_width\":{");
+        for (int i = 0, first = 1; i <= MAX_BITS; i++) {
+            if (stats->pairs[i] == 0)
+                continue;
+
+            fprintf(out, "%s\"%d\":%" PRIu64, first ? "" : ",", i,
+                stats->pairs[i] * (i + sym_bits));
+            bits += stats->pairs[i] * (i + sym_bits);
+            first = 0;
+        }
+
+        fprintf(out,
+            "},\"pair_bits\":%" PRIu64 ",\"bytes_read\":%" PRIu64 ",\"bytes_written\":%" PRIu64
+            ",\"read_calls\":%" PRIu64 ",\"write_calls\":%" PRIu64 ",\"mmap_calls\":%" PRIu64
+            ",\"uring_ops\":%" PRIu64 ",\"uring_enters\":%" PRIu64 ",\"syscalls\":%" PRIu64,
+            bits, io_counters.bytes_read, io_counters.bytes_written, io_counters.reads,
+            io_counters.writes, io_counters.maps, io_counters.uring_ops, io_counters.uring_enters,
+            io_counters.reads + io_counters.writes + io_counters.maps + io_counters.uring_enters);
+    }
+
+    fprintf(out, "}\n");
+}
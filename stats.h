@@ -0,0 +1,74 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "code.h"
+#include "lz78.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+//
+// Counters on the hot paths of the codec and of the I/O helpers.
+//
+// They are only compiled in when LZ_STATS is defined, which 'make STATS=1' does. Otherwise every
+// STAT_ADD is an empty statement and stat_clock is a constant 0, so the default build does exactly
+// the same work as if the counters were not there.
+//
+typedef struct Counters {
+    uint64_t lookups; // Dictionary lookups, one per symbol compressed.
+    uint64_t resets; // Times the dictionary or word table filled up and started over.
+    uint64_t pairs[MAX_BITS + 1]; // Pairs holding a phrase, by the width of their code.
+} Counters;
+
+//
+// System calls made by read_bytes, write_bytes, map_input and the io_uring of a pipeline on the
+// calling thread, the bytes they moved and the wall time they took. Only encode and decode do I/O,
+// on their main thread or on the threads of a pipeline, which hand their counters over to the main
+// thread when they stop, so the counters are per thread instead of per stream.
+//
+typedef struct IoCounters {
+    uint64_t reads, writes, maps; // System calls.
+    uint64_t uring_ops, uring_enters; // Reads and writes queued on an io_uring, system calls.
+    uint64_t bytes_read, bytes_written; // Bytes moved by read and write, or mapped.
+    uint64_t ns; // Wall time spent in them.
+} IoCounters;
+
+extern _Thread_local IoCounters io_counters;
+
+#ifdef LZ_STATS
+#define STAT_ADD(counter, n) ((counter) += (n))
+#else
+#define STAT_ADD(counter, n) ((void) sizeof((counter) += (n))) // not evaluated, but uses n
+#endif
+
+//
+// Nanoseconds on the monotonic clock, or 0 without LZ_STATS.
+//
+static inline uint64_t stat_clock(void) {
+#ifdef LZ_STATS
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+//
+// Add the counters in c to those in sum.
+//
+void counters_add(Counters *sum, const Counters *c);
+
+//
+// Add the I/O counters in c to those in sum.
+//
+void io_counters_add(IoCounters *sum, const IoCounters *c);
+
+//
+// Print stats, the I/O counters of the calling thread and the wall time of the whole run as one
+// line of JSON to out, for monitoring. mode is "compress" or "decompress". Counter fields are left
+// out when the library was built without LZ_STATS.
+//
+void print_stats(FILE *out, const char *mode, const lz_stats *stats, uint64_t wall_ns);
+
+#endif
@@ -0,0 +1,522 @@
+#include "stream.h"
+#include "bits.h"
+#include "code.h"
+#include "dict.h"
+#include "io.h"
+#include "policy.h"
+#include "word.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct StreamEncoder {
+    Dict *dict;
+    int policy; // what happens once the dictionary is full
+    bool lzw; // bare codes, the phrases after the 256 seeded ones starting at first_code
+    uint32_t first_code; // first code the dictionary hands out
+    uint32_t max_code;
+    uint32_t curr_code; // phrase matched so far, EMPTY_CODE between phrases
+    uint32_t prev_code; // curr_code without its last symbol
+    uint32_t next_code;
+    uint8_t prev_sym;
+    bool finished; // the stop pair has been packed
+    uint64_t pos; // symbols coded so far
+    Monitor monitor; // ratio of the dictionary, with POLICY_ADAPTIVE
+
+    BitWriter bw; // packs pairs into pairs
+    uint32_t drained; // bytes of pairs already handed out
+    uint8_t pairs[BLOCK + 16]; // room for a pair and a clear once BLOCK bytes are used
+};
+
+struct StreamDecoder {
+    WordTable *table;
+    int policy; // what happens once the table is full
+    bool lzw;
+    uint32_t first_code;
+    uint32_t max_code;
+    uint32_t next_code;
+    uint32_t prev_code; // with lzw, the previous word if the entry at next_code - 1 extends it
+    uint8_t first_sym; // first symbol of the last word written out
+    bool stopped; // the stop pair has been read
+
+    BitReader br; // bits carried over between calls, buf only points into the current input
+
+    uint8_t *word; // scratch for a word that did not fit into the output
+    uint32_t word_size; // bytes allocated for word
+    uint32_t word_pos, word_len; // part of word still to be handed out
+};
+
+// Constructor for StreamEncoder
+StreamEncoder *stream_encoder_create(int bits, int policy, bool lzw) {
+    StreamEncoder *se = (StreamEncoder *) calloc(1, sizeof(StreamEncoder));
+
+    if (se == NULL)
+        return NULL;
+
+    se->policy = policy;
+    se->lzw = lzw;
+    se->first_code = FIRST_CODE(policy) + (lzw ? LITERALS : 0);
+    se->max_code = MAX_CODE_BITS(bits);
+    se->dict = dict_create(se->max_code); // dictionary holding only the empty phrase, EMPTY_CODE
+    se->curr_code = EMPTY_CODE;
+    se->prev_code = EMPTY_CODE;
+    se->next_code = se->first_code;
+    se->bw.buf = se->pairs;
+    monitor_start(&se->monitor, 0);
+
+    if (se->dict == NULL || (policy == POLICY_LRU && !dict_track(se->dict, se->max_code))) {
+        stream_encoder_delete(se);
+        return NULL;
+    }
+
+    return se;
+}
+
+// Hands out as much of the packed pairs as fits, returns true once none are left
+static bool drain_pairs(StreamEncoder *se, uint8_t **out, size_t *out_len) {
+    size_t n = se->bw.pos - se->drained;
+    if (n > *out_len)
+        n = *out_len;
+
+    memcpy(*out, se->pairs + se->drained, n);
+    *out += n;
+    *out_len -= n;
+    se->drained += n;
+
+    if (se->drained < se->bw.pos)
+        return false;
+
+    se->bw.pos = se->drained = 0; // the bits still in the accumulator are kept
+    return true;
+}
+
+// Runs symbols through the dictionary into bare LZW codes until they run out or pairs fills up,
+// returns how many were used
+static size_t encode_codes(StreamEncoder *se, const uint8_t *in, size_t n) {
+    Dict *dict = se->dict;
+    uint32_t literals = se->first_code - LITERALS; // code of the one-symbol phrase 0
+    uint32_t curr_code = se->curr_code;
+    uint32_t next_code = se->next_code;
+    size_t i = 0;
+
+    // every phrase starts out as one of the seeded ones
+    if (curr_code == EMPTY_CODE && n > 0)
+        curr_code = literals + in[i++];
+
+    while (i < n && se->bw.pos < BLOCK) {
+        uint8_t sym = in[i++];
+        uint32_t next = dict_step(dict, curr_code, sym);
+
+        if (next != STOP_CODE) {
+            curr_code = next;
+            continue;
+        }
+
+        // only the code goes out: sym starts the next phrase, which is how the decoder learns it
+        int bitlen = code_bits(next_code);
+        bw_put(&se->bw, curr_code, bitlen);
+        STAT_ADD(dict->counters.pairs[bitlen], 1);
+
+        if (next_code < se->max_code) {
+            dict_insert(dict, curr_code, sym, next_code);
+            monitor_count(&se->monitor, bitlen);
+
+            if (++next_code == se->max_code && se->policy == POLICY_RESET) {
+                dict_reset(dict);
+                STAT_ADD(dict->counters.resets, 1);
+                next_code = se->first_code;
+            } else if (next_code == se->max_code) {
+                monitor_full(&se->monitor, se->pos + i);
+            }
+        } else if (se->policy == POLICY_ADAPTIVE
+                   && monitor_pair(&se->monitor, se->pos + i, bitlen)) {
+            bw_put(&se->bw, CLEAR_CODE, bitlen);
+            dict_reset(dict);
+            STAT_ADD(dict->counters.resets, 1);
+            next_code = se->first_code;
+            monitor_start(&se->monitor, se->pos + i);
+        }
+
+        curr_code = literals + sym;
+    }
+
+    se->pos += i;
+    STAT_ADD(dict->counters.lookups, i);
+    se->curr_code = curr_code;
+    se->next_code = next_code;
+    return i;
+}
+
+// Runs symbols through the dictionary until they run out or pairs fills up, returns how many
+// were used
+static size_t encode_syms(StreamEncoder *se, const uint8_t *in, size_t n) {
+    if (se->lzw)
+        return encode_codes(se, in, n);
+
+    Dict *dict = se->dict;
+    uint32_t curr_code = se->curr_code;
+    uint32_t prev_code = se->prev_code;
+    uint32_t next_code = se->next_code;
+    size_t i = 0;
+
+    while (i < n && se->bw.pos < BLOCK) {
+        uint8_t sym = in[i++];
+        uint32_t next = dict_step(dict, curr_code, sym);
+
+        // if the longer phrase exists, extend the current one
+        if (next != STOP_CODE) {
+            prev_code = curr_code;
+            curr_code = next;
+        }
+        // otherwise write it out and add it to the dictionary
+        else {
+            int bitlen = code_bits(next_code);
+
+            // the symbol sits directly above the code bits, so the whole pair goes in at once
+            bw_put(&se->bw, curr_code | (uint64_t) sym << bitlen, bitlen + 8);
+            STAT_ADD(dict->counters.pairs[bitlen], 1);
+
+            // a full dictionary is started over, kept as it is or recycled, depending on the policy
+            if (next_code < se->max_code) {
+                dict_insert(dict, curr_code, sym, next_code);
+                monitor_count(&se->monitor, bitlen + 8);
+
+                if (++next_code == se->max_code && se->policy == POLICY_RESET) {
+                    dict_reset(dict);
+                    STAT_ADD(dict->counters.resets, 1);
+                    next_code = START_CODE;
+                } else if (next_code == se->max_code) {
+                    monitor_full(&se->monitor, se->pos + i);
+                }
+            } else if (se->policy == POLICY_ADAPTIVE
+                       && monitor_pair(&se->monitor, se->pos + i, bitlen + 8)) {
+                bw_put(&se->bw, CLEAR_CODE, bitlen);
+                dict_reset(dict);
+                STAT_ADD(dict->counters.resets, 1);
+                next_code = FIRST_CODE(se->policy);
+                monitor_start(&se->monitor, se->pos + i);
+            } else if (se->policy == POLICY_LRU) {
+                dict_recycle(dict, curr_code, sym);
+            }
+
+            curr_code = EMPTY_CODE;
+        }
+    }
+
+    if (i > 0)
+        se->prev_sym = in[i - 1];
+
+    se->pos += i;
+    STAT_ADD(dict->counters.lookups, i);
+    se->curr_code = curr_code;
+    se->prev_code = prev_code;
+    se->next_code = next_code;
+    return i;
+}
+
+// Packs the unfinished phrase and the stop pair, and pads the last byte
+static void encode_end(StreamEncoder *se) {
+    int bitlen = code_bits(se->next_code);
+
+    // the decoder reserves an entry for every LZW code, the last one included
+    if (se->lzw) {
+        if (se->curr_code != EMPTY_CODE) {
+            bw_put(&se->bw, se->curr_code, bitlen);
+            STAT_ADD(se->dict->counters.pairs[bitlen], 1);
+
+            if (se->next_code < se->max_code && ++se->next_code == se->max_code
+                && se->policy == POLICY_RESET)
+                se->next_code = se->first_code;
+
+            bitlen = code_bits(se->next_code);
+        }
+
+        bw_put(&se->bw, STOP_CODE, bitlen);
+        bw_finish(&se->bw);
+        se->finished = true;
+        return;
+    }
+
+    if (se->curr_code != EMPTY_CODE) {
+        bw_put(&se->bw, se->prev_code | (uint64_t) se->prev_sym << bitlen, bitlen + 8);
+        STAT_ADD(se->dict->counters.pairs[bitlen], 1);
+
+        if (se->policy == POLICY_RESET)
+            se->next_code = (se->next_code + 1) % se->max_code;
+        else if (se->next_code < se->max_code)
+            se->next_code++;
+
+        bitlen = code_bits(se->next_code);
+    }
+
+    bw_put(&se->bw, STOP_CODE, bitlen + 8);
+    bw_finish(&se->bw);
+    se->finished = true;
+}
+
+// Compresses as much input as the output has room for
+lz_status stream_encode(StreamEncoder *se, const uint8_t **in, size_t *in_len, uint8_t **out,
+    size_t *out_len, bool finish) {
+    for (;;) {
+        if (!drain_pairs(se, out, out_len)) // output full
+            return LZ_OK;
+
+        if (*in_len > 0) {
+            size_t n = encode_syms(se, *in, *in_len);
+            *in += n;
+            *in_len -= n;
+        } else if (!finish) {
+            return LZ_OK;
+        } else if (se->finished) {
+            return LZ_STREAM_END;
+        } else {
+            encode_end(se); // pairs was just drained, so there is room for the last few
+        }
+    }
+}
+
+// Adds the counters of the encoder to sum
+void stream_encoder_counters(const StreamEncoder *se, Counters *sum) {
+    counters_add(sum, &se->dict->counters);
+}
+
+// Starts over without giving any memory back
+void stream_encoder_reset(StreamEncoder *se) {
+    dict_reset(se->dict);
+    memset(&se->dict->counters, 0, sizeof(Counters));
+
+    se->curr_code = EMPTY_CODE;
+    se->prev_code = EMPTY_CODE;
+    se->next_code = se->first_code;
+    se->prev_sym = 0;
+    se->finished = false;
+    se->pos = 0;
+    monitor_start(&se->monitor, 0);
+
+    se->bw = (BitWriter) { 0, 0, 0, se->pairs };
+    se->drained = 0;
+}
+
+// Destructor for StreamEncoder
+void stream_encoder_delete(StreamEncoder *se) {
+    if (se->dict != NULL)
+        dict_delete(se->dict);
+    free(se);
+}
+
+// Constructor for StreamDecoder
+StreamDecoder *stream_decoder_create(int bits, int policy, bool lzw) {
+    StreamDecoder *sd = (StreamDecoder *) calloc(1, sizeof(StreamDecoder));
+
+    if (sd == NULL)
+        return NULL;
+
+    sd->policy = policy;
+    sd->lzw = lzw;
+    sd->first_code = FIRST_CODE(policy) + (lzw ? LITERALS : 0);
+    sd->max_code = MAX_CODE_BITS(bits);
+    sd->table = wt_create(sd->max_code);
+    sd->next_code = sd->first_code;
+    sd->prev_code = EMPTY_CODE;
+
+    if (sd->table == NULL || (policy == POLICY_LRU && !wt_track(sd->table, sd->max_code))) {
+        stream_decoder_delete(sd);
+        return NULL;
+    }
+
+    if (lzw)
+        wt_seed(sd->table, FIRST_CODE(policy));
+
+    return sd;
+}
+
+// Hands out as much of the held back word as fits, returns true once none of it is left
+static bool drain_word(StreamDecoder *sd, uint8_t **out, size_t *out_len) {
+    size_t n = sd->word_len - sd->word_pos;
+    if (n > *out_len)
+        n = *out_len;
+
+    memcpy(*out, sd->word + sd->word_pos, n);
+    *out += n;
+    *out_len -= n;
+    sd->word_pos += n;
+
+    return sd->word_pos == sd->word_len;
+}
+
+// Writes the word under code into the output, or into word if it does not fit
+static bool put_word(StreamDecoder *sd, uint32_t code, uint8_t **out, size_t *out_len) {
+    uint32_t len = sd->table->lens[code];
+
+    if (len <= *out_len) {
+        wt_copy(sd->table, code, *out);
+        sd->first_sym = **out;
+        *out += len;
+        *out_len -= len;
+        return true;
+    }
+
+    // scratch only grows, and only ever for words longer than the output space
+    if (len > sd->word_size) {
+        uint8_t *grown = (uint8_t *) realloc(sd->word, len);
+
+        if (grown == NULL)
+            return false;
+        sd->word = grown;
+        sd->word_size = len;
+    }
+
+    wt_copy(sd->table, code, sd->word);
+    sd->first_sym = sd->word[0];
+    sd->word_pos = 0;
+    sd->word_len = len;
+    drain_word(sd, out, out_len);
+    return true;
+}
+
+// Writes out the word under the LZW code and completes the entry added with the code before
+static lz_status put_code(StreamDecoder *sd, uint32_t code, uint8_t **out, size_t *out_len) {
+    if (code < sd->first_code - LITERALS || code >= sd->next_code) // not a word yet
+        return LZ_DATA_ERROR;
+
+    // KwKwK: the encoder used the entry it added with the previous code right away, so the word
+    // is the previous one followed by its own first symbol
+    bool pending = sd->prev_code != EMPTY_CODE && code == sd->next_code - 1;
+    if (pending)
+        wt_add(sd->table, code, sd->prev_code, sd->first_sym);
+
+    if (!put_word(sd, code, out, out_len))
+        return LZ_MEM_ERROR;
+
+    // otherwise that entry ends with the first symbol of this word
+    if (sd->prev_code != EMPTY_CODE && !pending)
+        wt_add(sd->table, sd->next_code - 1, sd->prev_code, sd->first_sym);
+
+    // the encoder added an entry along with this code unless the table is full
+    sd->prev_code = EMPTY_CODE;
+    if (sd->next_code < sd->max_code) {
+        sd->prev_code = code;
+
+        if (++sd->next_code == sd->max_code && sd->policy == POLICY_RESET) {
+            wt_reset(sd->table);
+            STAT_ADD(sd->table->counters.resets, 1);
+            sd->next_code = sd->first_code;
+            sd->prev_code = EMPTY_CODE;
+        }
+    }
+
+    return LZ_OK;
+}
+
+// Decompresses as much input as the output has room for
+lz_status stream_decode(
+    StreamDecoder *sd, const uint8_t **in, size_t *in_len, uint8_t **out, size_t *out_len) {
+    BitReader *br = &sd->br;
+    lz_status status = LZ_OK;
+
+    if (sd->word_pos < sd->word_len && !drain_word(sd, out, out_len)) // output full
+        return LZ_OK;
+
+    br->buf = *in;
+    br->size = *in_len;
+    br->pos = 0;
+
+    while (!sd->stopped && *out_len > 0) {
+        int bitlen = code_bits(sd->next_code);
+        uint32_t size = bitlen + (sd->lzw ? 0 : 8);
+
+        // a pair is at most MAX_BITS + 8 = 32 bits, so one refill per pair is enough
+        if (br->count < size) {
+            br_refill(br);
+
+            if (br->count < size) // the rest of the pair is in the next input
+                break;
+        }
+
+        uint32_t code = br_get(br, bitlen);
+
+        if (code == STOP_CODE) {
+            sd->stopped = true;
+            break;
+        }
+
+        if (code == CLEAR_CODE && sd->policy == POLICY_ADAPTIVE) {
+            wt_reset(sd->table);
+            STAT_ADD(sd->table->counters.resets, 1);
+            sd->next_code = sd->first_code;
+            sd->prev_code = EMPTY_CODE;
+            continue;
+        }
+
+        if (sd->lzw) {
+            STAT_ADD(sd->table->counters.pairs[bitlen], 1);
+            status = put_code(sd, code, out, out_len);
+
+            if (status != LZ_OK)
+                break;
+            continue;
+        }
+
+        if (code >= sd->next_code) { // refers to a word that does not exist yet
+            status = LZ_DATA_ERROR;
+            break;
+        }
+
+        uint32_t word = sd->next_code;
+        if (sd->next_code == sd->max_code && sd->policy == POLICY_LRU)
+            word = wt_recycle(sd->table, code, br_get(br, 8));
+        else
+            wt_add(sd->table, sd->next_code, code, br_get(br, 8));
+        STAT_ADD(sd->table->counters.pairs[bitlen], 1);
+
+        if (!put_word(sd, word, out, out_len)) {
+            status = LZ_MEM_ERROR;
+            break;
+        }
+
+        // a full table is started over, recycled, or kept as it is, in which case each word is
+        // built in the spare entry at max_code and none are kept
+        if (sd->next_code < sd->max_code && ++sd->next_code == sd->max_code
+            && sd->policy == POLICY_RESET) {
+            wt_reset(sd->table);
+            STAT_ADD(sd->table->counters.resets, 1);
+            sd->next_code = START_CODE;
+        }
+    }
+
+    // only whole bytes are consumed; bits loaded past count are loaded again from the next input
+    *in += br->pos;
+    *in_len -= br->pos;
+    if (br->count < 64)
+        br->window &= (UINT64_C(1) << br->count) - 1;
+
+    if (status == LZ_OK && sd->stopped && sd->word_pos == sd->word_len)
+        status = LZ_STREAM_END;
+
+    return status;
+}
+
+// Adds the counters of the decoder to sum
+void stream_decoder_counters(const StreamDecoder *sd, Counters *sum) {
+    counters_add(sum, &sd->table->counters);
+}
+
+// Starts over without giving any memory back, the word buffer included
+void stream_decoder_reset(StreamDecoder *sd) {
+    wt_reset(sd->table); // the LZW literals stay seeded
+    memset(&sd->table->counters, 0, sizeof(Counters));
+
+    sd->next_code = sd->first_code;
+    sd->prev_code = EMPTY_CODE;
+    sd->first_sym = 0;
+    sd->stopped = false;
+    memset(&sd->br, 0, sizeof(BitReader));
+    sd->word_pos = sd->word_len = 0;
+}
+
+// Destructor for StreamDecoder
+void stream_decoder_delete(StreamDecoder *sd) {
+    if (sd->table != NULL)
+        wt_delete(sd->table);
+    free(sd->word);
+    free(sd);
+}
@@ -0,0 +1,86 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "lz78.h"
+#include "stats.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Incremental codec for the body of an unchunked file: one run of (code, symbol) pairs, or of bare
+// codes in LZW mode, over the whole input, closed by STOP_CODE.
+//
+// Unlike block_encode and block_decode, the input does not have to be in memory all at once.
+// Everything that has to survive from one call to the next, the dictionary, the current phrase and
+// the partial bits of a pair, is kept in the encoder or decoder, and both take their input and
+// output the same way lz_compress and lz_decompress do.
+//
+
+typedef struct StreamEncoder StreamEncoder;
+
+typedef struct StreamDecoder StreamDecoder;
+
+/*
+ * Constructor: Creates an encoder with codes of at most bits bits, handling a full dictionary as
+ * policy says, and writing bare LZW codes instead of pairs if lzw is set
+ * Returns the new encoder, NULL if memory ran out
+ */
+StreamEncoder *stream_encoder_create(int bits, int policy, bool lzw);
+
+/*
+ * Compresses input into output, finishing the stream once the input runs out if finish is set
+ * Returns LZ_STREAM_END once the stop pair has been written out, LZ_OK before that
+ */
+lz_status stream_encode(StreamEncoder *se, const uint8_t **in, size_t *in_len, uint8_t **out,
+    size_t *out_len, bool finish);
+
+/*
+ * Adds the counters of the encoder to sum
+ */
+void stream_encoder_counters(const StreamEncoder *se, Counters *sum);
+
+/*
+ * Empties the dictionary and zeroes the counters, ready to compress a new stream with the memory
+ * of the previous one
+ */
+void stream_encoder_reset(StreamEncoder *se);
+
+/*
+ * Destructor: Frees the encoder
+ */
+void stream_encoder_delete(StreamEncoder *se);
+
+/*
+ * Constructor: Creates a decoder for codes of at most bits bits and a full dictionary handled as
+ * policy says, reading bare LZW codes instead of pairs if lzw is set
+ * Returns the new decoder, NULL if memory ran out
+ */
+StreamDecoder *stream_decoder_create(int bits, int policy, bool lzw);
+
+/*
+ * Decompresses input into output
+ * Returns LZ_STREAM_END once the stop pair has been read and every word written out,
+ * LZ_DATA_ERROR if a pair refers to a code that does not exist yet, LZ_MEM_ERROR if a word does
+ * not fit into the output and there is no memory to hold it, and LZ_OK otherwise
+ */
+lz_status stream_decode(StreamDecoder *sd, const uint8_t **in, size_t *in_len, uint8_t **out,
+    size_t *out_len);
+
+/*
+ * Adds the counters of the decoder to sum
+ */
+void stream_decoder_counters(const StreamDecoder *sd, Counters *sum);
+
+/*
+ * Empties the word table and zeroes the counters, ready to decompress a new stream with the same
+ * code width, policy and mode, with the memory of the previous one
+ */
+void stream_decoder_reset(StreamDecoder *sd);
+
+/*
+ * Destructor: Frees the decoder
+ */
+void stream_decoder_delete(StreamDecoder *sd);
+
+#endif
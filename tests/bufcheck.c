@@ -0,0 +1,180 @@
+#include "lz78.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SEEK_READS 200 // Ranges read per cache size.
+#define SEEK_SPAN  20000 // Longest range read, several chunks of 4K.
+
+//
+// Checks of the one-shot calls lz_compress_buf and lz_decompress_buf, and of the random access
+// of lz_reader, run by tests/check.sh.
+//
+//   bufcheck round input        round trips input with caps of the bound, one byte short of it
+//                               and one byte short of the compressed size
+//   bufcheck compress in out    writes lz_compress_buf of in to out
+//   bufcheck decompress in out cap
+//                               writes lz_decompress_buf of in to out, given cap bytes for it,
+//                               and fails if it returns -1
+//   bufcheck seek in original   reads ranges of the indexed file in with caches of 1 and 4
+//                               chunks, and compares them against original
+//
+// Failures are reported on stderr and the exit status is 1.
+//
+
+// Reads the whole file at path into *data, returns false if it could not be read
+static bool load(const char *path, uint8_t **data, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    bool ok = file != NULL && fseek(file, 0, SEEK_END) == 0;
+    long end = ok ? ftell(file) : -1;
+
+    ok = end >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    *size = ok ? (size_t) end : 0;
+    *data = ok ? (uint8_t *) malloc(*size + 1) : NULL; // one spare byte, so an empty file is fine
+    ok = *data != NULL && fread(*data, 1, *size, file) == *size;
+
+    if (file != NULL)
+        fclose(file);
+    return ok;
+}
+
+// Writes n bytes of data to the file at path, returns false if they could not all be written
+static bool save(const char *path, const uint8_t *data, size_t n) {
+    FILE *file = fopen(path, "wb");
+    bool ok = file != NULL && fwrite(data, 1, n, file) == n;
+
+    return file != NULL && fclose(file) == 0 && ok;
+}
+
+// Compresses src into a buffer of cap bytes and decompresses it again, returns the compressed
+// size, or -1 after reporting what failed
+static int64_t round_trip(const char *name, const uint8_t *src, size_t n, size_t cap) {
+    uint8_t *packed = (uint8_t *) malloc(cap + 1);
+    uint8_t *unpacked = (uint8_t *) malloc(n + 1);
+    int64_t clen = -1, ulen = -1;
+
+    if (packed != NULL && unpacked != NULL) {
+        clen = lz_compress_buf(src, n, packed, cap);
+        ulen = clen < 0 ? -1 : lz_decompress_buf(packed, clen, unpacked, n);
+    }
+
+    if (clen < 0 || ulen != (int64_t) n || memcmp(unpacked, src, n) != 0) {
+        fprintf(stderr, "%s: Round trip with a cap of %zu bytes failed\n", name, cap);
+        clen = -1;
+    } else if (n > 0 && lz_decompress_buf(packed, clen, unpacked, n - 1) != -1) {
+        fprintf(stderr, "%s: Decompressed into a buffer one byte too small\n", name);
+        clen = -1;
+    }
+
+    free(packed);
+    free(unpacked);
+    return clen;
+}
+
+// Round trips src with every kind of cap
+static bool check_caps(const char *name, const uint8_t *src, size_t n) {
+    size_t bound = lz_compress_bound(n);
+    int64_t clen = round_trip(name, src, n, bound);
+
+    // one byte short of the bound is coded through a stream instead, and should come out the same
+    int64_t short_clen = round_trip(name, src, n, bound - 1);
+    if (clen >= 0 && short_clen >= 0 && short_clen != clen) {
+        fprintf(stderr, "%s: %zu bytes one short of the bound, %zu with it\n", name,
+            (size_t) short_clen, (size_t) clen);
+        return false;
+    }
+
+    // one byte short of what it takes has to fail rather than write past the cap
+    uint8_t *packed = (uint8_t *) malloc(bound + 1);
+    bool ok = clen >= 0 && short_clen >= 0 && packed != NULL;
+
+    if (ok) {
+        memset(packed, 0xA5, bound + 1);
+        ok = lz_compress_buf(src, n, packed, clen - 1) == -1 && packed[clen - 1] == 0xA5;
+
+        if (!ok)
+            fprintf(stderr, "%s: Compressed into a cap one byte too small\n", name);
+    }
+
+    free(packed);
+    return ok;
+}
+
+// Reads ranges of path with a cache of cache chunks, forwards, backwards and at random, and checks
+// them against the n bytes of original
+static bool check_seek(const char *path, const uint8_t *original, size_t n, int cache) {
+    int fd = open(path, O_RDONLY);
+    lz_reader *r = fd >= 0 ? lz_reader_open(fd, cache) : NULL;
+    uint8_t *buf = (uint8_t *) malloc(SEEK_SPAN);
+    uint64_t seed = 1;
+    bool ok = r != NULL && buf != NULL && lz_reader_size(r) == n;
+
+    for (int i = 0; ok && i < SEEK_READS; i++) {
+        seed = seed * 6364136223846793005 + 1442695040888963407;
+
+        // a third each of forward steps, backward steps and jumps, and some past the end
+        size_t len = (seed >> 33) % SEEK_SPAN;
+        size_t offset = i % 3 == 0   ? (size_t) i * n / SEEK_READS
+                        : i % 3 == 1 ? n - (size_t) i * n / SEEK_READS
+                                     : (seed >> 17) % (n + 100);
+        size_t want = offset >= n ? 0 : len < n - offset ? len : n - offset;
+
+        ok = lz_reader_read(r, offset, buf, len) == (int64_t) want
+             && memcmp(buf, original + (offset < n ? offset : n), want) == 0;
+
+        if (!ok)
+            fprintf(stderr, "%s: Range %zu:%zu wrong with a cache of %d\n", path, offset, len,
+                cache);
+    }
+
+    if (r != NULL)
+        lz_reader_close(r);
+    if (fd >= 0)
+        close(fd);
+    free(buf);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint8_t *data = NULL;
+    size_t size = 0;
+    bool ok = false;
+
+    if (argc == 3 && strcmp(argv[1], "round") == 0) {
+        ok = load(argv[2], &data, &size) && check_caps(argv[2], data, size);
+    } else if (argc == 4 && strcmp(argv[1], "compress") == 0) {
+        ok = load(argv[2], &data, &size);
+
+        size_t bound = lz_compress_bound(size);
+        uint8_t *packed = ok ? (uint8_t *) malloc(bound) : NULL;
+        int64_t clen = packed != NULL ? lz_compress_buf(data, size, packed, bound) : -1;
+
+        ok = clen >= 0 && save(argv[3], packed, clen);
+        free(packed);
+    } else if (argc == 5 && strcmp(argv[1], "decompress") == 0) {
+        ok = load(argv[2], &data, &size);
+
+        size_t cap = strtoull(argv[4], NULL, 10);
+        uint8_t *unpacked = ok ? (uint8_t *) malloc(cap + 1) : NULL;
+        int64_t ulen = unpacked != NULL ? lz_decompress_buf(data, size, unpacked, cap) : -1;
+
+        ok = ulen >= 0 && save(argv[3], unpacked, ulen);
+        free(unpacked);
+    } else if (argc == 4 && strcmp(argv[1], "seek") == 0) {
+        ok = load(argv[3], &data, &size) && check_seek(argv[2], data, size, 1)
+             && check_seek(argv[2], data, size, 4);
+    } else {
+        fprintf(stderr,
+            "Usage: %s round input | compress in out | decompress in out cap | seek in original\n",
+            argv[0]);
+    }
+
+    if (!ok && argc >= 3)
+        fprintf(stderr, "%s: %s failed\n", argv[2], argv[1]);
+
+    free(data);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,329 @@
+#!/bin/bash
+#
+# Round trips for 'make check'. Every input, the ones in tests/data and the ones built below, is
+# compressed and decompressed again with each set of options and has to come back unchanged.
+# Default files also have to be byte for byte what the original encoder wrote, whose SHA-256 sums
+# are recorded in tests/baseline.sha256.
+#
+# Runs encode and decode from the top directory, so build them first.
+#
+
+cd "$(dirname "$0")/.." || exit 1
+umask 022 # the mode of the output is recorded in the header, as it was by the original encoder
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+IN="$TMP/in"
+failed=0
+
+# Reports a case that failed and goes on with the others
+fail() {
+    echo "FAIL: $*"
+    failed=$((failed + 1))
+}
+
+# Compresses and decompresses every input with the encode options in $1 and the decode options in
+# $2, and checks that it comes back unchanged
+roundtrip() {
+    for f in "$IN"/*; do
+        n=$(basename "$f")
+
+        if ! ./encode -i "$f" -o "$TMP/$n.lz" $1; then
+            fail "encode $1: $n"
+        elif ! ./decode -i "$TMP/$n.lz" -o "$TMP/$n.out" $2; then
+            fail "decode $2 after encode $1: $n"
+        elif ! cmp -s "$f" "$TMP/$n.out"; then
+            fail "round trip encode $1, decode $2: $n"
+        fi
+    done
+}
+
+# Overwrites the bytes of file at offset with the printf format in $3
+poke() {
+    printf "$3" | dd of="$1" bs=1 seek="$2" conv=notrunc 2> /dev/null
+}
+
+# Runs a command whose files cannot grow past 64K, with SIGXFSZ ignored so that the writes past it
+# fail with EFBIG instead
+limited() {
+    (trap '' XFSZ; ulimit -f 64; "$@" 2> /dev/null)
+}
+
+# inputs too regular to be worth checking in, with phrases far longer than a buffer in zeros
+mkdir "$IN"
+cp tests/data/* "$IN"/
+head -c 100000 /dev/zero > "$IN/zeros"
+yes abcabcabd | head -c 50000 > "$IN/rep"
+: > "$IN/empty"
+printf a > "$IN/one"
+printf ab > "$IN/two"
+
+# default files, byte for byte
+while read -r sum name; do
+    ./encode -i "$IN/$name" -o "$TMP/$name.lz"
+    [ "$(sha256sum < "$TMP/$name.lz" | cut -d' ' -f1)" = "$sum" ] || fail "baseline: $name"
+done < tests/baseline.sha256
+
+roundtrip "" ""
+
+# code widths, with 12 bits filling up and resetting on the larger inputs
+for bits in 12 13 20 24; do
+    roundtrip "-w $bits" ""
+done
+
+
+# chunked files: several chunks per input on several threads, chunks smaller than an input, and a
+# chunk size alone, decoded on one thread and on several
+roundtrip "-T 3 -C 4K" ""
+roundtrip "-T 2 -C 8K -w 12" "-T 3"
+roundtrip "-C 64K" "-T 2"
+roundtrip "-T 4" "-T 4"
+
+# a damaged chunk header claiming far more symbols than its payload can hold is turned down before
+# anything is allocated for it
+./encode -i "$IN/two" -o "$TMP/huge.lz" -T 2
+poke "$TMP/huge.lz" 8 '\0\0\0\40'
+msg=$( (ulimit -v 300000; ./decode -i "$TMP/huge.lz" -o "$TMP/huge.out" -T 2) 2>&1)
+[[ $msg == *Damaged* ]] || fail "chunk header claiming 512M symbols: $msg"
+
+# dictionary policies, at 12 bits so that the dictionary fills up and decides, unchunked and chunked
+for policy in reset freeze adaptive lru; do
+    roundtrip "-p $policy -w 12" ""
+    roundtrip "-p $policy -w 12 -T 2 -C 8K" "-T 2"
+done
+
+# LZW codes, with every policy that goes with them, wide and narrow codes and chunks
+roundtrip "-l" ""
+for policy in reset freeze adaptive; do
+    roundtrip "-l -p $policy -w 12" ""
+done
+roundtrip "-l -w 20 -T 2 -C 4K" "-T 3"
+
+# entropy coded symbols, which need chunks, whether rANS wins on them or they are stored as they
+# are, and with the narrowest codes under every policy
+roundtrip "-e -T 2" "-T 2"
+roundtrip "-e -T 3 -C 4K" ""
+for policy in reset freeze adaptive lru; do
+    roundtrip "-e -p $policy -w 12 -T 2 -C 16K" "-T 2"
+done
+
+# checksummed chunks, and tests of every file that write nothing
+roundtrip "-c -T 2 -C 4K" "-T 2"
+roundtrip "-c -e -T 2" ""
+for f in "$IN"/*; do
+    n=$(basename "$f")
+    ./encode -i "$f" -o "$TMP/$n.lz" -c -T 2 -C 4K
+    [ "$(./decode -i "$TMP/$n.lz" -t -T 2)" = "" ] || fail "test of an intact file: $n"
+done
+
+# a flipped bit in the checksum of the first chunk, which decodes fine otherwise, is caught by both
+# a test and a decode
+./encode -i "$IN/text" -o "$TMP/crc.lz" -c -T 2 -C 4K
+clen=$(od -An -t u4 -j 12 -N 4 --endian=little "$TMP/crc.lz" | tr -d ' ')
+last=$(od -An -t u1 -j $((16 + clen - 1)) -N 1 "$TMP/crc.lz" | tr -d ' ')
+poke "$TMP/crc.lz" $((16 + clen - 1)) "\\$(printf %o $((last ^ 1)))"
+./decode -i "$TMP/crc.lz" -t 2> /dev/null && fail "test of a bad checksum"
+./decode -i "$TMP/crc.lz" -o "$TMP/crc.out" 2> /dev/null && fail "decode of a bad checksum"
+
+# the one-shot calls of the library, with caps of the bound, one byte short of it and too small,
+# against the files of encode and decode, single stream and chunked, and given exactly the room
+# the input takes
+for f in "$IN"/*; do
+    n=$(basename "$f")
+    size=$(stat -c %s "$f")
+
+    tests/bufcheck round "$f" || fail "buffer round trip: $n"
+    tests/bufcheck compress "$f" "$TMP/$n.buf" && ./decode -i "$TMP/$n.buf" | cmp -s "$f" - \
+        || fail "decode of lz_compress_buf: $n"
+
+    for options in "" "-T 2 -C 4K" "-e -c -T 2"; do
+        ./encode -i "$f" -o "$TMP/$n.lz" $options
+        tests/bufcheck decompress "$TMP/$n.lz" "$TMP/$n.out" "$size" && cmp -s "$f" "$TMP/$n.out" \
+            || fail "lz_decompress_buf after encode $options: $n"
+    done
+done
+
+# damaged input, not an lz file, cut short, a flipped checksum and too little room, returns -1
+size=$(stat -c %s "$IN/text")
+./encode -i "$IN/text" -o "$TMP/buf.lz"
+./encode -i "$IN/text" -o "$TMP/bufchunks.lz" -T 2 -C 4K
+head -c $(($(stat -c %s "$TMP/buf.lz") / 2)) "$TMP/buf.lz" > "$TMP/half.lz"
+for damaged in "$IN/text:$size" "$TMP/half.lz:$size" "$TMP/crc.lz:$size" \
+    "$TMP/buf.lz:$((size - 1))" "$TMP/bufchunks.lz:$((size - 1))"; do
+    tests/bufcheck decompress "${damaged%:*}" "$TMP/damaged.out" "${damaged#*:}" 2> /dev/null \
+        && fail "lz_decompress_buf of damaged input: $damaged"
+done
+
+# through pipes, which cannot be mapped and come up short on every read
+for f in "$IN"/*; do
+    cat "$f" | ./encode | ./decode | cmp -s "$f" - \
+        || fail "round trip through pipes: $(basename "$f")"
+done
+
+# a named input that cannot be read twice, which decode must not open again to look for an archive
+mkfifo "$TMP/fifo"
+./encode -i "$IN/text" -o "$TMP/text.lz"
+cat "$TMP/text.lz" > "$TMP/fifo" &
+writer=$!
+timeout 10 ./decode -i "$TMP/fifo" -o "$TMP/fifo.out" && cmp -s "$IN/text" "$TMP/fifo.out" \
+    || fail "decode of a FIFO"
+kill $writer 2> /dev/null # still waiting for a reader if decode never opened it
+wait $writer 2> /dev/null
+cat "$TMP/text.lz" | ./decode -i /dev/stdin | cmp -s "$IN/text" - || fail "decode of /dev/stdin"
+
+# read and write errors fail with an error rather than looking like the end of the file
+./encode -i "$IN/text" -o "$TMP/text.lz"
+./encode -i "$IN" -o "$TMP/dir.lz" 2> /dev/null && fail "encode of a directory"
+./decode -i "$IN" -o "$TMP/dir.out" 2> /dev/null && fail "decode of a directory"
+./encode -i "$IN/text" -o /dev/full 2> /dev/null && fail "encode to a full disk"
+./decode -i "$TMP/text.lz" -o /dev/full 2> /dev/null && fail "decode to a full disk"
+
+# the reader and writer threads of --pipeline, on files, through pipes and on errors
+roundtrip "--pipeline" "--pipeline"
+roundtrip "--pipeline -T 2 -C 64K" "--pipeline -T 2"
+for f in "$IN"/*; do
+    cat "$f" | ./encode --pipeline | ./decode --pipeline | cmp -s "$f" - \
+        || fail "round trip through pipes with --pipeline: $(basename "$f")"
+done
+./encode -i "$IN" -o "$TMP/dir.lz" --pipeline 2> /dev/null \
+    && fail "encode --pipeline of a directory"
+./encode -i "$IN/text" -o /dev/full --pipeline 2> /dev/null \
+    && fail "encode --pipeline to a full disk"
+./decode -i "$TMP/text.lz" -o /dev/full --pipeline 2> /dev/null \
+    && fail "decode --pipeline to a full disk"
+
+# regular files past the size limit, which --pipeline writes through io_uring where the kernel has
+# it
+./encode -i "$IN/random" -o "$TMP/random.lz"
+for piped in "" --pipeline; do
+    limited ./encode -i "$IN/random" -o "$TMP/big.lz" $piped \
+        && fail "encode $piped past the file size limit"
+    limited ./decode -i "$TMP/random.lz" -o "$TMP/big.out" $piped \
+        && fail "decode $piped past the file size limit"
+done
+
+# buffer sizes, the smallest one and one that is not a power of two, and O_DIRECT, which leaves
+# the unaligned tail of every file, and pipes, to the page cache
+roundtrip "--buffer 64K" "--buffer 68K"
+roundtrip "--buffer 68K --pipeline" "--buffer 64K --pipeline"
+roundtrip "--direct" "--direct"
+roundtrip "--direct --pipeline -T 2 -C 64K" "--direct --pipeline --buffer 68K"
+roundtrip "--direct --buffer 68K" "--direct -T 2"
+for f in "$IN"/*; do
+    cat "$f" | ./encode --direct | ./decode --direct | cmp -s "$f" - \
+        || fail "round trip through pipes with --direct: $(basename "$f")"
+done
+
+# ranges within a chunk, across chunks, up to the end, past it and empty, against the same bytes
+# cut out of the input
+for f in "$IN"/*; do
+    n=$(basename "$f")
+    size=$(stat -c %s "$f")
+    ./encode -i "$f" -o "$TMP/$n.lz" -T 2 -C 4K
+
+    for range in 0:10 100:4000 3000:9000 5000:1M $((size / 2)):1 $size:10 $((size + 5)):1 0:0; do
+        offset=${range%:*}
+        length=$(numfmt --from=iec "${range#*:}")
+
+        if ! ./decode -i "$TMP/$n.lz" -o "$TMP/$n.out" -r "$range"; then
+            fail "decode -r $range: $n"
+        elif ! tail -c +$((offset + 1)) "$f" | head -c "$length" | cmp -s - "$TMP/$n.out"; then
+            fail "range $range: $n"
+        fi
+    done
+
+    # the same through lz_reader of the library, with caches of one chunk and of several
+    tests/bufcheck seek "$TMP/$n.lz" "$f" || fail "lz_reader: $n"
+done
+
+# a damaged index fails the range instead of reading outside of it: no chunks for 100 symbols, and
+# a last chunk starting before the one ahead of it
+./encode -i "$IN/text" -o "$TMP/idx.lz" -T 2 -C 4K
+end=$(stat -c %s "$TMP/idx.lz")
+cp "$TMP/idx.lz" "$TMP/idx0.lz"
+poke "$TMP/idx0.lz" $((end - 24)) '\0\0\0\0\0\0\0\0\144\0\0\0\0\0\0\0'
+poke "$TMP/idx.lz" $((end - 40)) '\1\0\0\0\0\0\0\0'
+
+for damaged in idx0 idx; do
+    msg=$(./decode -i "$TMP/$damaged.lz" -o "$TMP/$damaged.out" -r 0:10 2>&1)
+    [[ $msg == *"needs an intact"* ]] || fail "range of a damaged index: $damaged: $msg"
+done
+./encode -i "$IN/text" -o "$TMP/idx.lz" -T 2 -C 4K
+./decode -i "$TMP/idx.lz" -o /dev/full -r 0:10 2> /dev/null && fail "range to a full disk"
+
+# batches of files next to themselves, from a list, into a directory and into an archive
+mkdir "$TMP/batch"
+cp "$IN"/* "$TMP/batch"/
+./encode -i "$TMP/batch/text" -i "$TMP/batch/zeros" -T 2 || fail "encode of a batch"
+ls "$TMP/batch"/* | grep -v -e '\.lz$' -e '/text$' -e '/zeros$' > "$TMP/batch.list"
+./encode -I "$TMP/batch.list" -C 4K || fail "encode of a listed batch"
+for f in "$IN"/*; do
+    mv "$TMP/batch/$(basename "$f")" "$TMP/batch/$(basename "$f").orig"
+done
+./decode -I <(ls "$TMP/batch"/*.lz) -t || fail "test of a batch"
+./decode -I <(ls "$TMP/batch"/*.lz) -o "$TMP/batch/out" || fail "decode of a batch into a directory"
+./decode -I <(ls "$TMP/batch"/*.lz) || fail "decode of a batch"
+./encode -I <(ls "$TMP/batch"/*.orig) -o "$TMP/batch.lza" -T 3 || fail "encode of an archive"
+./decode -i "$TMP/batch.lza" -t || fail "test of an archive"
+./decode -i "$TMP/batch.lza" -o "$TMP/batch/arch" || fail "decode of an archive"
+for f in "$IN"/*; do
+    n=$(basename "$f")
+    cmp -s "$f" "$TMP/batch/out/$n" && cmp -s "$f" "$TMP/batch/$n" \
+        && cmp -s "$f" "$TMP/batch/arch/${TMP#/}/batch/$n.orig" || fail "round trip of a batch: $n"
+done
+
+# outputs that exist are left alone without -f, the archive included, and overwritten with it
+cp "$TMP/batch/text" "$TMP/batch/keep"
+./decode -i "$TMP/batch/text.lz" -i "$TMP/batch/zeros.lz" 2> /dev/null \
+    && fail "decode of a batch over its outputs"
+./encode -i "$TMP/batch/one.orig" -i "$TMP/batch/two.orig" -o "$TMP/batch/keep" 2> /dev/null \
+    && fail "encode of an archive over a file"
+cmp -s "$IN/text" "$TMP/batch/keep" || fail "file overwritten by a batch"
+cp "$IN/one" "$TMP/batch/text"
+./decode -i "$TMP/batch/text.lz" -i "$TMP/batch/zeros.lz" -f \
+    && cmp -s "$IN/text" "$TMP/batch/text" || fail "decode -f of a batch over its outputs"
+./encode -i "$TMP/batch/one.orig" -i "$TMP/batch/two.orig" -o "$TMP/batch/keep" -f \
+    && ./decode -i "$TMP/batch/keep" -t || fail "encode -f of an archive over a file"
+
+# two inputs writing the same output or member, of which only the first one is coded
+cp "$IN/two" "$TMP/batch/out/text.lz"
+rm "$TMP/batch/text"
+msg=$(./decode -i "$TMP/batch/text.lz" -i "$TMP/batch/out/text.lz" -o "$TMP/batch" 2>&1)
+cmp -s "$IN/text" "$TMP/batch/text" && [[ $msg == *"Same output"* ]] \
+    || fail "decode of two inputs to the same output: $msg"
+msg=$(./encode -i "$TMP/batch/one.orig" -i "$TMP/batch/two.orig" -i "$TMP/batch/one.orig" \
+    -o "$TMP/dup.lza" 2>&1)
+./decode -i "$TMP/dup.lza" -o "$TMP/batch/dup" && [[ $msg == *"Same member"* ]] \
+    && [ "$(find "$TMP/batch/dup" -type f | wc -l)" = 2 ] \
+    || fail "archive of a repeated input: $msg"
+
+# archives keep names below the directory they are extracted into, the way tar does: leading
+# slashes, "." parts and everything up to the last ".." are dropped on both sides
+mkdir -p "$TMP/names/sub" "$TMP/names/out"
+cp "$IN/text" "$TMP/names/sub/text"
+cp "$IN/two" "$TMP/names/two"
+(cd "$TMP/names/sub" && "$OLDPWD/encode" -i ./text -i ../two -o "$TMP/names.lza") \
+    || fail "archive of relative names"
+./decode -i "$TMP/names.lza" -o "$TMP/names/out" && cmp -s "$IN/text" "$TMP/names/out/text" \
+    && cmp -s "$IN/two" "$TMP/names/out/two" || fail "members of relative names"
+msg=$(./encode -i "$IN/text" -i "$IN/.." -o "$TMP/dots.lza" 2>&1)
+[[ $msg == *"No name left"* ]] || fail "archive of a name with nothing left: $msg"
+
+# a member named ../../x by some other writer lands inside the directory as x
+./encode -i "$IN/two" -o "$TMP/x.lz"
+size=$(stat -c %s "$TMP/x.lz")
+head -c 16 "$TMP/names.lza" > "$TMP/evil.lza"
+poke "$TMP/evil.lza" 4 '\7\0\0\0'
+poke "$TMP/evil.lza" 8 "\\$(printf %o "$size")\0\0\0\0\0\0\0"
+printf ../../x >> "$TMP/evil.lza"
+cat "$TMP/x.lz" >> "$TMP/evil.lza"
+mkdir -p "$TMP/evil/a/b"
+./decode -i "$TMP/evil.lza" -o "$TMP/evil/a/b" && cmp -s "$IN/two" "$TMP/evil/a/b/x" \
+    && [ ! -e "$TMP/evil/x" ] || fail "member named ../../x"
+
+if [ $failed -gt 0 ]; then
+    echo "$failed checks failed"
+    exit 1
+fi
+
+echo "All checks passed"
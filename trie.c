@@ -1,66 +1,49 @@
 #include "trie.h"
 #include "code.h"
-#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
-// Constructor for trie_node
-TrieNode *trie_node_create(uint16_t index) {
-    TrieNode *newNode = (TrieNode *) calloc(1, sizeof(TrieNode));
-    newNode->code = index;
+#define ARENA_SIZE ((size_t) MAX_CODE * sizeof(TrieNode)) // one node per code
 
-    for (int i = 0; i < ALPHABET; i++)
-        newNode->children[i] = NULL;
+// Constructor for trie_node: hands out the arena slot belonging to index
+TrieNode *trie_node_create(TrieNode *root, uint32_t index) {
+    TrieNode *newNode = root + (index - EMPTY_CODE); // root sits at EMPTY_CODE
 
-    return newNode;
-}
-
-// Destructor for trie_node
-void trie_node_delete(TrieNode *n) {
-    n->code = 0; // set node code to 0
-    free(n); // free memory from heap
+    // the slot may still hold the children it had before the last reset
+    memset(newNode->children, 0, sizeof(newNode->children));
+    newNode->code = index;
 
-    n = NULL;
+    return newNode;
 }
 
-// Initializes a trie_node
+// Initializes a trie_node arena and its root
 TrieNode *trie_create(void) {
-    TrieNode *root = trie_node_create(EMPTY_CODE);
+    // anonymous mappings are zero filled and only take memory as pages are touched
+    TrieNode *arena = (TrieNode *) mmap(
+        NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-    if (root == NULL)
+    if (arena == MAP_FAILED)
         return NULL;
 
-    return root;
+#ifdef MADV_HUGEPAGE
+    madvise(arena, ARENA_SIZE, MADV_HUGEPAGE); // only a hint, fine if it is refused
+#endif
+
+    return trie_node_create(arena + EMPTY_CODE, EMPTY_CODE);
 }
 
 // Resets a trie_node to only contain the root node
 void trie_reset(TrieNode *root) {
-    for (int i = 0; i < ALPHABET; i++) {
-        // if child exists
-        if (root->children[i] != NULL) {
-            trie_node_delete(root->children[i]); // delete that child node
-            root->children[i] = NULL; // set this child to NULL
-        }
-    }
+    // every other node is unreachable once root has no children, and is cleared when reused
+    memset(root->children, 0, sizeof(root->children));
 }
 
-// deletes a sub-trie starting from node n
-void trie_delete(TrieNode *n) {
-    for (int i = 0; i < ALPHABET; i++) {
-        if (n->children[i] != NULL) // if child exists
-            trie_delete(
-                n->children[i]); // delete that node and all its children by setting them to NULL
-    }
-
-    trie_node_delete(n);
+// deletes the trie rooted at root by unmapping its arena
+void trie_delete(TrieNode *root) {
+    munmap(root - EMPTY_CODE, ARENA_SIZE);
 }
 
 // returns pointer of child containing symbol sym, or NULL if it doesn't exist
 TrieNode *trie_step(TrieNode *n, uint8_t sym) {
-    // iterate through all possible children
-    for (int i = 0; i < ALPHABET; i++) {
-        if (n->children[i] != NULL) // if child exists
-            if (i == sym) // if child index is the same as sym
-                return n->children[i];
-    }
-
-    return NULL; // no child with symbol sym found
+    return n->children[sym];
 }
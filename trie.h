@@ -7,45 +7,49 @@
 
 typedef struct TrieNode TrieNode;
 
+//
+// The codec no longer uses this trie, see dict.h. It is kept out of liblz78 and only linked into
+// microbench, as the baseline the dictionary kernels are measured against.
+//
+
+//
+// Trie nodes are not allocated one at a time. trie_create maps an arena of MAX_CODE nodes up front
+// and the node for code c always lives at index c of that arena, with the root at EMPTY_CODE.
+// Creating a node is just clearing its slot, and resetting the trie rewinds the arena, so neither
+// touches the allocator and nothing can leak.
+//
+
 struct TrieNode {
     TrieNode *children[ALPHABET];
-    uint16_t code;
+    uint32_t code;
 };
 
 /*
- * Creates a new TrieNode and returns a pointer to it
- * Allocate memory for TrieNode
+ * Creates a new TrieNode in the arena of the trie rooted at root and returns a pointer to it
  * Code is the code to be assigned to this new node
- * Returns the newly allocated node
- */
-TrieNode *trie_node_create(uint16_t code);
-
-/*
- * Deletes Node n
- * Frees any allocated memory
+ * Returns the node with no children
  */
-void trie_node_delete(TrieNode *n);
+TrieNode *trie_node_create(TrieNode *root, uint32_t code);
 
 /*
- * Constructor: Creates the root TrieNode and returns a pointer to it
- * Allocate memory for TrieNode
- * Code is START_CODE
- * Returns the newly allocated node
+ * Constructor: Maps the node arena and returns a pointer to the root TrieNode
+ * Backed by huge pages where the system allows it
+ * Code is EMPTY_CODE
+ * Returns the root node, NULL if the arena could not be mapped
  */
 TrieNode *trie_create(void);
 
 /*
  * Resets the trie: called when code reaches MAX_CODE
- * Deletes all the children of root and frees allocated memory
+ * Rewinds the arena by dropping the children of root, in constant time
  */
 void trie_reset(TrieNode *root);
 
 /*
- * Destructor: Deletes all nodes starting at n as the root
- * Deletes any children recursively before deleting the root
- * Frees all the memory allocated for TrieNodes n and below
+ * Destructor: Deletes the trie rooted at root
+ * Unmaps the whole node arena
  */
-void trie_delete(TrieNode *n);
+void trie_delete(TrieNode *root);
 
 /*
  * Checks if node has any children called sym
@@ -0,0 +1,181 @@
+#include "uring.h"
+#include "stats.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct Uring {
+    int fd;
+    unsigned entries; // requests allowed in flight
+    unsigned queued; // requests queued but not sent to the kernel yet
+    unsigned inflight; // requests queued or sent whose completion has not been taken
+
+    // submission ring, shared with the kernel, which moves the head
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+
+    // completion ring, shared with the kernel, which moves the tail
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_map, *cq_map; // the same mapping with IORING_FEAT_SINGLE_MMAP
+    size_t sq_size, cq_size, sqes_size;
+};
+
+// Maps part of the ring, returns NULL if it could not be mapped
+static void *map_ring(int fd, size_t size, off_t offset) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Constructor for Uring
+Uring *uring_create(unsigned entries, uint8_t *const *bufs, int count, size_t size) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) // ENOSYS before 5.1, EPERM where it is disabled or filtered out
+        return NULL;
+
+    Uring *u = (Uring *) calloc(1, sizeof(Uring));
+    if (u == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    u->fd = fd;
+    u->entries = params.sq_entries;
+    u->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    u->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        u->sq_size = u->cq_size = u->sq_size > u->cq_size ? u->sq_size : u->cq_size;
+        u->sq_map = u->cq_map = map_ring(fd, u->sq_size, IORING_OFF_SQ_RING);
+    } else {
+        u->sq_map = map_ring(fd, u->sq_size, IORING_OFF_SQ_RING);
+        u->cq_map = map_ring(fd, u->cq_size, IORING_OFF_CQ_RING);
+    }
+
+    u->sqes = (struct io_uring_sqe *) map_ring(fd, u->sqes_size, IORING_OFF_SQES);
+
+    struct iovec iov[count];
+    for (int i = 0; i < count; i++)
+        iov[i] = (struct iovec) { bufs[i], size };
+
+    // registering fails where the buffers do not fit under RLIMIT_MEMLOCK, before 5.12
+    if (u->sq_map == NULL || u->cq_map == NULL || u->sqes == NULL
+        || syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, iov, count) != 0) {
+        uring_delete(u);
+        return NULL;
+    }
+
+    uint8_t *sq = (uint8_t *) u->sq_map;
+    u->sq_head = (unsigned *) (sq + params.sq_off.head);
+    u->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    u->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    u->sq_array = (unsigned *) (sq + params.sq_off.array);
+
+    uint8_t *cq = (uint8_t *) u->cq_map;
+    u->cq_head = (unsigned *) (cq + params.cq_off.head);
+    u->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    u->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return u;
+}
+
+// Fills in the next submission queue entry, the kernel only sees it on the next io_uring_enter
+static bool queue(Uring *u, uint8_t opcode, int fd, int buf, const uint8_t *data, size_t n,
+    uint64_t offset, uint64_t tag) {
+    if (u->inflight == u->entries)
+        return false;
+
+    unsigned tail = *u->sq_tail; // only moved by this side
+    unsigned index = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t) data;
+    sqe->len = (uint32_t) n;
+    sqe->off = offset;
+    sqe->buf_index = (uint16_t) buf;
+    sqe->user_data = tag;
+
+    u->sq_array[index] = index;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE); // entry first, then the tail
+    u->queued++;
+    u->inflight++;
+
+    STAT_ADD(io_counters.uring_ops, 1);
+    return true;
+}
+
+// Queues a read into a registered buffer
+bool uring_read(Uring *u, int fd, int buf, uint8_t *data, size_t n, uint64_t offset, uint64_t tag) {
+    return queue(u, IORING_OP_READ_FIXED, fd, buf, data, n, offset, tag);
+}
+
+// Queues a write from a registered buffer
+bool uring_write(
+    Uring *u, int fd, int buf, const uint8_t *data, size_t n, uint64_t offset, uint64_t tag) {
+    return queue(u, IORING_OP_WRITE_FIXED, fd, buf, data, n, offset, tag);
+}
+
+// Submits whatever is queued and takes the oldest completion, with a single system call when both
+// are needed and none when a completion is already waiting and nothing is queued
+bool uring_wait(Uring *u, uint64_t *tag, int *res) {
+    uint64_t start = stat_clock();
+    unsigned head = *u->cq_head; // only moved by this side
+
+    if (u->inflight == 0)
+        return false;
+
+    for (;;) {
+        bool ready = head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+        if (ready && u->queued == 0)
+            break;
+
+        unsigned min_complete = ready ? 0 : 1;
+        int sent = (int) syscall(__NR_io_uring_enter, u->fd, u->queued, min_complete,
+            min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        STAT_ADD(io_counters.uring_enters, 1);
+
+        if (sent < 0 && errno != EINTR) {
+            STAT_ADD(io_counters.ns, stat_clock() - start);
+            return false;
+        }
+
+        if (sent > 0)
+            u->queued -= sent;
+    }
+
+    struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+    *tag = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE); // entry read first, then the head
+    u->inflight--;
+
+    STAT_ADD(io_counters.ns, stat_clock() - start);
+    return true;
+}
+
+// Destructor for Uring, closing the ring also unregisters the buffers
+void uring_delete(Uring *u) {
+    if (u->sqes != NULL)
+        munmap(u->sqes, u->sqes_size);
+    if (u->cq_map != NULL && u->cq_map != u->sq_map)
+        munmap(u->cq_map, u->cq_size);
+    if (u->sq_map != NULL)
+        munmap(u->sq_map, u->sq_size);
+
+    close(u->fd);
+    free(u);
+}
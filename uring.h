@@ -0,0 +1,56 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// A minimal io_uring, spoken to through the raw system calls so that no liburing is needed.
+//
+// It only queues reads and writes at explicit file offsets into a fixed set of buffers that are
+// registered with the kernel when it is created, so the kernel does not have to pin and map the
+// pages again for every request. Several requests can be in flight at once, and any number of them
+// go to the kernel with a single io_uring_enter, which is also where completions are waited for.
+//
+// Kernels without io_uring, or that refuse it to this process, make uring_create return NULL, and
+// the caller goes on with read() and write() instead.
+//
+
+typedef struct Uring Uring;
+
+/*
+ * Constructor: Sets up a ring with room for entries requests in flight, and registers the count
+ * buffers of size bytes in bufs, which are known by their index from then on
+ * Returns the new ring, NULL if io_uring is not available
+ */
+Uring *uring_create(unsigned entries, uint8_t *const *bufs, int count, size_t size);
+
+/*
+ * Queues a read of n bytes at offset of fd into data, which lies inside registered buffer buf
+ * tag comes back with its completion
+ * Returns false if entries requests are queued or in flight already
+ */
+bool uring_read(Uring *u, int fd, int buf, uint8_t *data, size_t n, uint64_t offset, uint64_t tag);
+
+/*
+ * Queues a write of n bytes of data, inside registered buffer buf, to fd at offset
+ * tag comes back with its completion
+ * Returns false if entries requests are queued or in flight already
+ */
+bool uring_write(
+    Uring *u, int fd, int buf, const uint8_t *data, size_t n, uint64_t offset, uint64_t tag);
+
+/*
+ * Sends the queued requests to the kernel and waits for one of the requests in flight to complete
+ * Stores its tag in *tag and its result, bytes moved or -errno, in *res
+ * Returns false if the kernel refused the requests
+ */
+bool uring_wait(Uring *u, uint64_t *tag, int *res);
+
+/*
+ * Destructor: Tears the ring down, which must have nothing in flight
+ */
+void uring_delete(Uring *u);
+
+#endif
@@ -1,82 +1,99 @@
 #include "word.h"
 #include "code.h"
-#include <stdio.h>
 #include <stdlib.h>
 
-// Constructor for a new word
-Word *word_create(uint8_t *syms, uint32_t len) {
+// Constructor for WordTable
+WordTable *wt_create(uint32_t max_code) {
+    WordTable *wt = (WordTable *) calloc(1, sizeof(WordTable)); // initalize new word table
 
-    Word *newWord = (Word *) calloc(1, sizeof(Word)); // allocate memory to new Word
-    newWord->syms = (uint8_t *) calloc(len, sizeof(uint8_t)); // allocate memory to sym array
+    if (wt == NULL)
+        return NULL;
 
-    newWord->len = len;
+    // max_code itself never gets a word, but it still fits in the widest pair
+    size_t size = (size_t) max_code + 1;
 
-    // copy ASCII value symbols from parameter onto new word
-    for (uint32_t i = 0; i < len; i++)
-        newWord->syms[i] = syms[i];
+    wt->prefix = (uint32_t *) calloc(size, sizeof(uint32_t));
+    wt->syms = (uint8_t *) calloc(size, sizeof(uint8_t));
+    wt->lens = (uint32_t *) calloc(size, sizeof(uint32_t));
 
-    if (newWord == NULL)
+    if (wt->prefix == NULL || wt->syms == NULL || wt->lens == NULL) {
+        wt_delete(wt);
         return NULL;
+    }
 
-    return newWord;
+    wt->lens[EMPTY_CODE] = 0; // index EMPTY_CODE is empty word
+    return wt;
 }
 
-// Add parameter sym to the end of word
-Word *word_append_sym(Word *w, uint8_t sym) {
-    uint8_t *newTempSym = (uint8_t *) calloc(w->len + 1, sizeof(uint8_t));
-
-    // copy ASCII value symbols from old word onto new word
-    for (uint32_t i = 0; i < w->len; i++)
-        newTempSym[i] = w->syms[i];
+// Stores the word prefix + sym under code
+static inline void wt_store(WordTable *wt, uint32_t code, uint32_t prefix, uint8_t sym) {
+    wt->prefix[code] = prefix;
+    wt->syms[code] = sym;
+    wt->lens[code] = wt->lens[prefix] + 1;
+}
 
-    newTempSym[w->len] = sym; // append by placing sym into length index - 1
+// Add the word prefix + sym as code
+void wt_add(WordTable *wt, uint32_t code, uint32_t prefix, uint8_t sym) {
+    wt_store(wt, code, prefix, sym);
 
-    Word *wordCopy = word_create(newTempSym, (w->len + 1)); // create a newWord copy with len+1
-    free(newTempSym);
+    if (wt->lru != NULL)
+        lru_add(wt->lru, code, prefix, sym);
+}
 
-    return wordCopy;
+// Add the one-symbol words from first on
+void wt_seed(WordTable *wt, uint32_t first) {
+    for (uint32_t sym = 0; sym < LITERALS; sym++)
+        wt_store(wt, first + sym, EMPTY_CODE, sym);
 }
 
-// Destructor for a Word
-void word_delete(Word *w) {
-    // set all values to 0 and null, then free their pointers
-    w->len = 0;
-    free(w->syms);
-    w->syms = NULL;
+// Add the word prefix + sym under the code of the least recently used leaf word
+uint32_t wt_recycle(WordTable *wt, uint32_t prefix, uint8_t sym) {
+    uint32_t code = lru_evict(wt->lru, prefix);
+
+    if (code == STOP_CODE) {
+        wt_store(wt, wt->lru->max_code, prefix, sym);
+        return wt->lru->max_code;
+    }
+
+    wt_add(wt, code, prefix, sym);
+    return code;
+}
 
-    free(w);
-    w = NULL;
+// Tracks the usage order of the words
+bool wt_track(WordTable *wt, uint32_t max_code) {
+    wt->lru = lru_create(max_code);
+    return wt->lru != NULL;
 }
 
-// Constructor for WordTable
-WordTable *wt_create(void) {
-    WordTable *words = (WordTable *) calloc(MAX_CODE, sizeof(Word)); // initalize new word table
-    words[EMPTY_CODE] = word_create(NULL, 0); // index EMPTY_CODE is empty word
+// Write the symbols of code into out, last symbol first
+uint32_t wt_copy(WordTable *wt, uint32_t code, uint8_t *out) {
+    uint32_t len = wt->lens[code];
+
+    // walking exactly len links keeps this bounded even if a damaged stream made a cycle
+    for (uint32_t i = len; i > 0; i--) {
+        out[i - 1] = wt->syms[code];
+        code = wt->prefix[code];
+    }
 
-    return words;
+    return len;
 }
 
 // Resets Wordtable to only contain empty word
 void wt_reset(WordTable *wt) {
-    // iterate from index after EMPTY_CODE
-    for (int i = EMPTY_CODE + 1; i < MAX_CODE; i++) {
-        // if word exists
-        if (wt[i] != NULL) {
-            word_delete(wt[i]);
-            wt[i] = NULL;
-        }
-    }
+    // nothing to free: a code is always added again before a valid stream refers to it, only the
+    // usage order starts over
+    if (wt->lru != NULL)
+        lru_reset(wt->lru);
 }
 
 // Destructor for WordTable
 void wt_delete(WordTable *wt) {
-    // delete all words and free memory
-    for (int i = 0; i < MAX_CODE; i++) {
-        if (wt[i] != NULL) {
-            word_delete(wt[i]);
-            wt[i] = NULL;
-        }
-    }
+    free(wt->prefix);
+    free(wt->syms);
+    free(wt->lens);
+
+    if (wt->lru != NULL)
+        lru_delete(wt->lru);
 
     free(wt);
 }
@@ -1,49 +1,79 @@
 #ifndef __WORD_H__
 #define __WORD_H__
 
+#include "lru.h"
+#include "stats.h"
+#include <stdbool.h>
 #include <stdint.h>
 
-typedef struct Word {
-    uint8_t *syms;
-    uint32_t len;
-} Word;
+//
+// Decoder dictionary.
+//
+// Every word is the word of some earlier code extended by one symbol, so instead of storing its
+// symbols the table stores that earlier code (the prefix), the last symbol and the length, each in
+// a flat array indexed by code. Adding a word is then three stores, and the symbols of a word are
+// produced on demand by following the prefix links backward from its last symbol.
+//
+// With POLICY_LRU the table tracks the usage order of its words exactly like the encoder's
+// dictionary does, so that both recycle the same codes.
+//
 
-typedef Word *WordTable;
+typedef struct WordTable {
+    uint32_t *prefix; // code of the word without its last symbol
+    uint8_t *syms; // last symbol of the word
+    uint32_t *lens; // number of symbols in the word
+    Lru *lru; // usage order of the words after wt_track, NULL otherwise
+    Counters counters; // of the codec using the table, with LZ_STATS
+} WordTable;
 
 /*
- * Creates a new Word with symbols syms and length len
- * Allocates new array and copies the symbols over
+ * Constructor:
+ * Creates a new table big enough to fit every code up to and including max_code
+ * Creates the first element at EMPTY_CODE, the empty word, and returns it
  */
-Word *word_create(uint8_t *syms, uint32_t len);
+WordTable *wt_create(uint32_t max_code);
 
 /*
- * Creates a new word by appending symbol sym to word w
- * Updates the length of the new word and copies symbols over
- * Returns a pointer to the newly allocated word
+ * Adds the word made of word prefix followed by sym under code
  */
-Word *word_append_sym(Word *w, uint8_t sym);
+void wt_add(WordTable *wt, uint32_t code, uint32_t prefix, uint8_t sym);
 
 /*
- * Deletes the word w
- * Frees up associated space
+ * Adds the 256 one-symbol words, each under first plus its symbol, which LZW streams start with
  */
-void word_delete(Word *w);
+void wt_seed(WordTable *wt, uint32_t first);
 
 /*
- * Constructor:
- * Creates a new table big enough to fit MAX_CODE
- * Creates the first element at EMPTY_CODE and returns it
+ * Adds the word made of word prefix followed by sym under the code of the least recently used
+ * word that no other word extends, or, if prefix is the only such word, under the spare entry at
+ * max_code without keeping it
+ * The table must be tracked
+ * Returns the code the word was added under
+ */
+uint32_t wt_recycle(WordTable *wt, uint32_t prefix, uint8_t sym);
+
+/*
+ * Starts tracking the usage order of the words added from now on, for wt_recycle
+ * max_code must be the one the table was created for
+ * Returns false if memory ran out
+ */
+bool wt_track(WordTable *wt, uint32_t max_code);
+
+/*
+ * Writes the symbols of the word under code into out
+ * out must have room for wt->lens[code] symbols
+ * Returns the number of symbols written
  */
-WordTable *wt_create(void);
+uint32_t wt_copy(WordTable *wt, uint32_t code, uint8_t *out);
 
 /*
- * Deletes all words except EMPTY_CODE
- * Frees associated memory
+ * Resets the table to only contain the empty word
+ * Constant time, entries are overwritten before they are read again
  */
 void wt_reset(WordTable *wt);
 
 /*
- * Destructor: Deletes all words and tables
+ * Destructor: Deletes the table
  * Frees up associated memory
  */
 void wt_delete(WordTable *wt);